@@ -0,0 +1,28 @@
+#include "clsCommandTiming.h"
+
+clsCommandTiming m_objCommandTiming;
+
+// The command in progress has been answered (or given up on), keep its stamps for the timing query
+void clsCommandTiming::Commit(int intCommand) {
+    memcpy(m_arrLast, m_arrCurrent, sizeof(m_arrLast));
+    m_intLastCommand = intCommand;
+    m_intSequence++;
+}
+
+// Fill the array with the last committed command, returns the number of values written.
+//
+// Layout:
+//   0      sequence number, increments on every commit
+//   1      command byte
+//   2-6    microseconds from each stage to the next: frame to received, received to parsed,
+//          parsed to bus start, bus start to bus end, bus end to reply
+int clsCommandTiming::intGetValues(long *arrValues) {
+    int n = 0;
+    
+    arrValues[n++] = m_intSequence;
+    arrValues[n++] = m_intLastCommand;
+    for (int i=1; i<TIMING_STAGES; i++) {
+        arrValues[n++] = m_arrLast[i] - m_arrLast[i - 1];
+    }
+    return n;
+}
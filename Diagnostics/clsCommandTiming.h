@@ -0,0 +1,50 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef COMMANDTIMING_H
+#define COMMANDTIMING_H 1
+
+// Stages of a command forwarded to the propeller, each one stamped from a free running microsecond timer
+#define TIMING_FRAME 0          // Frame read out of the EMAC (device_poll)
+#define TIMING_RECEIVED 1       // Segment handed to the command port (recv_callback)
+#define TIMING_PARSED 2         // Packet validated, about to be processed
+#define TIMING_BUS_START 3      // Packet about to be sent to the propeller
+#define TIMING_BUS_END 4        // Propeller transaction finished (reply or failure)
+#define TIMING_REPLY 5          // Reply written and tcp_output called
+#define TIMING_STAGES 6
+
+#define TIMING_VALUES (TIMING_STAGES + 1) // Number of values returned by intGetValues
+
+#define CMD_TIMING_NOW() (m_objCommandTiming.intNow())
+#define CMD_TIMING_MARK(x) (m_objCommandTiming.Mark(x))
+
+class clsCommandTiming {
+    private:
+        Timer           m_tmrClock;
+        int             m_arrCurrent[TIMING_STAGES];    // Stamps of the command in progress
+        
+    public:
+        int             m_intSequence;                  // Number of commands committed
+        int             m_intLastCommand;               // Command byte of the last committed command
+        int             m_arrLast[TIMING_STAGES];       // Stamps of the last committed command
+        
+        // Constructor
+        clsCommandTiming() {
+            m_intSequence = 0;
+            m_intLastCommand = 0;
+            memset(m_arrCurrent, 0, sizeof(m_arrCurrent));
+            memset(m_arrLast, 0, sizeof(m_arrLast));
+        }
+        
+        void Start() { m_tmrClock.start(); }
+        int intNow() { return m_tmrClock.read_us(); }
+        void Mark(int intStage) { m_arrCurrent[intStage] = m_tmrClock.read_us(); }
+        void MarkAt(int intStage, int intTime) { m_arrCurrent[intStage] = intTime; }
+        
+        void Commit(int intCommand);
+        int intGetValues(long *arrValues);
+};
+
+extern clsCommandTiming m_objCommandTiming;
+#endif
@@ -0,0 +1,111 @@
+#include "clsMemoryUsage.h"
+
+clsMemoryUsage m_objMemoryUsage;
+
+// Top of the C heap, from a probe allocation as the C library keeps its heap pointer to itself
+unsigned int *clsMemoryUsage::HeapTop() {
+#ifdef MEMORY_HEAP_TOP
+    return MEMORY_HEAP_TOP();
+#else
+    unsigned int *p = (unsigned int *)malloc(sizeof(unsigned int));
+
+    // No room left at all, the heap has reached the stack
+    if (p == NULL) {
+        return MEMORY_STACK_POINTER();
+    }
+    free(p);
+    return p + 1;
+#endif
+}
+
+// Paint the free space between the top of the heap and the stack pointer, call once first thing in main while the stack
+// is shallow and nothing has been freed yet
+void clsMemoryUsage::Paint() {
+    unsigned int *pBottom = HeapTop();
+    unsigned int *p;
+
+    if (pBottom > m_pHeapHighWater) { m_pHeapHighWater = pBottom; }
+
+    // An interrupt would push its frame onto the words being painted
+    __disable_irq();
+    p = MEMORY_STACK_POINTER() - MEMORY_PAINT_MARGIN;
+    if (pBottom < p) {
+        m_pPaintBottom = pBottom;
+        m_pPaintTop = p;
+        while (p > pBottom) { *--p = MEMORY_PAINT; }
+    }
+    __enable_irq();
+}
+
+// Start the lwIP high water marks again from the current use. The stack and heap marks come from the paint laid
+// down at boot and cover the whole run: once the heap has freed blocks the probe in HeapTop can return a hole below
+// its top, so repainting from there would overwrite live allocations.
+void clsMemoryUsage::Reset() {
+#if MEM_STATS
+    lwip_stats.mem.max = lwip_stats.mem.used;
+#endif
+#if MEMP_STATS
+    for (int i=0; i<MEMP_MAX; i++) {
+        lwip_stats.memp[i].max = lwip_stats.memp[i].used;
+    }
+#endif
+}
+
+// Fill the array with the memory use, returns the number of values written. Sizes are in bytes.
+//
+// Layout:
+//   0      free space when painted, from the top of the heap to the stack pointer
+//   1      deepest stack use, from the initial stack pointer
+//   2      current stack use
+//   3      least free space between the heap and the stack (painted words never written)
+//   4      heap growth since painting, high water
+//   5-8    lwIP heap: size, most used, least free, allocation failures
+//   9-     lwIP pools in memp_t order (see memp_std.h), each: least free of the configured number, most used, allocation failures
+int clsMemoryUsage::intGetValues(long *arrValues) {
+    unsigned int *pTop = MEMORY_STACK_TOP();
+    unsigned int *pHeap = HeapTop();
+    unsigned int *pFree, *p;
+    int n = 0;
+
+    if (pHeap > m_pHeapHighWater) { m_pHeapHighWater = pHeap; }
+
+    // Heap growth overwrites the painted words from the bottom, the stack from the top
+    p = m_pPaintBottom;
+    while (p < m_pPaintTop && *p != MEMORY_PAINT) { p++; }
+    if (p > m_pHeapHighWater) { m_pHeapHighWater = p; }
+    pFree = p;
+    while (p < m_pPaintTop && *p == MEMORY_PAINT) { p++; }
+
+    if (m_pPaintBottom == NULL) {
+        arrValues[n++] = 0;
+        arrValues[n++] = 0;
+        arrValues[n++] = (pTop - MEMORY_STACK_POINTER()) * sizeof(unsigned int);
+        arrValues[n++] = 0;
+        arrValues[n++] = 0;
+    } else {
+        arrValues[n++] = (m_pPaintTop - m_pPaintBottom) * sizeof(unsigned int);
+        arrValues[n++] = (pTop - p) * sizeof(unsigned int);
+        arrValues[n++] = (pTop - MEMORY_STACK_POINTER()) * sizeof(unsigned int);
+        arrValues[n++] = (p - pFree) * sizeof(unsigned int);
+        arrValues[n++] = (m_pHeapHighWater - m_pPaintBottom) * sizeof(unsigned int);
+    }
+
+#if MEM_STATS
+    arrValues[n++] = lwip_stats.mem.avail;
+    arrValues[n++] = lwip_stats.mem.max;
+    arrValues[n++] = (long)lwip_stats.mem.avail - lwip_stats.mem.max;
+    arrValues[n++] = lwip_stats.mem.err;
+#else
+    for (int i=0; i<4; i++) { arrValues[n++] = 0; }
+#endif
+#if MEMP_STATS
+    for (int i=0; i<MEMP_MAX; i++) {
+        arrValues[n++] = (long)lwip_stats.memp[i].avail - lwip_stats.memp[i].max;
+        arrValues[n++] = lwip_stats.memp[i].max;
+        arrValues[n++] = lwip_stats.memp[i].err;
+    }
+#else
+    for (int i=0; i<3 * MEMP_MAX; i++) { arrValues[n++] = 0; }
+#endif
+    return n;
+}
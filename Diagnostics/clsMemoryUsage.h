@@ -0,0 +1,45 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef MEMORYUSAGE_H
+#define MEMORYUSAGE_H 1
+
+#include "lwip/opt.h"
+#include "lwip/stats.h"
+#include "lwip/memp.h"
+
+// The stack grows down from the initial stack pointer (the first vector table entry) towards the top of the C heap,
+// both in the main SRAM block. The lwIP heap (MEM_SIZE), which the pools are taken from, is in AHB SRAM.
+#ifndef MEMORY_STACK_TOP
+#define MEMORY_STACK_TOP() (*(unsigned int **)SCB->VTOR)
+#define MEMORY_STACK_POINTER() ((unsigned int *)__get_MSP())
+#endif
+
+#define MEMORY_PAINT 0xC5C5C5C5     // Pattern painted over the free stack, any other value has been used
+#define MEMORY_PAINT_MARGIN 32      // Words left unpainted below the stack pointer, for the painting function's own frame
+#define MEMORY_VALUES (9 + 3 * MEMP_MAX) // Number of values returned by intGetValues
+
+class clsMemoryUsage {
+    private:
+        unsigned int    *m_pPaintBottom;        // Lowest painted word, the top of the heap when painted
+        unsigned int    *m_pPaintTop;           // One past the highest painted word
+        unsigned int    *m_pHeapHighWater;      // Highest heap top seen
+
+        unsigned int    *HeapTop();
+
+    public:
+        // Constructor
+        clsMemoryUsage() {
+            m_pPaintBottom = NULL;
+            m_pPaintTop = NULL;
+            m_pHeapHighWater = NULL;
+        }
+
+        void Paint();
+        void Reset();
+        int intGetValues(long *arrValues);
+};
+
+extern clsMemoryUsage m_objMemoryUsage;
+#endif
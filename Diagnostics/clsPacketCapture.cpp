@@ -0,0 +1,288 @@
+#include "clsPacketCapture.h"
+#include "lwip/ip.h"
+#include "netif/etharp.h"
+
+clsPacketCapture m_objPacketCapture;
+
+// In AHB SRAM next to the lwIP heap, the main SRAM block is left to the stack and the C heap
+static CaptureRecord m_arrRecords[CAPTURE_RECORDS] __attribute((section("AHBSRAM1"),aligned));
+
+// pcap file format, microsecond timestamps, written in the byte order of the firmware (the magic number tells readers which)
+#define PCAP_MAGIC 0xA1B2C3D4
+#define PCAP_LINKTYPE_ETHERNET 1
+
+struct PcapFileHeader {
+    u32_t           magic;
+    u16_t           version_major;
+    u16_t           version_minor;
+    s32_t           thiszone;
+    u32_t           sigfigs;
+    u32_t           snaplen;
+    u32_t           network;
+};
+
+struct PcapRecordHeader {
+    u32_t           ts_sec;
+    u32_t           ts_usec;
+    u32_t           incl_len;
+    u32_t           orig_len;
+};
+
+// ===========================================================================================================================================================================================
+// DOWNLOAD CONNECTION
+// ===========================================================================================================================================================================================
+
+static void err_callbackCapture(void *arg, err_t err) {
+    // The pcb has already been freed
+    m_objPacketCapture.m_objConnection = NULL;
+    m_objPacketCapture.Finish();
+}
+
+static err_t recv_callbackCapture(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    if (p == NULL) {
+        if (m_objPacketCapture.m_objConnection == pcb) {
+            m_objPacketCapture.Finish();
+        } else {
+            tcp_close(pcb);
+        }
+        return ERR_OK;
+    }
+
+    // Anything the client sends is ignored
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t accept_callbackCapture(void *arg, struct tcp_pcb *npcb, err_t err) {
+    // Only one client, a new one replaces the last and starts the download again
+    if (m_objPacketCapture.m_objConnection != NULL) {
+        tcp_err(m_objPacketCapture.m_objConnection, NULL);
+        tcp_recv(m_objPacketCapture.m_objConnection, NULL);
+        tcp_abort(m_objPacketCapture.m_objConnection);
+    }
+    tcp_err(npcb, &err_callbackCapture);
+    tcp_recv(npcb, &recv_callbackCapture);
+    m_objPacketCapture.Download(npcb);
+    return ERR_OK;
+}
+
+// Bind the capture port, call after the network interface is up
+void clsPacketCapture::Setup(int intPort) {
+    struct tcp_pcb *pcb;
+
+    m_intListenPort = intPort;
+
+    pcb = tcp_new();
+    if (pcb == NULL || tcp_bind(pcb, IP_ADDR_ANY, intPort) != ERR_OK) {
+        printf("Failed to bind TCP capture port to network interface\n");
+        return;
+    }
+    pcb = tcp_listen(pcb);
+    tcp_accept(pcb, &accept_callbackCapture);
+}
+
+// ===========================================================================================================================================================================================
+// CAPTURING
+// ===========================================================================================================================================================================================
+
+// Clear the ring and capture with the new flags, no direction flag turns the capture off
+void clsPacketCapture::Start(int intFlags, int intPort) {
+    m_intActive = 0;
+    m_intTriggers = 0;
+    m_intHead = 0;
+    m_intCount = 0;
+    m_intFrames = 0;
+    m_intTriggerEvent = 0;
+    m_intTriggerTime = 0;
+    m_intFlags = intFlags & 0xFF;
+    m_intPort = intPort;
+
+    if (!(m_intFlags & (CAPTURE_RX | CAPTURE_TX))) {
+        m_intState = CAPTURE_OFF;
+    } else if (m_intFlags & CAPTURE_TRIGGERS) {
+        m_intState = CAPTURE_ARMED;
+    } else {
+        m_intState = CAPTURE_RUNNING;
+    }
+
+    // A download in progress would mix the old and new captures
+    Finish();
+}
+
+// Capture again unless stopped or a download is holding the ring still
+void clsPacketCapture::Resume() {
+    if (m_objConnection != NULL) { return; }
+    m_intTriggers = (m_intState == CAPTURE_ARMED) ? (m_intFlags & CAPTURE_TRIGGERS) : 0;
+    m_intActive = (m_intState == CAPTURE_RUNNING || m_intState == CAPTURE_ARMED || m_intState == CAPTURE_TRIGGERED);
+}
+
+// Frames on the capture port are never kept, otherwise a port filter needs that TCP or UDP port at either end
+int clsPacketCapture::intPortMatches(u8_t *d, int intLength) {
+    int intHeader, intSource, intDest;
+
+    if (intLength < 34 || ((d[12] << 8) | d[13]) != ETHTYPE_IP || (d[23] != IP_PROTO_TCP && d[23] != IP_PROTO_UDP)) {
+        return m_intPort == 0;
+    }
+    intHeader = 14 + (d[14] & 0x0f) * 4;
+    if (intHeader + 4 > intLength) {
+        return m_intPort == 0;
+    }
+
+    intSource = (d[intHeader] << 8) | d[intHeader + 1];
+    intDest = (d[intHeader + 2] << 8) | d[intHeader + 3];
+    if (intSource == m_intListenPort || intDest == m_intListenPort) {
+        return 0;
+    }
+    return m_intPort == 0 || intSource == m_intPort || intDest == m_intPort;
+}
+
+// Keep the start of a frame, called through CAPTURE_FRAME so it only runs while capturing
+void clsPacketCapture::Add(int intDirection, struct pbuf *p) {
+    CaptureRecord *r = &m_arrRecords[m_intHead];
+    u8_t arrHeader[CAPTURE_FILTER_BYTES];
+
+    if (!(m_intFlags & intDirection)) { return; }
+
+    // The headers are filtered from a copy, once the ring is full the slot still holds the oldest frame kept
+    if (!intPortMatches(arrHeader, pbuf_copy_partial(p, arrHeader, sizeof(arrHeader), 0))) { return; }
+    r->caplen = pbuf_copy_partial(p, r->data, CAPTURE_SNAPLEN, 0);
+    r->time = CMD_TIMING_NOW();
+    r->length = p->tot_len;
+    r->direction = intDirection;
+
+    m_intHead = (m_intHead + 1) % CAPTURE_RECORDS;
+    if (m_intCount < CAPTURE_RECORDS) { m_intCount++; }
+    m_intFrames++;
+
+    if (m_intState == CAPTURE_TRIGGERED && --m_intPostTrigger <= 0) {
+        m_intState = CAPTURE_STOPPED;
+        m_intActive = 0;
+    }
+}
+
+// An armed event has happened, keep capturing until the ring holds as many frames after it as before
+void clsPacketCapture::Trigger(int intEvent) {
+    m_intTriggers = 0;
+    m_intTriggerEvent = intEvent;
+    m_intTriggerTime = CMD_TIMING_NOW();
+    m_intPostTrigger = CAPTURE_POST_TRIGGER;
+    m_intState = CAPTURE_TRIGGERED;
+}
+
+// ===========================================================================================================================================================================================
+// DOWNLOADING
+// ===========================================================================================================================================================================================
+
+// Send the ring to a new connection, nothing is captured until it has all been sent
+void clsPacketCapture::Download(struct tcp_pcb *pcb) {
+    m_objConnection = pcb;
+    m_intActive = 0;
+    m_intTriggers = 0;
+    m_intSendHeader = 1;
+    m_intSendNext = 0;
+    m_intSendLastTime = m_arrRecords[(m_intHead + CAPTURE_RECORDS - m_intCount) % CAPTURE_RECORDS].time;
+    m_intSendWraps = 0;
+}
+
+// End the download and carry on capturing
+void clsPacketCapture::Finish() {
+    if (m_objConnection != NULL) {
+        tcp_err(m_objConnection, NULL);
+        if (tcp_close(m_objConnection) != ERR_OK) {
+            tcp_recv(m_objConnection, NULL);
+            tcp_abort(m_objConnection);
+        }
+        m_objConnection = NULL;
+    }
+    Resume();
+}
+
+// Called on every pass of the main loop. Queues as many whole records as fit, so it never blocks.
+void clsPacketCapture::Drain() {
+    u8_t arrBatch[CAPTURE_TCP_QUEUE];
+    unsigned int intNext;
+    u32_t intLastTime, intWraps;
+    int intRoom, n = 0;
+
+    if (m_objConnection == NULL) { return; }
+
+    // Bounded like the trace connection, the services sharing the lwIP heap are not charged for it
+    intRoom = CAPTURE_TCP_QUEUE - (TCP_SND_BUF - (int)tcp_sndbuf(m_objConnection));
+
+    if (m_intSendHeader) {
+        struct PcapFileHeader objHeader;
+        if (intRoom < (int)sizeof(objHeader)) { return; }
+        objHeader.magic = PCAP_MAGIC;
+        objHeader.version_major = 2;
+        objHeader.version_minor = 4;
+        objHeader.thiszone = 0;
+        objHeader.sigfigs = 0;
+        objHeader.snaplen = CAPTURE_SNAPLEN;
+        objHeader.network = PCAP_LINKTYPE_ETHERNET;
+        memcpy(arrBatch, &objHeader, sizeof(objHeader));
+        n += sizeof(objHeader);
+    }
+
+    // Oldest record first, the timestamps are unwrapped into seconds since the clock started
+    intNext = m_intSendNext;
+    intLastTime = m_intSendLastTime;
+    intWraps = m_intSendWraps;
+    while (intNext < m_intCount) {
+        CaptureRecord *r = &m_arrRecords[(m_intHead + CAPTURE_RECORDS - m_intCount + intNext) % CAPTURE_RECORDS];
+        struct PcapRecordHeader objRecord;
+        unsigned long long lngTime;
+
+        if (n + (int)sizeof(objRecord) + r->caplen > intRoom) { break; }
+        if (r->time < intLastTime) { intWraps++; }
+        intLastTime = r->time;
+        lngTime = ((unsigned long long)intWraps << 32) | r->time;
+
+        objRecord.ts_sec = (u32_t)(lngTime / 1000000);
+        objRecord.ts_usec = (u32_t)(lngTime % 1000000);
+        objRecord.incl_len = r->caplen;
+        objRecord.orig_len = r->length;
+        memcpy(&arrBatch[n], &objRecord, sizeof(objRecord));
+        n += sizeof(objRecord);
+        memcpy(&arrBatch[n], r->data, r->caplen);
+        n += r->caplen;
+        intNext++;
+    }
+
+    if (n == 0) {
+        // Everything has been queued, closing sends it before the FIN
+        if (m_intSendNext >= m_intCount) { Finish(); }
+        return;
+    }
+
+    // Nothing moves on until the write has been taken, a failed one is tried again on the next pass
+    if (tcp_write(m_objConnection, arrBatch, n, 1) != ERR_OK) { return; }
+    tcp_output(m_objConnection);
+    m_intSendHeader = 0;
+    m_intSendNext = intNext;
+    m_intSendLastTime = intLastTime;
+    m_intSendWraps = intWraps;
+}
+
+// Fill the array with the capture state, returns the number of values written.
+//
+// Layout:
+//   0      state (CAPTURE_OFF to CAPTURE_STOPPED)
+//   1      flags
+//   2      port filter, 0 for any
+//   3      frames held
+//   4      frames captured since the capture was started
+//   5      trigger that stopped the capture (CAPTURE_TRIGGER_*), 0 if none yet
+//   6      time of the trigger in microseconds, on the command timing clock
+int clsPacketCapture::intGetValues(long *arrValues) {
+    int n = 0;
+
+    arrValues[n++] = m_intState;
+    arrValues[n++] = m_intFlags;
+    arrValues[n++] = m_intPort;
+    arrValues[n++] = m_intCount;
+    arrValues[n++] = m_intFrames;
+    arrValues[n++] = m_intTriggerEvent;
+    arrValues[n++] = m_intTriggerTime;
+    return n;
+}
@@ -0,0 +1,110 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef PACKETCAPTURE_H
+#define PACKETCAPTURE_H 1
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+#include "clsCommandTiming.h"
+
+#define CAPTURE_TCP_PORT 10013      // A connection is sent the capture as a pcap stream and then closed
+#define CAPTURE_RECORDS 32          // Frames held, oldest overwritten first
+#define CAPTURE_SNAPLEN 120         // Bytes kept of each frame, the headers and the start of a command or reply
+#define CAPTURE_FILTER_BYTES 78     // Bytes read to filter a frame: Ethernet header, largest IP header, TCP or UDP ports
+#define CAPTURE_TCP_QUEUE 512       // Most bytes queued on the download connection at once (the lwIP heap is shared)
+#define CAPTURE_POST_TRIGGER (CAPTURE_RECORDS / 2) // Frames captured after a trigger, the rest are from before it
+
+// Flags, set with node 3 command 241. Frames on the capture port itself are never captured.
+#define CAPTURE_RX 0x01                 // Frames accepted by the receive filter (device_poll)
+#define CAPTURE_TX 0x02                 // Frames sent (device_output)
+#define CAPTURE_TRIGGER_CHECKSUM 0x10   // Stop after a command checksum mismatch
+#define CAPTURE_TRIGGER_FRAMING 0x20    // Stop after command data without a valid STX/ETX structure
+#define CAPTURE_TRIGGER_OVERFLOW 0x40   // Stop after the command buffer was cleared as it was full
+#define CAPTURE_TRIGGER_PROPELLER 0x80  // Stop after a propeller command got no valid reply
+#define CAPTURE_TRIGGERS 0xF0
+#define CAPTURE_SET 0x100               // Command 241 value: set the flags to the low byte and restart the capture
+
+// States
+#define CAPTURE_OFF 0
+#define CAPTURE_RUNNING 1               // No triggers, the ring always holds the latest frames
+#define CAPTURE_ARMED 2                 // Waiting for a trigger
+#define CAPTURE_TRIGGERED 3             // Capturing the frames after the trigger
+#define CAPTURE_STOPPED 4               // Held until the capture is restarted
+
+// A single test on the frame path while the capture is off
+#define CAPTURE_FRAME(dir, p) do { if (m_objPacketCapture.m_intActive) { m_objPacketCapture.Add((dir), (p)); } } while (0)
+#define CAPTURE_TRIGGER(ev) do { if (m_objPacketCapture.m_intTriggers & (ev)) { m_objPacketCapture.Trigger(ev); } } while (0)
+
+#define CAPTURE_VALUES 7 // Number of values returned by intGetValues
+
+struct CaptureRecord {
+    u32_t           time;                           // Microseconds, on the command timing clock
+    u16_t           length;                         // Length of the whole frame
+    u8_t            caplen;                         // Bytes kept
+    u8_t            direction;                      // CAPTURE_RX or CAPTURE_TX
+    u8_t            data[CAPTURE_SNAPLEN];
+};
+
+class clsPacketCapture {
+    private:
+        unsigned int    m_intHead;                      // Next record to write
+        unsigned int    m_intCount;                     // Records held
+        int             m_intPostTrigger;               // Frames still to capture after the trigger
+        int             m_intListenPort;
+
+        // Download
+        int             m_intSendHeader;                // The pcap file header is still to be sent
+        unsigned int    m_intSendNext;                  // Records sent so far, oldest first
+        u32_t           m_intSendLastTime;
+        u32_t           m_intSendWraps;                 // Times the microsecond clock has wrapped, to unwrap the timestamps
+
+        int             intPortMatches(u8_t *d, int intLength);
+        void            Resume();
+
+    public:
+        struct tcp_pcb  *m_objConnection;
+        volatile int    m_intActive;                    // Nonzero while frames are being captured
+        volatile int    m_intTriggers;                  // Triggers armed, zero unless waiting for one
+        int             m_intState;
+        int             m_intFlags;
+        int             m_intPort;                      // TCP or UDP port either end must use, 0 for any
+        unsigned int    m_intFrames;                    // Frames captured since the capture was started
+        int             m_intTriggerEvent;              // Trigger that fired (CAPTURE_TRIGGER_*)
+        u32_t           m_intTriggerTime;
+
+        // Constructor
+        clsPacketCapture() {
+            m_intHead = 0;
+            m_intCount = 0;
+            m_intPostTrigger = 0;
+            m_intListenPort = 0;
+            m_intSendHeader = 0;
+            m_intSendNext = 0;
+            m_intSendLastTime = 0;
+            m_intSendWraps = 0;
+            m_objConnection = NULL;
+            m_intActive = 0;
+            m_intTriggers = 0;
+            m_intState = CAPTURE_OFF;
+            m_intFlags = 0;
+            m_intPort = 0;
+            m_intFrames = 0;
+            m_intTriggerEvent = 0;
+            m_intTriggerTime = 0;
+        }
+
+        void Setup(int intPort);
+        void Start(int intFlags, int intPort);
+        void Add(int intDirection, struct pbuf *p);
+        void Trigger(int intEvent);
+        void Download(struct tcp_pcb *pcb);
+        void Finish();
+        void Drain();
+        int intGetValues(long *arrValues);
+};
+
+extern clsPacketCapture m_objPacketCapture;
+#endif
@@ -0,0 +1,47 @@
+#include "clsStageProfile.h"
+
+clsStageProfile m_objStageProfile;
+
+// Enable the DWT cycle counter, it keeps counting from wherever it is (a debugger may already be using it)
+void clsStageProfile::Start() {
+    DWT_DEMCR |= DWT_DEMCR_TRCENA;
+    DWT_CONTROL |= DWT_CONTROL_CYCCNTENA;
+}
+
+void clsStageProfile::Add(int intStage, unsigned int intCycles) {
+    StageHistogram *h = &m_arrStages[intStage];
+    int intBucket = 0;
+    
+    if (intCycles > 0) { intBucket = 31 - __builtin_clz(intCycles); }
+    h->buckets[intBucket]++;
+    h->count++;
+    h->total += intCycles;
+    if (intCycles > h->max) { h->max = intCycles; }
+}
+
+void clsStageProfile::Reset(int intStage) {
+    memset(&m_arrStages[intStage], 0, sizeof(StageHistogram));
+}
+
+// Fill the array with one stage's histogram, returns the number of values written.
+//
+// Layout:
+//   0      core clock in Hz, to convert cycles to time
+//   1      number of durations recorded
+//   2      longest duration in cycles
+//   3-4    total cycles, low and high 32 bits
+//   5-36   bucket counts, bucket n is 2^n to 2^(n+1)-1 cycles
+int clsStageProfile::intGetValues(int intStage, long *arrValues) {
+    StageHistogram *h = &m_arrStages[intStage];
+    int n = 0;
+    
+    arrValues[n++] = SystemCoreClock;
+    arrValues[n++] = h->count;
+    arrValues[n++] = h->max;
+    arrValues[n++] = (long)(h->total & 0xFFFFFFFF);
+    arrValues[n++] = (long)(h->total >> 32);
+    for (int i=0; i<PROFILE_BUCKETS; i++) {
+        arrValues[n++] = h->buckets[i];
+    }
+    return n;
+}
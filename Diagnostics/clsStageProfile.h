@@ -0,0 +1,69 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef STAGEPROFILE_H
+#define STAGEPROFILE_H 1
+
+// Cortex-M3 cycle counter registers, the CMSIS headers in the mbed library do not define the DWT
+#ifndef DWT_CYCCNT
+#define DWT_DEMCR (*(volatile uint32_t *)0xE000EDFC)      // Debug exception and monitor control
+#define DWT_CONTROL (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT (*(volatile uint32_t *)0xE0001004)
+#endif
+#define DWT_DEMCR_TRCENA (1UL << 24)                       // Enables the DWT
+#define DWT_CONTROL_CYCCNTENA 1UL                          // Starts the cycle counter
+
+// Profiled stages. The main loop stages run back to back, commands run inside PROFILE_DEVICE_POLL.
+#define PROFILE_OUTPUTS 0           // clsOutputDriver::Poll
+#define PROFILE_SERIAL 1            // ProcessLoop_CheckSerialPorts
+#define PROFILE_DEVICE_POLL 2       // device_poll, including every command it dispatches
+#define PROFILE_TIMERS 3            // PollTimers (lwIP timers)
+#define PROFILE_LED 4               // Status LED fade
+#define PROFILE_LOOP 5              // One whole pass of the main loop
+#define PROFILE_COMMAND_PROPELLER 6 // TCPPacketReceived for node 1, including the propeller transaction and reply
+#define PROFILE_COMMAND_MBED 7      // TCPPacketReceived for node 3
+#define PROFILE_TRACE 8             // Trace and packet capture drains (see clsTrace, clsPacketCapture)
+#define PROFILE_SNAPSHOT 9           // clsAxisSnapshot::Poll, a background Propeller read when one is due
+#define PROFILE_RULES 10             // clsRuleEngine::Poll, the Propeller commands of rules that have fired
+#define PROFILE_POSITION_CAPTURE 11  // clsPositionCapture::Poll, the encoder read for captures waiting on it
+#define PROFILE_STAGES 12
+
+// Bucket n counts durations of 2^n to 2^(n+1)-1 cycles (bucket 0 also counts 0), so 32 buckets cover the whole counter
+#define PROFILE_BUCKETS 32
+#define PROFILE_VALUES (PROFILE_BUCKETS + 5) // Number of values returned by intGetValues
+
+#define STAGE_PROFILE_NOW() ((unsigned int)DWT_CYCCNT)
+
+struct StageHistogram {
+    unsigned int        count;
+    unsigned int        max;                            // Longest duration in cycles
+    unsigned long long  total;                          // Sum of every duration in cycles
+    unsigned int        buckets[PROFILE_BUCKETS];
+};
+
+class clsStageProfile {
+    public:
+        StageHistogram  m_arrStages[PROFILE_STAGES];
+        
+        // Constructor
+        clsStageProfile() {
+            memset(m_arrStages, 0, sizeof(m_arrStages));
+        }
+        
+        void Start();
+        
+        // Record the time since intStart against the stage, returns the current count so stages can be chained
+        unsigned int intRecord(int intStage, unsigned int intStart) {
+            unsigned int intNow = STAGE_PROFILE_NOW();
+            Add(intStage, intNow - intStart);
+            return intNow;
+        }
+        
+        void Add(int intStage, unsigned int intCycles);
+        void Reset(int intStage);
+        int intGetValues(int intStage, long *arrValues);
+};
+
+extern clsStageProfile m_objStageProfile;
+#endif
@@ -0,0 +1,138 @@
+#include "clsStatistics.h"
+#include "clsServiceReservations.h"
+#include "device.h"
+
+clsStatistics m_objStatistics;
+
+// Answer any datagram received on the statistics port with the statistics blob
+static void recv_callbackStatistics(void *arg, struct udp_pcb *pcb, struct pbuf *p, struct ip_addr *addr, u16_t port) {
+    u32_t arrValues[STATISTICS_MAX_VALUES];
+    
+    // The request content is not used
+    pbuf_free(p);
+    
+    // Send the values as a raw little endian array, there is no framing to protect on UDP
+    int intCount = m_objStatistics.intGetValues(arrValues, STATISTICS_MAX_VALUES);
+    struct pbuf *reply = pbuf_alloc(PBUF_TRANSPORT, intCount * sizeof(u32_t), PBUF_RAM);
+    if (reply == NULL) {
+        return;
+    }
+    
+    memcpy(reply->payload, arrValues, intCount * sizeof(u32_t));
+    udp_sendto(pcb, reply, addr, port);
+    pbuf_free(reply);
+}
+
+// Bind the UDP statistics query port, call after the network interface is up
+void clsStatistics::SetupUDPQuery(int intPort) {
+    m_objUDPQuery = udp_new();
+    if (m_objUDPQuery == NULL || udp_bind(m_objUDPQuery, IP_ADDR_ANY, intPort) != ERR_OK) {
+        printf("Failed to bind UDP statistics port to network interface\n");
+        return;
+    }
+    
+    udp_recv(m_objUDPQuery, &recv_callbackStatistics, NULL);
+}
+
+// Helpers to append counter groups, a disabled lwIP group is reported as zeros so that the layout never changes
+static int intAddProtocol(u32_t *arrValues, int n, struct stats_proto *proto, int intChecksums, int intMemory, int intRetransmits) {
+    arrValues[n++] = proto->xmit;
+    arrValues[n++] = proto->recv;
+    arrValues[n++] = proto->drop;
+    if (intChecksums) { arrValues[n++] = proto->chkerr; }
+    if (intMemory) { arrValues[n++] = proto->memerr; }
+    if (intRetransmits) { arrValues[n++] = proto->rexmit; }
+    return n;
+}
+
+static int intAddZeros(u32_t *arrValues, int n, int intCount) {
+    while (intCount-- > 0) { arrValues[n++] = 0; }
+    return n;
+}
+
+// Fill the array with all counters, returns the number of values written.
+//
+// Layout (32 bit values, new values are only appended):
+//   0      header: STATISTICS_VERSION << 16 | number of values
+//   1-6    link: xmit, recv, drop, memerr, lenerr, proterr
+//   7-10   etharp: xmit, recv, drop, cachehit
+//   11-14  ip: xmit, recv, drop, chkerr
+//   15-17  udp: xmit, recv, drop
+//   18-23  tcp: xmit, recv, drop, chkerr, memerr, rexmit
+//   24-27  heap: avail, used, max, err
+//   28-39  pools PBUF_POOL, PBUF, TCP_SEG, TCP_PCB: used, max, err each
+//   40-62  firmware counters, in the order of struct FirmwareCounters
+//   63-66  transmit reservation failures: command, serial 1, serial 2, serial 3
+//   67-73  receive filter: accepted, then dropped as short, ethertype, arp target, ip dest, ip protocol, port
+//   74     receive filter: accepted frames dispatched as priority traffic
+//   75-80  serial bridge busy time (us): serial to TCP for ports 1-3, then TCP to serial for ports 1-3
+int clsStatistics::intGetValues(u32_t *arrValues, int intMaxValues) {
+    int n = 1;
+    
+    if (intMaxValues < STATISTICS_MAX_VALUES) { return 0; }
+    
+#if LINK_STATS
+    n = intAddProtocol(arrValues, n, &lwip_stats.link, 0, 1, 0);
+    arrValues[n++] = lwip_stats.link.lenerr;
+    arrValues[n++] = lwip_stats.link.proterr;
+#else
+    n = intAddZeros(arrValues, n, 6);
+#endif
+#if ETHARP_STATS
+    n = intAddProtocol(arrValues, n, &lwip_stats.etharp, 0, 0, 0);
+    arrValues[n++] = lwip_stats.etharp.cachehit;
+#else
+    n = intAddZeros(arrValues, n, 4);
+#endif
+#if IP_STATS
+    n = intAddProtocol(arrValues, n, &lwip_stats.ip, 1, 0, 0);
+#else
+    n = intAddZeros(arrValues, n, 4);
+#endif
+#if UDP_STATS
+    n = intAddProtocol(arrValues, n, &lwip_stats.udp, 0, 0, 0);
+#else
+    n = intAddZeros(arrValues, n, 3);
+#endif
+#if TCP_STATS
+    n = intAddProtocol(arrValues, n, &lwip_stats.tcp, 1, 1, 1);
+#else
+    n = intAddZeros(arrValues, n, 6);
+#endif
+#if MEM_STATS
+    arrValues[n++] = lwip_stats.mem.avail;
+    arrValues[n++] = lwip_stats.mem.used;
+    arrValues[n++] = lwip_stats.mem.max;
+    arrValues[n++] = lwip_stats.mem.err;
+#else
+    n = intAddZeros(arrValues, n, 4);
+#endif
+#if MEMP_STATS
+    const int arrPools[4] = { MEMP_PBUF_POOL, MEMP_PBUF, MEMP_TCP_SEG, MEMP_TCP_PCB };
+    for (int i=0; i<4; i++) {
+        arrValues[n++] = lwip_stats.memp[arrPools[i]].used;
+        arrValues[n++] = lwip_stats.memp[arrPools[i]].max;
+        arrValues[n++] = lwip_stats.memp[arrPools[i]].err;
+    }
+#else
+    n = intAddZeros(arrValues, n, 12);
+#endif
+    
+    // Firmware counters are all u32_t so they can be copied as they are
+    memcpy(&arrValues[n], &m_objCounters, sizeof(m_objCounters));
+    n += sizeof(m_objCounters) / sizeof(u32_t);
+    
+    for (int i=0; i<SERVICE_COUNT; i++) {
+        arrValues[n++] = m_objServiceReservations.m_arrFailures[i];
+    }
+    
+    // Receive filter counters are all u32_t as well
+    memcpy(&arrValues[n], &device_filter_stats, sizeof(device_filter_stats));
+    n += sizeof(device_filter_stats) / sizeof(u32_t);
+    
+    memcpy(&arrValues[n], &m_objBridgeTimes, sizeof(m_objBridgeTimes));
+    n += sizeof(m_objBridgeTimes) / sizeof(u32_t);
+    
+    arrValues[0] = (STATISTICS_VERSION << 16) | n;
+    return n;
+}
@@ -0,0 +1,66 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef STATISTICS_H
+#define STATISTICS_H 1
+
+#include "lwip/opt.h"
+#include "lwip/stats.h"
+#include "lwip/udp.h"
+
+#define STATISTICS_UDP_PORT 10010   // Any datagram to this port is answered with the statistics blob
+#define STATISTICS_VERSION 1        // New values are only ever appended, bump this if existing values move
+#define STATISTICS_MAX_VALUES 96    // Maximum number of 32 bit values in the statistics blob
+
+// Firmware counters. Every update is a single increment (see FW_STATS_INC), never a printf, so they can live on hot paths.
+struct FirmwareCounters {
+    u32_t           rxFramesNoBuffer;           // Frames dropped as no pbuf could be allocated (the next receive discards them)
+    u32_t           commandsReceived;           // Valid packets received on the command port
+    u32_t           commandFramingErrors;       // Command port data without a valid STX/ETX structure
+    u32_t           commandChecksumErrors;      // Command port packets with a bad checksum
+    u32_t           commandBufferOverflows;     // Command port buffer cleared as it was full
+    u32_t           replyWriteErrors;           // tcp_write failures replying on the command port
+    u32_t           propellerTransactions;      // Packets sent to the propeller
+    u32_t           propellerRetries;           // Packets re-sent to the propeller
+    u32_t           propellerFailures;          // Packets with no valid reply after all retries
+    u32_t           propellerTimeouts;          // Handshake timeouts waiting for the propeller
+    u32_t           propellerChecksumErrors;    // Propeller replies with a bad checksum
+    u32_t           serialToTCPBytes[3];        // Bytes bridged from each serial port to TCP
+    u32_t           serialToTCPDroppedBytes[3]; // Bytes dropped as the TCP send buffer was full
+    u32_t           tcpToSerialBytes[3];        // Bytes bridged from TCP to each serial port
+    u32_t           tcpToSerialOverflows[3];    // TCP segments truncated to the bridge buffer size
+};
+
+// Time spent bridging each serial port, in microseconds. Kept apart from FirmwareCounters so no existing value moves in the blob.
+struct BridgeTimes {
+    u32_t           serialToTCPUs[3];           // Serial buffer read out and queued on TCP (ProcessLoop_CheckSerialPorts)
+    u32_t           tcpToSerialUs[3];           // TCP data written to the UART, including waits for the transmit FIFO
+};
+
+#define FW_STATS_INC(x) (++m_objStatistics.m_objCounters.x)
+#define FW_STATS_ADD(x, n) (m_objStatistics.m_objCounters.x += (n))
+#define FW_STATS_TIME(x, n) (m_objStatistics.m_objBridgeTimes.x += (n))
+
+class clsStatistics {
+    private:
+        struct udp_pcb  *m_objUDPQuery;
+
+    public:
+        struct FirmwareCounters m_objCounters;
+        struct BridgeTimes m_objBridgeTimes;
+
+        // Constructor
+        clsStatistics() {
+            m_objUDPQuery = NULL;
+            memset(&m_objCounters, 0, sizeof(m_objCounters));
+            memset(&m_objBridgeTimes, 0, sizeof(m_objBridgeTimes));
+        }
+
+        void SetupUDPQuery(int intPort);
+        int intGetValues(u32_t *arrValues, int intMaxValues);
+};
+
+// Statically allocated so that counter updates do not need a pointer dereference
+extern clsStatistics m_objStatistics;
+#endif
@@ -0,0 +1,166 @@
+#include "clsTrace.h"
+
+clsTrace m_objTrace;
+
+// Text of each event for the USB serial port, formatted with arg0 and arg1 (either may be left unused)
+static const struct {
+    unsigned short  event;
+    const char      *format;
+} m_arrEventFormats[] = {
+    { TRACE_COMMAND_FRAMING, "Command STX/ETX invalid: %d %ld" },
+    { TRACE_COMMAND_CHECKSUM, "Command checksum mismatch: calculated %d, received %ld" },
+    { TRACE_COMMAND_UNKNOWN, "Parameter not found: %d" },
+    { TRACE_PROPELLER_TX_TIMEOUT, "Timed out sending byte %d to propeller (%ld)" },
+    { TRACE_PROPELLER_RX_TIMEOUT, "Timed out receiving byte %d from propeller (%ld)" },
+    { TRACE_PROPELLER_CHECKSUM, "Checksum from propeller is invalid, try %d, length %ld" },
+    { TRACE_BRIDGE_OVERFLOW, "Serial port %d transmit buffer overflow, %ld bytes" },
+    { TRACE_BRIDGE_TO_TCP, "Serial port %d data to TCP, %ld bytes" },
+    { TRACE_CONNECTION_ACCEPT, "Accepted connection on port %d" },
+    { TRACE_CONNECTION_CLOSED, "Connection closed on port %d" },
+    { TRACE_COMMAND_RECEIVED, "Received command %d, node %ld" },
+    { TRACE_SPAN_COMMAND, "Command %d, node %ld" },
+    { TRACE_SPAN_PROPELLER, "Propeller command %d, %ld bytes" },
+    { TRACE_SPAN_TCP_SEND, "TCP send for service %d, %ld bytes" },
+    { TRACE_SPAN_TIMER, "lwIP timer %d" },
+    { TRACE_SPAN_SERIAL_ISR, "Serial port %d receive interrupt, %ld bytes" },
+};
+
+// ===========================================================================================================================================================================================
+// TRACE CONNECTION
+// ===========================================================================================================================================================================================
+
+static void err_callbackTrace(void *arg, err_t err) {
+    // The pcb has already been freed
+    m_objTrace.m_objConnection = NULL;
+}
+
+static err_t recv_callbackTrace(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    if (p == NULL) {
+        if (m_objTrace.m_objConnection == pcb) { m_objTrace.m_objConnection = NULL; }
+        tcp_close(pcb);
+        return ERR_OK;
+    }
+    
+    // The last byte received sets the categories, so a trace client never has to use the command port
+    struct pbuf *q = p;
+    while (q->next != NULL) { q = q->next; }
+    if (q->len > 0) { m_objTrace.m_intCategories = ((u8_t *)q->payload)[q->len - 1]; }
+    
+    tcp_recved(pcb, p->tot_len);
+    pbuf_free(p);
+    return ERR_OK;
+}
+
+static err_t accept_callbackTrace(void *arg, struct tcp_pcb *npcb, err_t err) {
+    // Only one client, a new one replaces the last
+    if (m_objTrace.m_objConnection != NULL) {
+        tcp_err(m_objTrace.m_objConnection, NULL);
+        tcp_recv(m_objTrace.m_objConnection, NULL);
+        tcp_abort(m_objTrace.m_objConnection);
+    }
+    tcp_err(npcb, &err_callbackTrace);
+    tcp_recv(npcb, &recv_callbackTrace);
+    m_objTrace.m_objConnection = npcb;
+    return ERR_OK;
+}
+
+// Set the USB serial port and bind the trace port, call after the network interface is up
+void clsTrace::Setup(Serial *objUSB, int intPort) {
+    struct tcp_pcb *pcb;
+    
+    m_objUSB = objUSB;
+    
+    pcb = tcp_new();
+    if (pcb == NULL || tcp_bind(pcb, IP_ADDR_ANY, intPort) != ERR_OK) {
+        printf("Failed to bind TCP trace port to network interface\n");
+        return;
+    }
+    pcb = tcp_listen(pcb);
+    tcp_accept(pcb, &accept_callbackTrace);
+}
+
+// ===========================================================================================================================================================================================
+// DRAINING
+// ===========================================================================================================================================================================================
+
+// Take the next record off the ring, records lost since the last one come first as a TRACE_LOST record. It takes the time of
+// the record that follows it, or the current time when none is queued, so the times never go backwards.
+int clsTrace::intTakeRecord(TraceRecord *objRecord) {
+    if (m_intLost > 0) {
+        objRecord->time = (m_intTail != m_intHead) ? m_arrRecords[m_intTail].time : CMD_TIMING_NOW();
+        objRecord->event = TRACE_LOST;
+        objRecord->arg0 = 0;
+        __disable_irq();
+        objRecord->arg1 = m_intLost;
+        m_intLost = 0;
+        __enable_irq();
+        return 1;
+    }
+    if (m_intTail == m_intHead) { return 0; }
+    
+    *objRecord = m_arrRecords[m_intTail];
+    m_intTail = (m_intTail + 1) & (TRACE_RECORDS - 1);
+    return 1;
+}
+
+// Called on every pass of the main loop. Only ever writes what the UART FIFO or the connection can take, so it never blocks.
+void clsTrace::Drain() {
+    if (m_objConnection != NULL) {
+        DrainTCP();
+    } else if (m_objUSB != NULL) {
+        DrainUSB();
+    }
+}
+
+void clsTrace::DrainUSB() {
+    TraceRecord objRecord;
+    
+    while (m_objUSB->writeable()) {
+        // Format the next record once the last one has been written
+        if (m_intLinePosition >= m_intLineLength) {
+            if (!intTakeRecord(&objRecord)) { return; }
+            
+            // Both ends of a span share the text of its begin event
+            int intSpan = (objRecord.event >> 8) & (TRACE_TIMELINE | TRACE_TIMELINE_ISR);
+            int intEvent = intSpan ? (objRecord.event & ~TRACE_SPAN_END) : objRecord.event;
+            const char *strFormat = "Event %d: %ld";
+            for (unsigned int i=0; i<sizeof(m_arrEventFormats) / sizeof(m_arrEventFormats[0]); i++) {
+                if (m_arrEventFormats[i].event == intEvent) { strFormat = m_arrEventFormats[i].format; break; }
+            }
+            
+            // Leave room for the line end, snprintf returns the untruncated length
+            int n = snprintf(m_strLine, TRACE_LINE - 2, "%10lu ", (unsigned long)objRecord.time);
+            if (objRecord.event == TRACE_LOST) {
+                n += snprintf(&m_strLine[n], TRACE_LINE - 2 - n, "%ld trace records lost", (long)objRecord.arg1);
+            } else {
+                n += snprintf(&m_strLine[n], TRACE_LINE - 2 - n, strFormat, (int)objRecord.arg0, (long)objRecord.arg1);
+                if (intSpan && n < TRACE_LINE - 2) {
+                    n += snprintf(&m_strLine[n], TRACE_LINE - 2 - n, (objRecord.event & TRACE_SPAN_END) ? " end" : " begin");
+                }
+            }
+            m_intLineLength = (n < TRACE_LINE - 3) ? n : TRACE_LINE - 3;
+            m_strLine[m_intLineLength++] = '\r';
+            m_strLine[m_intLineLength++] = '\n';
+            m_intLinePosition = 0;
+        }
+        m_objUSB->putc(m_strLine[m_intLinePosition++]);
+    }
+}
+
+void clsTrace::DrainTCP() {
+    TraceRecord arrBatch[TRACE_TCP_QUEUE / sizeof(TraceRecord)];
+    int intRoom, n = 0;
+    
+    // Records go out in one write per pass, and the heap held by queued records is bounded as the services sharing it
+    // are not charged for the trace connection
+    intRoom = (TRACE_TCP_QUEUE - (TCP_SND_BUF - (int)tcp_sndbuf(m_objConnection))) / (int)sizeof(TraceRecord);
+    while (n < intRoom && intTakeRecord(&arrBatch[n])) { n++; }
+    if (n == 0) { return; }
+    
+    if (tcp_write(m_objConnection, arrBatch, n * sizeof(TraceRecord), 1) != ERR_OK) {
+        m_intLost += n;
+        m_intDropped += n;
+        return;
+    }
+    tcp_output(m_objConnection);
+}
@@ -0,0 +1,129 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef TRACE_H
+#define TRACE_H 1
+
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+#include "clsCommandTiming.h"
+
+#define TRACE_TCP_PORT 10012        // A client connected here receives the raw records instead of the USB serial port, and may send a byte to set the categories
+#define TRACE_RECORDS 128           // Size of the ring, a power of two
+#define TRACE_TCP_QUEUE 480         // Most record bytes left queued on the trace connection at once
+#define TRACE_LINE 96               // Longest text line written to the USB serial port
+
+// Categories, switched at runtime with node 3 command 239 or from the trace connection
+#define TRACE_COMMAND 0x01          // Command port framing and checksum errors, unknown commands
+#define TRACE_PROPELLER 0x02        // Propeller timeouts and bad replies
+#define TRACE_BRIDGE 0x04           // Serial bridge overflows
+#define TRACE_BRIDGE_DATA 0x08      // Every chunk of serial data bridged to TCP
+#define TRACE_CONNECTION 0x10       // TCP connections accepted and closed
+#define TRACE_DEBUG 0x20            // Every command received
+#define TRACE_TIMELINE 0x40         // Begin and end of commands, propeller transactions, TCP sends and lwIP timers
+#define TRACE_TIMELINE_ISR 0x80     // Begin and end of serial receive interrupts
+#define TRACE_DEFAULT (TRACE_COMMAND | TRACE_PROPELLER | TRACE_BRIDGE | TRACE_CONNECTION)
+#define TRACE_SET 0x100             // Command 239 value flag, the low byte is the new set of categories
+
+// Events, the category is the high byte so that TRACE can test it without a lookup
+#define TRACE_EVENT(cat, n) (((cat) << 8) | (n))
+#define TRACE_LOST 0                                                    // arg1 records dropped as the ring was full
+#define TRACE_COMMAND_FRAMING TRACE_EVENT(TRACE_COMMAND, 1)             // arg0 STX position, arg1 ETX position
+#define TRACE_COMMAND_CHECKSUM TRACE_EVENT(TRACE_COMMAND, 2)            // arg0 calculated, arg1 received
+#define TRACE_COMMAND_UNKNOWN TRACE_EVENT(TRACE_COMMAND, 3)             // arg0 command
+#define TRACE_PROPELLER_TX_TIMEOUT TRACE_EVENT(TRACE_PROPELLER, 1)      // arg0 byte, arg1 0 waiting for the ack, 1 for ready again
+#define TRACE_PROPELLER_RX_TIMEOUT TRACE_EVENT(TRACE_PROPELLER, 2)      // arg0 byte, arg1 0 waiting for the reply, 1 for the ack, 2 for the next byte
+#define TRACE_PROPELLER_CHECKSUM TRACE_EVENT(TRACE_PROPELLER, 3)        // arg0 retry, arg1 reply length
+#define TRACE_BRIDGE_OVERFLOW TRACE_EVENT(TRACE_BRIDGE, 1)              // arg0 port, arg1 segment length
+#define TRACE_BRIDGE_TO_TCP TRACE_EVENT(TRACE_BRIDGE_DATA, 1)           // arg0 port, arg1 bytes
+#define TRACE_CONNECTION_ACCEPT TRACE_EVENT(TRACE_CONNECTION, 1)        // arg0 local port
+#define TRACE_CONNECTION_CLOSED TRACE_EVENT(TRACE_CONNECTION, 2)        // arg0 local port
+#define TRACE_COMMAND_RECEIVED TRACE_EVENT(TRACE_DEBUG, 1)              // arg0 command, arg1 node
+
+// Spans, recorded with TRACE_BEGIN and TRACE_END. host/tools/trace2json turns them into a Chrome trace timeline.
+#define TRACE_SPAN_END 0x80
+#define TRACE_SPAN_COMMAND TRACE_EVENT(TRACE_TIMELINE, 1)               // arg0 command, arg1 node
+#define TRACE_SPAN_PROPELLER TRACE_EVENT(TRACE_TIMELINE, 2)             // arg0 command, arg1 packet length, reply length at the end
+#define TRACE_SPAN_TCP_SEND TRACE_EVENT(TRACE_TIMELINE, 3)              // arg0 service (clsServiceReservations), arg1 bytes
+#define TRACE_SPAN_TIMER TRACE_EVENT(TRACE_TIMELINE, 4)                 // arg0 timer (TRACE_TIMER_*)
+#define TRACE_SPAN_SERIAL_ISR TRACE_EVENT(TRACE_TIMELINE_ISR, 1)        // arg0 port, arg1 bytes read at the end
+
+#define TRACE_TIMER_TCP 0
+#define TRACE_TIMER_ARP 1
+#define TRACE_TIMER_DNS 2
+#define TRACE_TIMER_DHCP_FINE 3
+#define TRACE_TIMER_DHCP_COARSE 4
+
+// Costs a test of the category when it is off, and a 12 byte copy into the ring when it is on
+#define TRACE(ev, a0, a1) do { if (m_objTrace.m_intCategories & ((ev) >> 8)) { m_objTrace.Add((ev), (a0), (a1)); } } while (0)
+#define TRACE_BEGIN(ev, a0, a1) TRACE((ev), (a0), (a1))
+#define TRACE_END(ev, a0, a1) TRACE((ev) | TRACE_SPAN_END, (a0), (a1))
+
+// Sent as is on the trace connection, 12 bytes little endian
+struct TraceRecord {
+    u32_t           time;                           // Microseconds, on the command timing clock
+    u16_t           event;
+    s16_t           arg0;
+    s32_t           arg1;
+};
+
+class clsTrace {
+    private:
+        TraceRecord     m_arrRecords[TRACE_RECORDS];
+        unsigned int    m_intHead;                      // Next record to write
+        unsigned int    m_intTail;                      // Next record to drain
+        unsigned int    m_intLost;                      // Records dropped since the last drain
+        Serial          *m_objUSB;
+        char            m_strLine[TRACE_LINE];          // Text of the record being written to the USB serial port
+        int             m_intLineLength;
+        int             m_intLinePosition;
+        
+        int             intTakeRecord(TraceRecord *objRecord);
+        void            DrainUSB();
+        void            DrainTCP();
+        
+    public:
+        unsigned int    m_intCategories;
+        unsigned int    m_intDropped;                   // Records dropped as the ring was full, in total
+        struct tcp_pcb  *m_objConnection;               // Trace client, NULL if there is none
+        
+        // Constructor
+        clsTrace() {
+            m_intHead = 0;
+            m_intTail = 0;
+            m_intLost = 0;
+            m_objUSB = NULL;
+            m_intLineLength = 0;
+            m_intLinePosition = 0;
+            m_intCategories = TRACE_DEFAULT;
+            m_intDropped = 0;
+            m_objConnection = NULL;
+        }
+        
+        // Interrupts are held off while the record is written, so interrupt handlers can trace too
+        void Add(int intEvent, int intArg0, long lngArg1) {
+            __disable_irq();
+            unsigned int intNext = (m_intHead + 1) & (TRACE_RECORDS - 1);
+            if (intNext == m_intTail) {
+                m_intLost++;
+                m_intDropped++;
+                __enable_irq();
+                return;
+            }
+            TraceRecord *r = &m_arrRecords[m_intHead];
+            r->time = CMD_TIMING_NOW();
+            r->event = intEvent;
+            r->arg0 = intArg0;
+            r->arg1 = lngArg1;
+            m_intHead = intNext;
+            __enable_irq();
+        }
+        
+        void Setup(Serial *objUSB, int intPort);
+        void Drain();
+        int intQueued() { return (m_intHead - m_intTail) & (TRACE_RECORDS - 1); }
+};
+
+extern clsTrace m_objTrace;
+#endif
@@ -0,0 +1,173 @@
+#include "clsBusArbiter.h"
+
+clsBusArbiter m_objBusArbiter;
+
+// Deselect the input banks and leave the bus floating, the pins are set up by the mbed objects in main.cpp
+void clsBusArbiter::Setup() {
+    InputCS1::high();
+    InputCS2::high();
+    InputLatch::low();
+    Float();
+}
+
+// Returns the client number to request cycles with, or -1 if there is no room
+int clsBusArbiter::intAddClient(void (* fncCycle)()) {
+    if (m_intClients >= BUS_CLIENTS) { return -1; }
+    m_arrCycles[m_intClients] = fncCycle;
+    return m_intClients++;
+}
+
+// ===========================================================================================================================================================================================
+// ARBITRATION
+// ===========================================================================================================================================================================================
+
+// Queue a cycle, from the main loop or an interrupt. Returns 1 if it ran straight away, 0 if it waits for the bus.
+int clsBusArbiter::intRequest(int intClient) {
+    int intRun;
+
+    __disable_irq();
+    m_intPending |= 1 << intClient;
+    intRun = (m_intOwner == BUS_FREE);
+    if (intRun) {
+        m_intOwner = BUS_EXPANDER;
+        m_intResume = BUS_FREE;
+    }
+    __enable_irq();
+
+    if (!intRun) { return 0; }
+    RunPending();
+    Finish();
+    return 1;
+}
+
+// Run the queued cycles in client order, called by the owner BUS_EXPANDER. Stops at a cycle that holds the bus.
+void clsBusArbiter::RunPending() {
+    while (m_intPending && !m_intHeld) {
+        for (int i=0; i<m_intClients; i++) {
+            if (!(m_intPending & (1 << i))) { continue; }
+
+            // Cleared once the cycle has run, a request made meanwhile is covered by it
+            m_arrCycles[i]();
+            __disable_irq();
+            m_intPending &= ~(1 << i);
+            __enable_irq();
+            if (m_intHeld) { return; }
+        }
+    }
+}
+
+// Hand the bus back once no cycle holds it. A request made after RunPending last looked only queued itself, as the bus
+// was still owned, so the queue is checked again with interrupts off and run if anything is left.
+void clsBusArbiter::Finish() {
+    while (1) {
+        __disable_irq();
+        if (m_intHeld) {
+            __enable_irq();
+            return;
+        }
+        if (!m_intPending) {
+            m_intOwner = m_intResume;
+            __enable_irq();
+            return;
+        }
+        __enable_irq();
+        RunPending();
+    }
+}
+
+// A held cycle is done, carry on with any queued while it ran
+void clsBusArbiter::Unhold() {
+    m_intHeld = 0;
+    RunPending();
+    Finish();
+}
+
+// Wait for any expander cycle to finish and take the bus for a Propeller transaction
+void clsBusArbiter::Acquire() {
+    while (1) {
+        __disable_irq();
+        if (m_intOwner == BUS_FREE) {
+            m_intOwner = BUS_PROPELLER;
+            __enable_irq();
+            break;
+        }
+        __enable_irq();
+        wait_us(1);
+    }
+}
+
+// End a Propeller transaction, cycles queued during it run now
+void clsBusArbiter::Release() {
+    Float();
+
+    __disable_irq();
+    if (!m_intPending) {
+        m_intOwner = BUS_FREE;
+        __enable_irq();
+        return;
+    }
+    m_intOwner = BUS_EXPANDER;
+    m_intResume = BUS_FREE;
+    __enable_irq();
+
+    RunPending();
+    Finish();
+}
+
+// Run the queued cycles in a gap between Propeller bytes, through BUS_YIELD. The bus is left as the Propeller had it.
+void clsBusArbiter::Yield() {
+    int intDriving = m_intDriving;
+    int intValue = m_intValue;
+
+    __disable_irq();
+    m_intOwner = BUS_EXPANDER;
+    m_intResume = BUS_PROPELLER;
+    __enable_irq();
+
+    RunPending();
+    Finish();
+    while (m_intOwner != BUS_PROPELLER) { wait_us(1); }
+
+    if (intDriving) {
+        Drive(intValue);
+    } else {
+        Float();
+    }
+}
+
+// ===========================================================================================================================================================================================
+// BUS ACCESS
+// ===========================================================================================================================================================================================
+
+void clsBusArbiter::Drive(int intValue) {
+    if (!m_intDriving) {
+        clsDataBus::output();
+        m_intDriving = 1;
+    }
+    clsDataBus::write(intValue);
+    m_intValue = intValue;
+}
+
+void clsBusArbiter::Float() {
+    clsDataBus::input();
+    m_intDriving = 0;
+}
+
+// Latch an input bank onto the bus, bank 0 is selected by CS2 and bank 1 by CS1. Read it with intReadBank once it has
+// had BUS_BANK_SETTLE_US to drive the bus.
+void clsBusArbiter::LatchBank(int intBank) {
+    Float();
+    if (intBank == 1) { InputCS1::low(); } else { InputCS2::low(); }
+    InputLatch::high();
+}
+
+// Read the latched input bank and deselect it. The inputs are active low.
+int clsBusArbiter::intReadBank(int intBank) {
+    int intData;
+
+    intData = clsDataBus::read();
+    InputLatch::low();
+    if (intBank == 1) { InputCS1::high(); } else { InputCS2::high(); }
+
+    return (~intData) & 0xFF;
+}
@@ -0,0 +1,76 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef BUSARBITER_H
+#define BUSARBITER_H 1
+
+#include "clsFastGPIO.h"
+
+#define BUS_CLIENTS 8               // Most expander clients (clsInputMonitor, clsOutputDriver)
+#define BUS_BANK_SETTLE_US 25       // Time an input bank is given to drive the bus after it is latched
+
+// Bus owners
+#define BUS_FREE 0
+#define BUS_PROPELLER 1             // A Propeller transaction, from the main loop
+#define BUS_EXPANDER 2              // Queued expander cycles are running
+
+// The Propeller only listens while the mbed sends a command, so expander cycles can run between command bytes.
+// Between reply bytes they rely on the Propeller floating the bus once RCLK is back high, and it waits for TCLK
+// before the next byte; leave this off unless the Propeller firmware does both.
+#define BUS_SLOT_REPLY 0
+
+// A single test between Propeller bytes while no expander cycle is queued
+#define BUS_YIELD() do { if (m_objBusArbiter.m_intPending) { m_objBusArbiter.Yield(); } } while (0)
+
+class clsBusArbiter {
+    private:
+        void            (* m_arrCycles[BUS_CLIENTS])(); // Runs one expander cycle for each client
+        int             m_intClients;
+        volatile int    m_intOwner;
+        volatile int    m_intResume;                    // Owner once the expander cycles are done, BUS_FREE or BUS_PROPELLER
+        volatile int    m_intHeld;                      // A cycle carries on from a Timeout (see Hold)
+        int             m_intDriving;                   // Bus direction, and the value driven
+        int             m_intValue;
+
+        void            RunPending();
+        void            Finish();
+
+    public:
+        volatile unsigned int m_intPending;             // One bit per client with a cycle queued
+
+        // Constructor
+        clsBusArbiter() {
+            m_intClients = 0;
+            m_intOwner = BUS_FREE;
+            m_intResume = BUS_FREE;
+            m_intHeld = 0;
+            m_intDriving = 0;
+            m_intValue = 0;
+            m_intPending = 0;
+        }
+
+        void Setup();
+        int intAddClient(void (* fncCycle)());
+
+        // Expander clients: queue a cycle, which runs straight away if the bus is free. A cycle that has to wait
+        // for a Timeout calls Hold, and Unhold from the Timeout once it is done with the bus.
+        int intRequest(int intClient);
+        void Hold() { m_intHeld = 1; }
+        void Unhold();
+
+        // The Propeller: owns the bus between Acquire and Release and yields to queued cycles between bytes
+        void Acquire();
+        void Release();
+        void Yield();
+
+        // Bus access for the current owner
+        void Drive(int intValue);
+        void Float();
+        int intRead() { return clsDataBus::read(); }
+        void LatchBank(int intBank);
+        int intReadBank(int intBank);
+};
+
+extern clsBusArbiter m_objBusArbiter;
+#endif
@@ -0,0 +1,56 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef FASTGPIO_H
+#define FASTGPIO_H 1
+
+// Port register access, the host build supplies its own (see host/mbed/mbed.h). Reads are one masked FIOPIN access.
+// Writes go through FIOSET and FIOCLR rather than FIOMASK and FIOPIN, as FIOMASK is shared by every pin on the port
+// and writes to the port from an interrupt (the input sampler's chip selects) would be lost while it was set.
+#ifndef FAST_GPIO_READ
+#define FAST_GPIO_PORT(port) ((LPC_GPIO_TypeDef *)(LPC_GPIO0_BASE + (port) * 0x20))
+#define FAST_GPIO_READ(port, mask) (FAST_GPIO_PORT(port)->FIOPIN & (mask))
+#define FAST_GPIO_WRITE(port, mask, value) do { FAST_GPIO_PORT(port)->FIOSET = (value) & (mask); FAST_GPIO_PORT(port)->FIOCLR = ~(value) & (mask); } while (0)
+#define FAST_GPIO_DIRECTION(port, mask, output) do { if (output) { FAST_GPIO_PORT(port)->FIODIR |= (mask); } else { FAST_GPIO_PORT(port)->FIODIR &= ~(mask); } } while (0)
+#endif
+
+// Pins on one GPIO port, fixed at compile time so every access is a single register operation on a constant address.
+// The pins are set up (function, pull, initial direction) by the mbed DigitalIn/DigitalOut/BusInOut objects in main.cpp.
+template <int PORT, unsigned int MASK>
+class clsPortPins {
+    public:
+        static inline unsigned int read() { return FAST_GPIO_READ(PORT, MASK); }
+        static inline void write(unsigned int intBits) { FAST_GPIO_WRITE(PORT, MASK, intBits); }
+        static inline void high() { FAST_GPIO_WRITE(PORT, MASK, MASK); }
+        static inline void low() { FAST_GPIO_WRITE(PORT, MASK, 0); }
+        static inline void output() { FAST_GPIO_DIRECTION(PORT, MASK, 1); }
+        static inline void input() { FAST_GPIO_DIRECTION(PORT, MASK, 0); }
+};
+
+// Wiring, as in main.cpp
+typedef clsPortPins<0, 1 << 18> PropellerRCLK;      // p11
+typedef clsPortPins<0, 1 << 17> PropellerTCLK;      // p12
+typedef clsPortPins<0, 1 << 9> InputCS1;            // p5
+typedef clsPortPins<0, 1 << 6> InputCS2;            // p8
+typedef clsPortPins<0, 1 << 7> InputLatch;          // p7
+
+// The data bus: bits 0-5 on P2.5 down to P2.0 (p21-p26), bits 6-7 on P0.24 and P0.23 (p16, p15).
+// Both halves run the opposite way to the port, so one bit reverse (RBIT) lines a byte up with both ports.
+typedef clsPortPins<2, 0x0000003F> DataBusLow;
+typedef clsPortPins<0, 0x01800000> DataBusHigh;
+
+class clsDataBus {
+    public:
+        static inline int read() {
+            return (__RBIT(DataBusLow::read()) >> 26) | (__RBIT(DataBusHigh::read()) >> 1);
+        }
+        static inline void write(int intValue) {
+            unsigned int intReversed = __RBIT(intValue);
+            DataBusLow::write(intReversed >> 26);
+            DataBusHigh::write(intReversed >> 1);
+        }
+        static inline void output() { DataBusLow::output(); DataBusHigh::output(); }
+        static inline void input() { DataBusLow::input(); DataBusHigh::input(); }
+};
+#endif
@@ -0,0 +1,163 @@
+#include "clsInputMonitor.h"
+
+clsInputMonitor m_objInputMonitor;
+
+void tick_callbackInputSample() {
+    m_objInputMonitor.Sample();
+}
+
+void bus_callbackInputSample() {
+    m_objInputMonitor.Read();
+}
+
+void timeout_callbackInputSample() {
+    m_objInputMonitor.BankCallback();
+}
+
+// Take the first sample as the debounced state and start sampling at a fixed rate, as the expanders have no interrupt line
+void clsInputMonitor::Setup(int intPeriodUs) {
+    m_intClient = m_objBusArbiter.intAddClient(&bus_callbackInputSample);
+    m_objBusArbiter.intRequest(m_intClient);
+    while (m_intSamples == 0) { wait_us(1); }
+    for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) { m_arrCount[i] = 0; }
+    m_intState = m_intRaw;
+    m_intLastChange = CMD_TIMING_NOW();
+    m_tickSample.attach_us(&tick_callbackInputSample, intPeriodUs);
+}
+
+// Called from the ticker, the bus arbiter runs the sample now or as soon as the bus is free
+void clsInputMonitor::Sample() {
+    if (!m_objBusArbiter.intRequest(m_intClient)) { m_intDeferred++; }
+}
+
+// Run by the bus arbiter. Latches bank 0 and holds the bus while it settles, the banks are read from a Timeout so the
+// interrupt that starts the sample never waits on them. The timestamp is taken as the first bank is latched.
+void clsInputMonitor::Read() {
+    m_objBusArbiter.Hold();
+    m_intReadTime = CMD_TIMING_NOW();
+    m_intReading = 0;
+    m_intBank = 0;
+    m_objBusArbiter.LatchBank(0);
+    m_timeSettle.attach_us(&timeout_callbackInputSample, BUS_BANK_SETTLE_US);
+}
+
+// A bank has settled, read it and latch the next. Once both are in the sample is debounced before the bus is handed back,
+// so outputs set by the rules are latched in the same pass.
+void clsInputMonitor::BankCallback() {
+    m_intReading |= m_objBusArbiter.intReadBank(m_intBank) << (m_intBank * 8);
+    if (m_intBank == 0) {
+        m_intBank = 1;
+        m_objBusArbiter.LatchBank(1);
+        m_timeSettle.attach_us(&timeout_callbackInputSample, BUS_BANK_SETTLE_US);
+        return;
+    }
+
+    Debounce(m_intReading, m_intReadTime);
+    m_objBusArbiter.Unhold();
+}
+
+// Debounce a sample of both banks and log any change
+void clsInputMonitor::Debounce(unsigned int intRaw, u32_t intTime) {
+    unsigned int intWas = m_intState;
+    unsigned int intDiffer = intRaw ^ m_intState;
+    unsigned int intCarry = intDiffer;
+    unsigned int intMismatch = 0;
+    unsigned int intChanged, t;
+
+    m_intSamples++;
+    m_intRaw = intRaw;
+
+    // Inputs back at their debounced level start counting again, the rest count up by one (a ripple carry across the planes)
+    for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) {
+        t = m_arrCount[i] & intDiffer;
+        m_arrCount[i] = t ^ intCarry;
+        intCarry &= t;
+        intMismatch |= m_arrCount[i] ^ m_arrLimit[i];
+    }
+
+    // Inputs whose count has reached their limit take the new level
+    intChanged = intDiffer & ~intMismatch;
+    if (intChanged != 0) {
+        for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) { m_arrCount[i] &= ~intChanged; }
+
+        InputEdge *e = &m_arrEdges[m_intSequence % INPUT_EDGES];
+        e->time = intTime;
+        e->state = m_intState ^ intChanged;
+        e->changed = intChanged;
+        m_intState ^= intChanged;
+        m_intLastChange = intTime;
+        m_intSequence++;
+        
+        POSITION_CAPTURE_EDGES(intChanged, m_intState, intTime);
+    }
+
+    // The rules act on every sample, as a level rule holds its outputs
+    RULES_EVALUATE(intWas, m_intState, intTime);
+}
+
+// Samples an input must hold a new level before the debounced state follows it, 1 takes every change straight away
+void clsInputMonitor::SetDebounce(int intInput, int intCount) {
+    if (intInput < 0 || intInput >= INPUT_BITS) { return; }
+    if (intCount < 1) { intCount = 1; }
+    if (intCount > INPUT_DEBOUNCE_MAX) { intCount = INPUT_DEBOUNCE_MAX; }
+
+    __disable_irq();
+    for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) {
+        m_arrLimit[i] = (m_arrLimit[i] & ~(1 << intInput)) | (((intCount >> i) & 1) << intInput);
+    }
+    __enable_irq();
+}
+
+int clsInputMonitor::intGetDebounce(int intInput) {
+    int intCount = 0;
+
+    for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) {
+        intCount |= ((m_arrLimit[i] >> intInput) & 1) << i;
+    }
+    return intCount;
+}
+
+// Fill the array with the edges from sequence number lngFrom on, returns the number of values written.
+// Edges already overwritten are skipped, a negative lngFrom returns the header only.
+//
+// Layout:
+//   0      sequence number of the first edge returned
+//   1      edges returned
+//   2      sequence number to ask for next
+//   3      current debounced input state
+//   4      samples taken
+//   5      samples taken late as the data bus was in use
+//   6-     each edge: time in microseconds on the command timing clock, changed inputs << 16 | input state
+int clsInputMonitor::intGetEdges(long lngFrom, long *arrValues, int intMaxValues) {
+    unsigned int intFrom, intCount, intSequence;
+    int n = INPUT_LOG_HEADER;
+
+    // Copied with the ticker held off so an edge cannot be half written
+    __disable_irq();
+    intSequence = m_intSequence;
+    if (lngFrom < 0) {
+        intFrom = intSequence;
+    } else {
+        intFrom = lngFrom;
+        if (intFrom > intSequence) { intFrom = intSequence; }
+        if (intSequence - intFrom > INPUT_EDGES) { intFrom = intSequence - INPUT_EDGES; }
+    }
+    intCount = intSequence - intFrom;
+    if (intCount > (unsigned int)(intMaxValues - INPUT_LOG_HEADER) / INPUT_LOG_VALUES) {
+        intCount = (intMaxValues - INPUT_LOG_HEADER) / INPUT_LOG_VALUES;
+    }
+    for (unsigned int i=0; i<intCount; i++) {
+        InputEdge *e = &m_arrEdges[(intFrom + i) % INPUT_EDGES];
+        arrValues[n++] = e->time;
+        arrValues[n++] = ((long)e->changed << 16) | e->state;
+    }
+    arrValues[3] = m_intState;
+    arrValues[4] = m_intSamples;
+    arrValues[5] = m_intDeferred;
+    __enable_irq();
+
+    arrValues[0] = intFrom;
+    arrValues[1] = intCount;
+    arrValues[2] = intFrom + intCount;
+    return n;
+}
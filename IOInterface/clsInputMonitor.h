@@ -0,0 +1,86 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef INPUTMONITOR_H
+#define INPUTMONITOR_H 1
+
+#include "lwip/opt.h"
+#include "clsCommandTiming.h"
+#include "clsBusArbiter.h"
+#include "clsRuleEngine.h"
+#include "clsPositionCapture.h"
+
+#define INPUT_SAMPLE_US 500         // Sampling period of both input banks, each sample holds the bus for about 50us
+#define INPUT_BITS 16               // Inputs in both banks
+#define INPUT_DEBOUNCE_PLANES 4     // Bits of the vertical debounce counters, so counts of 1 to 15 samples
+#define INPUT_DEBOUNCE_MAX ((1 << INPUT_DEBOUNCE_PLANES) - 1)
+#define INPUT_DEBOUNCE_DEFAULT 4    // Samples an input must hold a new level before it changes (2ms)
+#define INPUT_EDGES 64              // Edge log records, oldest overwritten first
+#define INPUT_LOG_HEADER 6          // Values before the records in an edge log reply (see intGetEdges)
+#define INPUT_LOG_VALUES 2          // Values per record in an edge log reply
+
+// One change of any input bits
+struct InputEdge {
+    u32_t           time;                           // Microseconds, on the command timing clock, of the sample that completed the debounce count
+    u16_t           state;                          // Every debounced input after the change, bank 0 in the low byte
+    u16_t           changed;                        // Inputs that changed
+};
+
+void tick_callbackInputSample();
+void bus_callbackInputSample();
+void timeout_callbackInputSample();
+
+class clsInputMonitor {
+    private:
+        Ticker          m_tickSample;
+        Timeout         m_timeSettle;                   // Times each bank settling on the bus
+        int             m_intClient;                    // Bus arbiter client number
+        int             m_intBank;                      // Bank latched onto the bus
+        unsigned int    m_intReading;                   // Banks read so far in this sample
+        u32_t           m_intReadTime;                  // Time the sample was started
+        InputEdge       m_arrEdges[INPUT_EDGES];
+        
+        // Vertical counters, bit n of each plane is one bit of input n's count, so all inputs are counted at once
+        unsigned int    m_arrCount[INPUT_DEBOUNCE_PLANES];  // Samples the raw level has differed from the debounced state
+        unsigned int    m_arrLimit[INPUT_DEBOUNCE_PLANES];  // Count at which each input takes its new level
+
+    public:
+        volatile unsigned int m_intState;               // Debounced inputs
+        volatile unsigned int m_intRaw;                 // Inputs at the last sample, before debouncing
+        volatile unsigned int m_intSequence;            // Sequence number of the next edge
+        volatile u32_t  m_intLastChange;                // Time of the last edge, or of Setup before the first
+        volatile unsigned int m_intSamples;
+        volatile unsigned int m_intDeferred;            // Samples queued by the bus arbiter as the bus was in use
+
+        // Constructor
+        clsInputMonitor() {
+            m_intClient = -1;
+            m_intBank = 0;
+            m_intReading = 0;
+            m_intReadTime = 0;
+            m_intState = 0;
+            m_intRaw = 0;
+            m_intSequence = 0;
+            m_intLastChange = 0;
+            m_intSamples = 0;
+            m_intDeferred = 0;
+            for (int i=0; i<INPUT_DEBOUNCE_PLANES; i++) {
+                m_arrCount[i] = 0;
+                m_arrLimit[i] = ((INPUT_DEBOUNCE_DEFAULT >> i) & 1) ? (1 << INPUT_BITS) - 1 : 0;
+            }
+        }
+
+        void Setup(int intPeriodUs);
+        void Sample();
+        void Read();
+        void BankCallback();
+        void Debounce(unsigned int intRaw, u32_t intTime);
+
+        void SetDebounce(int intInput, int intCount);
+        int intGetDebounce(int intInput);
+        int intGetEdges(long lngFrom, long *arrValues, int intMaxValues);
+};
+
+extern clsInputMonitor m_objInputMonitor;
+#endif
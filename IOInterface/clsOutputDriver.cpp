@@ -0,0 +1,227 @@
+#include "clsOutputDriver.h"
+
+clsOutputDriver m_objOutputDriver;
+
+// Pins free for the latch lines of banks 1 to 3, the rest are taken by the data bus, the expanders, the serial ports and the Propeller
+static const struct { int intPin; PinName pin; } m_arrLatchPins[] = {
+    { 18, p18 }, { 19, p19 }, { 20, p20 }, { 29, p29 }, { 30, p30 }
+};
+
+void timeout_callbackOutputLatch() {
+    m_objOutputDriver.LatchCallback();
+}
+
+void bus_callbackOutputLatch() {
+    m_objOutputDriver.Latch();
+}
+
+void timeout_callbackPulse0() { m_objOutputDriver.PulseEdge(0); }
+void timeout_callbackPulse1() { m_objOutputDriver.PulseEdge(1); }
+void timeout_callbackPulse2() { m_objOutputDriver.PulseEdge(2); }
+void timeout_callbackPulse3() { m_objOutputDriver.PulseEdge(3); }
+
+static void (* m_arrPulseCallbacks[OUTPUT_PULSES])() = {
+    &timeout_callbackPulse0, &timeout_callbackPulse1, &timeout_callbackPulse2, &timeout_callbackPulse3
+};
+
+// Latch the initial outputs straight away, bank 0 is wired to out_OutputLatch
+void clsOutputDriver::Setup(DigitalOut *out_OutputLatch) {
+    m_arrLatch[0] = out_OutputLatch;
+    m_arrLatch[0]->write(0);
+    m_arrLatchPin[0] = 6;
+    m_intMask = 0xFF;
+    m_intClient = m_objBusArbiter.intAddClient(&bus_callbackOutputLatch);
+    m_intLatched = ~m_intOutputs;
+    Poll();
+}
+
+// Fit output bank 1 to 3, its latch line is mbed pin intPin (e.g. 18 for p18). Returns 0 if the bank or pin cannot be used.
+int clsOutputDriver::intSetLatchPin(int intBank, int intPin) {
+    int intUsed = 0;
+
+    if (intBank < 1 || intBank >= OUTPUT_BANKS || m_arrLatch[intBank] != NULL) { return 0; }
+    for (int i=0; i<OUTPUT_BANKS; i++) { intUsed |= (m_arrLatchPin[i] == intPin); }
+    if (intUsed) { return 0; }
+
+    for (unsigned int i=0; i<sizeof(m_arrLatchPins) / sizeof(m_arrLatchPins[0]); i++) {
+        if (m_arrLatchPins[i].intPin != intPin) { continue; }
+
+        DigitalOut *out_Latch = new DigitalOut(m_arrLatchPins[i].pin);
+        out_Latch->write(0);
+        m_arrLatchPin[intBank] = intPin;
+
+        // The bank is latched on the next poll, whatever its outputs, as the expander has not been written yet
+        __disable_irq();
+        m_arrLatch[intBank] = out_Latch;
+        m_intMask |= 0xFF << (intBank * 8);
+        m_intLatched ^= 0xFF << (intBank * 8);
+        __enable_irq();
+        return 1;
+    }
+    return 0;
+}
+
+// Output bit for output number intOutput, numbered from 1 with output 1 in bit 7 of bank 0 as on the original single bank. 0 if out of range.
+unsigned int clsOutputDriver::intOutputBit(int intOutput) {
+    if (intOutput < 1 || intOutput > OUTPUT_BITS) { return 0; }
+    intOutput--;
+    return 1 << ((intOutput & ~7) + 7 - (intOutput & 7));
+}
+
+// Called on every pass of the main loop, queues a latch cycle with the bus arbiter if the outputs have changed or the refresh is due
+void clsOutputDriver::Poll() {
+    if (m_intPhase || (m_objBusArbiter.m_intPending & (1 << m_intClient))) { return; }
+    if (((m_intOutputs ^ m_intLatched) & m_intMask) == 0) {
+        if (m_intRefreshUs == 0 || CMD_TIMING_NOW() - m_intLastLatch < m_intRefreshUs) { return; }
+        m_intRefreshes++;
+    }
+    m_objBusArbiter.intRequest(m_intClient);
+}
+
+// Run by the bus arbiter. Every bank that has changed is latched from one copy of the outputs in a single held bus cycle,
+// so a command that sets several banks never shows half of them; a refresh latches every bank. The pulses are timed by a
+// Timeout, so the loop carries on while they are high.
+void clsOutputDriver::Latch() {
+    unsigned int intChanged;
+
+    m_intLatching = m_intOutputs;
+    intChanged = (m_intLatching ^ m_intLatched) & m_intMask;
+    m_intBanks = 0;
+    for (int i=0; i<OUTPUT_BANKS; i++) {
+        if (m_arrLatch[i] != NULL && (intChanged == 0 || (intChanged >> (i * 8)) & 0xFF)) { m_intBanks |= 1 << i; }
+    }
+
+    m_objBusArbiter.Hold();
+    m_intLatched = m_intLatching;
+    m_intLastLatch = CMD_TIMING_NOW();
+    m_intLatches++;
+    NextBank();
+}
+
+// Raise the latch of the next bank with its outputs on the bus, or float the bus and let it settle once they are all done
+void clsOutputDriver::NextBank() {
+    for (m_intBank=0; m_intBank<OUTPUT_BANKS; m_intBank++) {
+        if (m_intBanks & (1 << m_intBank)) { break; }
+    }
+
+    if (m_intBank == OUTPUT_BANKS) {
+        m_objBusArbiter.Float();
+        m_intPhase = 2;
+    } else {
+        m_objBusArbiter.Drive((m_intLatching >> (m_intBank * 8)) & 0xFF);
+        m_arrLatch[m_intBank]->write(1);
+        m_intPhase = 1;
+    }
+    m_timeLatch.attach_us(&timeout_callbackOutputLatch, OUTPUT_LATCH_US);
+}
+
+// Ends a latch pulse and starts the next, then hands the bus back once it has settled
+void clsOutputDriver::LatchCallback() {
+    if (m_intPhase == 1) {
+        m_arrLatch[m_intBank]->write(0);
+        m_intBanks &= ~(1 << m_intBank);
+        NextBank();
+        return;
+    }
+    m_intPhase = 0;
+    m_objBusArbiter.Unhold();
+
+    // A pulse edge during the cycle is latched now rather than on the next pass of the main loop
+    if ((m_intOutputs ^ m_intLatched) & m_intMask) { Poll(); }
+}
+
+// ===========================================================================================================================================================================================
+// PULSES
+// ===========================================================================================================================================================================================
+
+// Pulse an output intCount times (0 until stopped), on for intWidthUs every intPeriodUs. The edges are timed by Timeouts and
+// latched straight away, so they do not wait on the main loop. A width of 0 stops the output's pulses and leaves it off.
+// Returns 0 if the output does not exist or is not fitted, the timing is too short or every channel is in use.
+int clsOutputDriver::intPulse(int intOutput, int intCount, u32_t intWidthUs, u32_t intPeriodUs) {
+    unsigned int intBit = intFittedBit(intOutput);
+    int intChannel = -1;
+
+    if (intBit == 0 || intCount < 0) { return 0; }
+
+    // Its own channel if it already has one, otherwise the first free one
+    for (int i=0; i<OUTPUT_PULSES; i++) {
+        if (m_arrPulses[i].output == intOutput) { intChannel = i; break; }
+        if (m_arrPulses[i].output == 0 && intChannel < 0) { intChannel = i; }
+    }
+
+    if (intWidthUs == 0) {
+        if (intChannel >= 0 && m_arrPulses[intChannel].output == intOutput) {
+            m_arrPulseTimers[intChannel].detach();
+            m_arrPulses[intChannel].output = 0;
+            m_arrPulses[intChannel].on = 0;
+            ClearBits(intBit);
+        }
+        return 1;
+    }
+    if (intChannel < 0 || intWidthUs < OUTPUT_PULSE_MIN_US) { return 0; }
+    if (intCount != 1 && intPeriodUs < intWidthUs + OUTPUT_PULSE_MIN_US) { return 0; }
+
+    m_arrPulseTimers[intChannel].detach();
+    OutputPulse *p = &m_arrPulses[intChannel];
+    p->output = intOutput;
+    p->bit = intBit;
+    p->count = intCount;
+    p->width = intWidthUs;
+    p->period = intPeriodUs;
+    p->start = CMD_TIMING_NOW();
+    p->on = 0;
+    PulseEdge(intChannel);
+    return 1;
+}
+
+// Wait for the next edge, the times run from the start of the first pulse so a train does not drift
+void clsOutputDriver::ScheduleEdge(int intChannel, u32_t intDue) {
+    int intDelay = (int)(intDue - CMD_TIMING_NOW());
+
+    if (intDelay < 1) { intDelay = 1; }
+    m_arrPulseTimers[intChannel].attach_us(m_arrPulseCallbacks[intChannel], intDelay);
+}
+
+// Start or end a pulse, from its Timeout
+void clsOutputDriver::PulseEdge(int intChannel) {
+    OutputPulse *p = &m_arrPulses[intChannel];
+
+    if (p->output == 0) { return; }
+
+    if (!p->on) {
+        SetBits(p->bit);
+        p->on = 1;
+        ScheduleEdge(intChannel, p->start + p->width);
+    } else {
+        ClearBits(p->bit);
+        p->on = 0;
+        if (p->count == 1) {
+            p->output = 0;
+        } else {
+            if (p->count > 1) { p->count--; }
+            p->start += p->period;
+            ScheduleEdge(intChannel, p->start);
+        }
+    }
+
+    // Queued with the bus arbiter, run now unless the bus is in use
+    Poll();
+}
+
+// Fill the array with the pulse channels, returns the number of values written.
+//
+// Layout, for each channel:
+//   output (0 for a free channel), pulses still to start counting the current one (0 until stopped), width in microseconds,
+//   period in microseconds
+int clsOutputDriver::intGetPulses(long *arrValues) {
+    int n = 0;
+
+    for (int i=0; i<OUTPUT_PULSES; i++) {
+        OutputPulse *p = &m_arrPulses[i];
+        arrValues[n++] = p->output;
+        arrValues[n++] = p->output ? p->count : 0;
+        arrValues[n++] = p->output ? p->width : 0;
+        arrValues[n++] = p->output ? p->period : 0;
+    }
+    return n;
+}
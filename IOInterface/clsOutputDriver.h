@@ -0,0 +1,108 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef OUTPUTDRIVER_H
+#define OUTPUTDRIVER_H 1
+
+#include "lwip/opt.h"
+#include "clsCommandTiming.h"
+#include "clsBusArbiter.h"
+
+#define OUTPUT_LATCH_US 25              // Latch pulse width, and the time the bus is then left to settle
+#define OUTPUT_REFRESH_MS 100           // Outputs are latched again this often even when unchanged, 0 for only on a change
+#define OUTPUT_BANKS 4                  // Banks of 8 outputs, bank 0 in the low byte of the output word
+#define OUTPUT_BITS (OUTPUT_BANKS * 8)
+#define OUTPUT_PULSES 4                 // Outputs that can be pulsed at once
+#define OUTPUT_PULSE_MIN_US 200         // Shortest pulse and gap, several latch cycles of every bank
+
+#define OUTPUT_PULSE_VALUES (4 * OUTPUT_PULSES) // Number of values returned by intGetPulses
+
+// A pulse or pulse train on one output, timed by its own Timeout
+struct OutputPulse {
+    int             output;                         // Output number, 0 for a free channel
+    unsigned int    bit;
+    unsigned int    count;                          // Pulses still to start, 0 to run until stopped
+    u32_t           width;                          // Microseconds on
+    u32_t           period;                         // Microseconds from one pulse start to the next
+    u32_t           start;                          // When the current pulse started (or starts), on the command timing clock
+    int             on;
+};
+
+void timeout_callbackOutputLatch();
+void bus_callbackOutputLatch();
+void timeout_callbackPulse0();
+void timeout_callbackPulse1();
+void timeout_callbackPulse2();
+void timeout_callbackPulse3();
+
+class clsOutputDriver {
+    private:
+        DigitalOut      *m_arrLatch[OUTPUT_BANKS];      // Latch line of each bank, NULL for a bank that is not fitted
+        int             m_arrLatchPin[OUTPUT_BANKS];    // mbed pin number of each latch line
+        unsigned int    m_intMask;                      // Output bits of the fitted banks
+        int             m_intClient;                    // Bus arbiter client number
+        Timeout         m_timeLatch;
+        unsigned int    m_intLatched;                   // Outputs on the expanders
+        unsigned int    m_intLatching;                  // Outputs being latched, every bank is written from this one copy
+        unsigned int    m_intBanks;                     // Banks still to latch in this cycle, one bit each
+        int             m_intBank;                      // Bank whose latch pulse is in progress
+        u32_t           m_intLastLatch;                 // Time of the last latch, on the command timing clock
+        volatile int    m_intPhase;                     // Latch pulse in progress (see LatchCallback)
+        OutputPulse     m_arrPulses[OUTPUT_PULSES];
+        Timeout         m_arrPulseTimers[OUTPUT_PULSES];
+
+        void            NextBank();
+        void            ScheduleEdge(int intChannel, u32_t intDue);
+
+    public:
+        volatile unsigned int m_intOutputs;             // Shadow register, written by the commands and latched by Poll
+        unsigned int    m_intRefreshUs;
+        unsigned int    m_intLatches;
+        unsigned int    m_intRefreshes;                 // Latches of unchanged outputs
+
+        // Constructor
+        clsOutputDriver() {
+            for (int i=0; i<OUTPUT_BANKS; i++) {
+                m_arrLatch[i] = NULL;
+                m_arrLatchPin[i] = 0;
+            }
+            m_intMask = 0;
+            m_intClient = -1;
+            m_intLatched = 0;
+            m_intLatching = 0;
+            m_intBanks = 0;
+            m_intBank = 0;
+            m_intLastLatch = 0;
+            m_intPhase = 0;
+            m_intOutputs = 0;
+            m_intRefreshUs = OUTPUT_REFRESH_MS * 1000;
+            m_intLatches = 0;
+            m_intRefreshes = 0;
+            for (int i=0; i<OUTPUT_PULSES; i++) {
+                m_arrPulses[i].output = 0;
+                m_arrPulses[i].bit = 0;
+                m_arrPulses[i].on = 0;
+            }
+        }
+
+        void Setup(DigitalOut *out_OutputLatch);
+        int intSetLatchPin(int intBank, int intPin);
+        static unsigned int intOutputBit(int intOutput);
+        unsigned int intFittedBit(int intOutput) { return intOutputBit(intOutput) & m_intMask; } // 0 unless its bank is fitted
+        void SetRefresh(int intRefreshMs) { m_intRefreshUs = intRefreshMs * 1000; }
+        // The rules (see clsRuleEngine) also change the outputs, from the input sampler's interrupt
+        void Set(unsigned int intOutputs) { m_intOutputs = intOutputs; }
+        void SetBits(unsigned int intBits) { __disable_irq(); m_intOutputs |= intBits; __enable_irq(); }
+        void ClearBits(unsigned int intBits) { __disable_irq(); m_intOutputs &= ~intBits; __enable_irq(); }
+        void Poll();
+        void Latch();
+        void LatchCallback();
+
+        int intPulse(int intOutput, int intCount, u32_t intWidthUs, u32_t intPeriodUs);
+        void PulseEdge(int intChannel);
+        int intGetPulses(long *arrValues);
+};
+
+extern clsOutputDriver m_objOutputDriver;
+#endif
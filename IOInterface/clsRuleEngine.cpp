@@ -0,0 +1,130 @@
+#include "clsRuleEngine.h"
+
+clsRuleEngine m_objRuleEngine;
+
+// Set or clear (RULE_OFF) a rule, returns 0 if the rule is not valid. A level rule that already holds acts at the next sample.
+int clsRuleEngine::intSetRule(int intRule, unsigned int intWord, long lngValue) {
+    int intCondition = RULE_CONDITION(intWord);
+    int intAction = RULE_ACTION(intWord);
+
+    if (intRule < 0 || intRule >= RULES || intCondition > RULE_LOW) { return 0; }
+    if (intCondition != RULE_OFF) {
+        if (intAction < RULE_COMMAND || intAction > RULE_OUTPUT_OFF) { return 0; }
+        if (intAction != RULE_COMMAND && clsOutputDriver::intOutputBit(RULE_TARGET(intWord)) == 0) { return 0; }
+    }
+
+    // The sampler reads the rules from its interrupt
+    __disable_irq();
+    m_arrRules[intRule].word = (intCondition == RULE_OFF) ? 0 : (intWord & 0x00FFFFFF);
+    m_arrRules[intRule].value = lngValue;
+    m_arrRules[intRule].fired = 0;
+    m_intHolding &= ~(1 << intRule);
+    m_intPending &= ~(1 << intRule);
+    if (intCondition == RULE_OFF) {
+        m_intRules &= ~(1 << intRule);
+    } else {
+        m_intRules |= 1 << intRule;
+    }
+    __enable_irq();
+    return 1;
+}
+
+// Returns the rule word, 0 for a rule that is not set, and its command value
+unsigned int clsRuleEngine::intGetRule(int intRule, long *lngValue) {
+    *lngValue = m_arrRules[intRule].value;
+    return m_arrRules[intRule].word;
+}
+
+// Called through RULES_EVALUATE by the input sampler with the debounced inputs before and after the sample. Outputs are
+// latched straight away by the bus arbiter, commands are queued for the main loop as a Propeller transaction cannot run here.
+void clsRuleEngine::Evaluate(unsigned int intWas, unsigned int intNow, u32_t intTime) {
+    unsigned int intOutputs = m_objOutputDriver.m_intOutputs;
+    unsigned int intHolding = 0;
+
+    for (int i=0; i<RULES; i++) {
+        if (!(m_intRules & (1 << i))) { continue; }
+
+        Rule *r = &m_arrRules[i];
+        unsigned int intBit = 1 << RULE_INPUT(r->word);
+        int intHolds;
+
+        switch (RULE_CONDITION(r->word)) {
+            case RULE_RISE: intHolds = (intNow & intBit) && !(intWas & intBit); break;
+            case RULE_FALL: intHolds = !(intNow & intBit) && (intWas & intBit); break;
+            case RULE_HIGH: intHolds = (intNow & intBit) != 0; break;
+            default: intHolds = !(intNow & intBit); break;
+        }
+        if (!intHolds) { continue; }
+        intHolding |= 1 << i;
+
+        // Outputs are held for as long as the condition holds, commands are sent once as it starts to
+        if (RULE_ACTION(r->word) == RULE_OUTPUT_ON) {
+            intOutputs |= clsOutputDriver::intOutputBit(RULE_TARGET(r->word));
+        } else if (RULE_ACTION(r->word) == RULE_OUTPUT_OFF) {
+            intOutputs &= ~clsOutputDriver::intOutputBit(RULE_TARGET(r->word));
+        }
+        if (m_intHolding & (1 << i)) { continue; }
+        r->fired++;
+        if (RULE_ACTION(r->word) == RULE_COMMAND) {
+            m_intPending |= 1 << i;
+            m_arrQueued[i] = intTime;
+        }
+    }
+    m_intHolding = intHolding;
+
+    // Queued behind this sample, so the latch follows it on the same pass of the bus arbiter
+    if (intOutputs != m_objOutputDriver.m_intOutputs) {
+        m_objOutputDriver.Set(intOutputs);
+        m_objOutputDriver.Poll();
+    }
+}
+
+// Called on every pass of the main loop, sends the queued commands in rule order
+void clsRuleEngine::Poll() {
+    char strPacket[12];
+    int intReplyLength;
+    u32_t intReaction;
+
+    if (m_intPending == 0 || m_objPropeller == NULL) { return; }
+
+    for (int i=0; i<RULES; i++) {
+        if (!(m_intPending & (1 << i))) { continue; }
+        __disable_irq();
+        m_intPending &= ~(1 << i);
+        __enable_irq();
+
+        intReplyLength = m_objPropeller->intTX(strPacket, m_objPropeller->intBuildPacket(strPacket, RULE_TARGET(m_arrRules[i].word), 1, m_arrRules[i].value));
+        m_intCommands++;
+        if (intReplyLength <= 0) {
+            m_intFailures++;
+            continue;
+        }
+
+        intReaction = CMD_TIMING_NOW() - m_arrQueued[i];
+        m_intLastReaction = intReaction;
+        if (intReaction > m_intMaxReaction) { m_intMaxReaction = intReaction; }
+    }
+}
+
+// Fill the array with the rules, returns the number of values written.
+//
+// Layout:
+//   0      commands sent
+//   1      commands the Propeller did not answer
+//   2      microseconds from the input sample to the reply to the last command sent
+//   3      longest of those since start up
+//   4-     each rule: rule word (0 if not set), command value, times fired
+int clsRuleEngine::intGetValues(long *arrValues) {
+    int n = 0;
+
+    arrValues[n++] = m_intCommands;
+    arrValues[n++] = m_intFailures;
+    arrValues[n++] = m_intLastReaction;
+    arrValues[n++] = m_intMaxReaction;
+    for (int i=0; i<RULES; i++) {
+        arrValues[n++] = m_arrRules[i].word;
+        arrValues[n++] = m_arrRules[i].value;
+        arrValues[n++] = m_arrRules[i].fired;
+    }
+    return n;
+}
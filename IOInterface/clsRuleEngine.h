@@ -0,0 +1,93 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef RULEENGINE_H
+#define RULEENGINE_H 1
+
+#include "lwip/opt.h"
+#include "clsCommandTiming.h"
+#include "clsPropellerInterface.h"
+#include "clsOutputDriver.h"
+
+#define RULES 16                        // Rules held, set with node 3 command 245 and kept in config.cfg as Rule<n>
+
+// A rule is one word, plus the value sent with a Propeller command (0 for none, as with lngSendCommand)
+//   bits 0-3   input, 0 to 15
+//   bits 4-7   condition (RULE_OFF to RULE_LOW)
+//   bits 8-11  action (RULE_COMMAND to RULE_OUTPUT_OFF)
+//   bits 16-23 Propeller command with the axis added (StopAxis on axis 2 is 17), or output 1 to OUTPUT_BITS
+//   bits 24-31 rule number, only in command 245
+#define RULE_INPUT(w) ((w) & 0x0F)
+#define RULE_CONDITION(w) (((w) >> 4) & 0x0F)
+#define RULE_ACTION(w) (((w) >> 8) & 0x0F)
+#define RULE_TARGET(w) (((w) >> 16) & 0xFF)
+#define RULE_NUMBER(w) (((w) >> 24) & 0xFF)
+
+// Conditions, on the debounced inputs
+#define RULE_OFF 0
+#define RULE_RISE 1                     // The input has just come on
+#define RULE_FALL 2                     // The input has just gone off
+#define RULE_HIGH 3                     // While the input is on: a command is sent as it comes on, an output is held after every sample
+#define RULE_LOW 4                      // While the input is off, as RULE_HIGH
+
+// Actions
+#define RULE_COMMAND 1                  // Send a Propeller command from the main loop
+#define RULE_OUTPUT_ON 2                // Switch an output on, latched straight after the sample
+#define RULE_OUTPUT_OFF 3
+
+// Run after every input sample, a single test while there are no rules
+#define RULES_EVALUATE(was, now, time) do { if (m_objRuleEngine.m_intRules) { m_objRuleEngine.Evaluate((was), (now), (time)); } } while (0)
+
+#define RULE_VALUES_HEADER 4            // Values before the rules in a command 245 reply (see intGetValues)
+#define RULE_VALUES (RULE_VALUES_HEADER + 3 * RULES) // Number of values returned by intGetValues
+
+struct Rule {
+    unsigned int    word;                           // Without the rule number
+    long            value;
+    unsigned int    fired;                          // Times the condition has started to hold
+};
+
+class clsRuleEngine {
+    private:
+        clsPropellerInterface *m_objPropeller;
+        Rule            m_arrRules[RULES];
+        unsigned int    m_intHolding;                   // One bit per rule whose condition held at the last sample
+        u32_t           m_arrQueued[RULES];             // Time of the sample that queued each command
+
+    public:
+        volatile unsigned int m_intRules;               // One bit per rule set
+        volatile unsigned int m_intPending;             // One bit per rule with a command still to send
+        unsigned int    m_intCommands;                  // Commands sent
+        unsigned int    m_intFailures;                  // Commands the Propeller did not answer
+        u32_t           m_intLastReaction;              // Microseconds from the sample to the reply to the command
+        u32_t           m_intMaxReaction;
+
+        // Constructor
+        clsRuleEngine() {
+            m_objPropeller = NULL;
+            for (int i=0; i<RULES; i++) {
+                m_arrRules[i].word = 0;
+                m_arrRules[i].value = 0;
+                m_arrRules[i].fired = 0;
+                m_arrQueued[i] = 0;
+            }
+            m_intHolding = 0;
+            m_intRules = 0;
+            m_intPending = 0;
+            m_intCommands = 0;
+            m_intFailures = 0;
+            m_intLastReaction = 0;
+            m_intMaxReaction = 0;
+        }
+
+        void Setup(clsPropellerInterface *objPropeller) { m_objPropeller = objPropeller; }
+        int intSetRule(int intRule, unsigned int intWord, long lngValue);
+        unsigned int intGetRule(int intRule, long *lngValue);
+        void Evaluate(unsigned int intWas, unsigned int intNow, u32_t intTime);
+        void Poll();
+        int intGetValues(long *arrValues);
+};
+
+extern clsRuleEngine m_objRuleEngine;
+#endif
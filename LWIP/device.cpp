@@ -1,4 +1,7 @@
 #include "mbed.h"
+#include "clsStatistics.h"
+#include "clsCommandTiming.h"
+#include "clsPacketCapture.h"
 
 using namespace mbed;
 
@@ -13,21 +16,169 @@ extern "C" {
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include "lwip/stats.h"
+#include "lwip/ip.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
 #include "netif/etharp.h"
+#include "device.h"
 #include "string.h"
 
 #define IFNAME0 'E'
 #define IFNAME1 'X'
 
+/* Drop frames the stack cannot consume before a pbuf is allocated for them */
+#define DEVICE_RX_FILTER 1
+#define DEVICE_FILTER_HLEN 42     /* Ethernet + ARP, or Ethernet + IP without options + ports */
+#define DEVICE_FILTER_MAXHLEN 78  /* Ethernet + IP with all options + ports */
+
+/* Frames the filter classifies as control traffic are dispatched ahead of the rest within each poll */
+#define DEVICE_RX_DROP 0
+#define DEVICE_RX_NORMAL 1
+#define DEVICE_RX_HIGH 2
+#define DEVICE_RX_PRIO_HIGH TCP_PRIO_MAX  /* TCP pcbs at this priority (tcp_setprio) are control traffic */
+#define DEVICE_RX_DEFER 4                 /* Normal frames held back per poll, each one holds a pool buffer */
+
 #define min(x,y) (((x)<(y))?(x):(y))
 
 struct netif *gnetif;
+struct device_filter_stats device_filter_stats;
+
+#if DEVICE_RX_FILTER
+/* Is a pcb bound to this local port? Frames for any other port would only be answered with a reset.
+ * Returns DEVICE_RX_HIGH for TCP ports whose pcb has control priority */
+static int device_port_class(u8_t proto, u16_t port) {
+  struct udp_pcb *upcb;
+  struct tcp_pcb_listen *lpcb;
+  struct tcp_pcb *tpcb;
+
+  if(proto == IP_PROTO_UDP) {
+    for(upcb = udp_pcbs; upcb != NULL; upcb = upcb->next) {
+      if(upcb->local_port == port) return DEVICE_RX_NORMAL;
+    }
+    return DEVICE_RX_DROP;
+  }
+
+  for(lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+    if(lpcb->local_port == port) return (lpcb->prio >= DEVICE_RX_PRIO_HIGH) ? DEVICE_RX_HIGH : DEVICE_RX_NORMAL;
+  }
+  for(tpcb = tcp_active_pcbs; tpcb != NULL; tpcb = tpcb->next) {
+    if(tpcb->local_port == port) return (tpcb->prio >= DEVICE_RX_PRIO_HIGH) ? DEVICE_RX_HIGH : DEVICE_RX_NORMAL;
+  }
+  for(tpcb = tcp_tw_pcbs; tpcb != NULL; tpcb = tpcb->next) {
+    if(tpcb->local_port == port) return DEVICE_RX_NORMAL;
+  }
+  return DEVICE_RX_DROP;
+}
+
+/* Classify a frame from its header alone, returns DEVICE_RX_DROP if it should be dropped */
+static int device_filter(u8_t *hdr, int hlen) {
+  struct ip_addr dest;
+  u16_t type, offset, port;
+  u8_t proto;
+  int iphlen, unicast, cls;
+
+  if(hlen < DEVICE_FILTER_HLEN) {
+    device_filter_stats.short_frame++;
+    return 0;
+  }
+
+  type = (hdr[12] << 8) | hdr[13];
+
+  /* ARP, only requests for and replies to our address (any while we have none) */
+  if(type == ETHTYPE_ARP) {
+    memcpy(&dest, &hdr[38], sizeof(dest));
+    if(ip_addr_isany(&gnetif->ip_addr) || ip_addr_cmp(&dest, &gnetif->ip_addr)) {
+      /* Replies to control traffic cannot go out until ARP is resolved */
+      device_filter_stats.accepted++;
+      device_filter_stats.priority++;
+      return DEVICE_RX_HIGH;
+    }
+    device_filter_stats.arp_target++;
+    return 0;
+  }
+
+  if(type != ETHTYPE_IP || (hdr[14] >> 4) != 4) {
+    device_filter_stats.ethertype++;
+    return 0;
+  }
+
+  iphlen = (hdr[14] & 0x0f) * 4;
+  proto = hdr[23];
+  offset = ((hdr[20] << 8) | hdr[21]) & IP_OFFMASK;
+  memcpy(&dest, &hdr[30], sizeof(dest));
+  unicast = ip_addr_cmp(&dest, &gnetif->ip_addr);
+
+  if(!unicast && (ip_addr_ismulticast(&dest) || !ip_addr_isbroadcast(&dest, gnetif))) {
+    /* Until DHCP has configured the interface, offers may be addressed to the offered address */
+    if(!(proto == IP_PROTO_UDP && ip_addr_isany(&gnetif->ip_addr))) {
+      device_filter_stats.ip_dest++;
+      return 0;
+    }
+  }
+
+  cls = DEVICE_RX_NORMAL;
+  switch(proto) {
+    case IP_PROTO_ICMP:
+      /* Echo requests to our own address only */
+      if(!unicast) {
+        device_filter_stats.ip_dest++;
+        return 0;
+      }
+      break;
+
+    case IP_PROTO_TCP:
+      if(!unicast) {
+        device_filter_stats.ip_dest++;
+        return 0;
+      }
+      /* Fall through */
+    case IP_PROTO_UDP:
+      /* Later fragments carry no ports, leave those to reassembly */
+      if(offset != 0) break;
+      if(14 + iphlen + 4 > hlen) {
+        device_filter_stats.short_frame++;
+        return 0;
+      }
+      port = (hdr[14 + iphlen + 2] << 8) | hdr[14 + iphlen + 3];
+      cls = device_port_class(proto, port);
+      if(cls == DEVICE_RX_DROP) {
+        device_filter_stats.port++;
+        return 0;
+      }
+      break;
+
+    default:
+      device_filter_stats.ip_protocol++;
+      return 0;
+  }
+
+  device_filter_stats.accepted++;
+  if(cls == DEVICE_RX_HIGH) device_filter_stats.priority++;
+  return cls;
+}
+
+/* Read the frame header out of the EMAC, with enough bytes to see the ports past any IP options */
+static int device_read_header(u8_t *hdr, int len) {
+  int hlen, needed;
+
+  hlen = eth->read((char *)hdr, min(len, DEVICE_FILTER_HLEN));
+  if(hlen == DEVICE_FILTER_HLEN && ((hdr[12] << 8) | hdr[13]) == ETHTYPE_IP) {
+    needed = min(len, 14 + (hdr[14] & 0x0f) * 4 + 4);
+    if(needed > hlen) {
+      hlen += eth->read((char *)&hdr[hlen], needed - hlen);
+    }
+  }
+  return hlen;
+}
+#endif
 
 static err_t device_output(struct netif *netif, struct pbuf *p) {
   #if ETH_PAD_SIZE
     pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
   #endif
 
+  CAPTURE_FRAME(CAPTURE_TX, p);
+
   do {
     eth->write((const char *)p->payload, p->len);
   } while((p = p->next)!=NULL);
@@ -42,19 +193,70 @@ static err_t device_output(struct netif *netif, struct pbuf *p) {
   return ERR_OK;
 }
 
-void device_poll() {
+/* Hand a received frame to the stack, which frees it. The stamp is when it was read out of the EMAC */
+static void device_input(struct pbuf *frame, int stamp) {
   struct eth_hdr *ethhdr;
+
+  m_objCommandTiming.MarkAt(TIMING_FRAME, stamp);
+  ethhdr = (struct eth_hdr *)(frame->payload);
+
+  switch(htons(ethhdr->type)) {
+      
+      case ETHTYPE_IP:
+          etharp_ip_input(gnetif, frame);
+          pbuf_header(frame, -((s16_t) sizeof(struct eth_hdr)));
+          gnetif->input(frame, gnetif);
+          break;
+      
+      case ETHTYPE_ARP:
+          etharp_arp_input(gnetif, (struct eth_addr *)(gnetif->hwaddr), frame);
+          break;
+      
+      default:
+          LINK_STATS_INC(link.proterr);
+          LINK_STATS_INC(link.drop);
+          pbuf_free(frame);
+          break;
+  }
+}
+
+void device_poll() {
   struct pbuf *frame, *p;
-  int len, read;
+  struct pbuf *deferred[DEVICE_RX_DEFER];
+  int deferred_stamp[DEVICE_RX_DEFER];
+  int len, read, hlen, copied, n, cls, stamp;
+  int head = 0, count = 0;
+  u8_t hdr[DEVICE_FILTER_MAXHLEN];
 
+  /* Control frames are dispatched as they are read, everything else waits until the EMAC is drained
+   * (or the deferred queue is full) so a command is never stuck behind a burst of bridge segments */
   while((len = eth->receive()) != 0) {
+      LINK_STATS_INC(link.recv);
+      stamp = CMD_TIMING_NOW();
+      hlen = 0;
+      cls = DEVICE_RX_HIGH;
+      #if DEVICE_RX_FILTER
+          hlen = device_read_header(hdr, len);
+          cls = device_filter(hdr, hlen);
+          if(cls == DEVICE_RX_DROP) {
+              LINK_STATS_INC(link.drop);
+              continue;
+          }
+      #endif
       frame = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
       if(frame == NULL) {
-          return;
+          LINK_STATS_INC(link.memerr);
+          FW_STATS_INC(rxFramesNoBuffer);
+          break;
       }
       p = frame;
+      copied = 0;
       do {
-         read = eth->read((char *)p->payload, p->len);
+         /* The header has already been read out of the EMAC by the filter */
+         n = min(hlen - copied, p->len);
+         memcpy(p->payload, &hdr[copied], n);
+         copied += n;
+         read = n + eth->read((char *)p->payload + n, p->len - n);
          p = p->next;
       } while(p != NULL && read != 0);
       
@@ -62,24 +264,28 @@ void device_poll() {
           pbuf_header(p, ETH_PAD_SIZE);
       #endif
 
-      ethhdr = (struct eth_hdr *)(frame->payload);
-
-      switch(htons(ethhdr->type)) {
-          
-          case ETHTYPE_IP:
-              etharp_ip_input(gnetif, frame);
-              pbuf_header(frame, -((s16_t) sizeof(struct eth_hdr)));
-              gnetif->input(frame, gnetif);
-              break;
-          
-          case ETHTYPE_ARP:
-              etharp_arp_input(gnetif, (struct eth_addr *)(gnetif->hwaddr), frame);
-              break;
-          
-          default:
-              break;
+      CAPTURE_FRAME(CAPTURE_RX, frame);
+
+      if(cls == DEVICE_RX_HIGH) {
+          device_input(frame, stamp);
+          continue;
+      }
+
+      /* Keep arrival order within the normal frames, make room by dispatching the oldest */
+      if(count == DEVICE_RX_DEFER) {
+          device_input(deferred[head], deferred_stamp[head]);
+          head = (head + 1) % DEVICE_RX_DEFER;
+          count--;
       }
-      pbuf_free(frame);
+      deferred[(head + count) % DEVICE_RX_DEFER] = frame;
+      deferred_stamp[(head + count) % DEVICE_RX_DEFER] = stamp;
+      count++;
+  }
+
+  while(count > 0) {
+      device_input(deferred[head], deferred_stamp[head]);
+      head = (head + 1) % DEVICE_RX_DEFER;
+      count--;
   }
 }
 
@@ -108,12 +314,18 @@ err_t device_init(struct netif *netif) {
   netif->output          = etharp_output;
   netif->linkoutput      = device_output;
 
-  eth = new Ethernet();
+  if(eth == NULL) {
+    eth = new Ethernet();
+  }
 
   return ERR_OK;
 }
 
+/* Called before netif_add(), so the interface may not be initialised yet */
 void device_address(char *mac) {
+    if(eth == NULL) {
+        eth = new Ethernet();
+    }
     eth->address(mac);
 }
 
@@ -5,6 +5,19 @@
 extern "C" {
 #endif
 
+/* Frames dropped by the receive filter in device_poll(), per reason */
+struct device_filter_stats {
+  u32_t accepted;
+  u32_t short_frame;  /* too short to classify */
+  u32_t ethertype;    /* neither ARP nor IPv4 */
+  u32_t arp_target;   /* ARP for another host */
+  u32_t ip_dest;      /* multicast, another host, or broadcast other than UDP */
+  u32_t ip_protocol;  /* not ICMP, UDP or TCP */
+  u32_t port;         /* UDP or TCP port with no pcb bound */
+  u32_t priority;     /* accepted frames dispatched ahead of the rest (ARP and control priority TCP) */
+};
+extern struct device_filter_stats device_filter_stats;
+
 void device_poll();
 err_t device_init(struct netif *netif);
 void device_address(char *mac);
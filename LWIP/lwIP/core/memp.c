@@ -115,6 +115,15 @@ static struct memp *memp_tab[MEMP_MAX];
 
 #define MEMP_ALIGN_SIZE(x) (LWIP_MEM_ALIGN_SIZE(x))
 
+#if MEMP_STATS
+/** The configured number of elements per pool. With MEMP_MEM_MALLOC
+ *  this is only reported as 'avail', the heap is the real limit. */
+static const u16_t memp_num[MEMP_MAX] = {
+#define LWIP_MEMPOOL(name,num,size,desc)  (num),
+#include "lwip/memp_std.h"
+};
+#endif /* MEMP_STATS */
+
 #endif /* MEMP_MEM_MALLOC */
 
 /** This array holds the element sizes of each pool. */
@@ -384,3 +393,72 @@ memp_free(memp_t type, void *mem)
 }
 
 #endif /* MEMP_MEM_MALLOC */
+
+#if MEMP_MEM_MALLOC && MEMP_STATS
+/**
+ * Initialize the per-pool statistics. The pools themselves are taken from
+ * the heap (MEMP_MEM_MALLOC), so there is nothing else to set up.
+ */
+void
+memp_init(void)
+{
+  u16_t i;
+
+  for (i = 0; i < MEMP_MAX; ++i) {
+    MEMP_STATS_AVAIL(used, i, 0);
+    MEMP_STATS_AVAIL(max, i, 0);
+    MEMP_STATS_AVAIL(err, i, 0);
+    MEMP_STATS_AVAIL(avail, i, memp_num[i]);
+  }
+}
+
+/**
+ * Get an element of the given pool type from the heap and count it.
+ *
+ * @param type the pool to get an element from
+ * @return a pointer to the allocated memory or a NULL pointer on error
+ */
+void *
+memp_malloc(memp_t type)
+{
+  void *mem;
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  LWIP_ERROR("memp_malloc: type < MEMP_MAX", (type < MEMP_MAX), return NULL;);
+
+  mem = mem_malloc(memp_sizes[type]);
+
+  SYS_ARCH_PROTECT(old_level);
+  if (mem != NULL) {
+    MEMP_STATS_INC_USED(used, type);
+  } else {
+    LWIP_DEBUGF(MEMP_DEBUG | 2, ("memp_malloc: out of memory in pool %"U16_F"\n", (u16_t)type));
+    MEMP_STATS_INC(err, type);
+  }
+  SYS_ARCH_UNPROTECT(old_level);
+
+  return mem;
+}
+
+/**
+ * Return an element of the given pool type to the heap.
+ *
+ * @param type the pool where to put mem
+ * @param mem the memp element to free
+ */
+void
+memp_free(memp_t type, void *mem)
+{
+  SYS_ARCH_DECL_PROTECT(old_level);
+
+  if (mem == NULL) {
+    return;
+  }
+
+  SYS_ARCH_PROTECT(old_level);
+  MEMP_STATS_DEC(used, type);
+  SYS_ARCH_UNPROTECT(old_level);
+
+  mem_free(mem);
+}
+#endif /* MEMP_MEM_MALLOC && MEMP_STATS */
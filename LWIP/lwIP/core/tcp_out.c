@@ -810,6 +810,7 @@ tcp_rexmit_rto(struct tcp_pcb *pcb)
 
   /* increment number of retransmissions */
   ++pcb->nrtx;
+  TCP_STATS_INC(tcp.rexmit);
 
   /* Don't take any RTT measurements after retransmitting. */
   pcb->rttest = 0;
@@ -849,6 +850,7 @@ tcp_rexmit(struct tcp_pcb *pcb)
   *cur_seg = seg;
 
   ++pcb->nrtx;
+  TCP_STATS_INC(tcp.rexmit);
 
   /* Don't take any rtt measurements after retransmitting. */
   pcb->rttest = 0;
@@ -83,9 +83,16 @@ extern const u16_t memp_sizes[MEMP_MAX];
 
 #include "mem.h"
 
+#if MEMP_STATS
+/* pools are carved from the heap, but still counted per pool type */
+void  memp_init(void);
+void *memp_malloc(memp_t type);
+void  memp_free(memp_t type, void *mem);
+#else /* MEMP_STATS */
 #define memp_init()
 #define memp_malloc(type)     mem_malloc(memp_sizes[type])
 #define memp_free(type, mem)  mem_free(mem)
+#endif /* MEMP_STATS */
 
 #else /* MEMP_MEM_MALLOC */
 
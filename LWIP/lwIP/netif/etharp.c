@@ -83,12 +83,18 @@
 #define ARPH_HWLEN_SET(hdr, len) (hdr)->_hwlen_protolen = htons(ARPH_PROTOLEN(hdr) | ((len) << 8))
 #define ARPH_PROTOLEN_SET(hdr, len) (hdr)->_hwlen_protolen = htons((len) | (ARPH_HWLEN(hdr) << 8))
 
+/** Entry states. Anything >= ETHARP_STATE_STABLE holds a resolved address;
+ *  ETHARP_STATE_STATIC entries are never aged out or recycled. */
 enum etharp_state {
   ETHARP_STATE_EMPTY = 0,
   ETHARP_STATE_PENDING,
-  ETHARP_STATE_STABLE
+  ETHARP_STATE_STABLE,
+  ETHARP_STATE_STATIC
 };
 
+/** An ARP cache entry. The state is kept in a u8_t (not the enum) and the
+ *  netif pointer is only stored when SNMP needs it, so that an entry packs
+ *  into 12 bytes and the table can be made larger for the same RAM. */
 struct etharp_entry {
 #if ARP_QUEUEING
   /** 
@@ -98,17 +104,27 @@ struct etharp_entry {
 #endif
   struct ip_addr ipaddr;
   struct eth_addr ethaddr;
-  enum etharp_state state;
+  u8_t state;
   u8_t ctime;
+#if LWIP_SNMP
   struct netif *netif;
+#endif
 };
 
 const struct eth_addr ethbroadcast = {{0xff,0xff,0xff,0xff,0xff,0xff}};
 const struct eth_addr ethzero = {{0,0,0,0,0,0}};
+
+/** The ARP cache is an open-addressed hash table with linear probing.
+ *  Every entry lives in the probe chain starting at ETHARP_HASH(ipaddr),
+ *  and a chain always ends at an empty slot, so a lookup touches only a
+ *  couple of entries regardless of the table size. */
 static struct etharp_entry arp_table[ARP_TABLE_SIZE] MEM_POSITION;
-#if !LWIP_NETIF_HWADDRHINT
-static u8_t etharp_cached_entry MEM_POSITION;
-#endif
+/** number of ETHARP_STATE_STATIC entries in arp_table */
+static u8_t etharp_static_count MEM_POSITION;
+
+#define ETHARP_TABLE_MASK   (ARP_TABLE_SIZE - 1)
+/** Fibonacci hash of the (network order) IP address onto a table slot */
+#define ETHARP_HASH(ipaddr) ((u8_t)(((u32_t)((ipaddr)->addr * 2654435761UL)) >> 24) & ETHARP_TABLE_MASK)
 
 /**
  * Try hard to create a new entry - we want the IP address to appear in
@@ -131,6 +147,9 @@ static err_t update_arp_entry(struct netif *netif, struct ip_addr *ipaddr, struc
 #if (LWIP_ARP && (ARP_TABLE_SIZE > 0x7f))
   #error "If you want to use ARP, ARP_TABLE_SIZE must fit in an s8_t, so, you have to reduce it in your lwipopts.h"
 #endif
+#if (LWIP_ARP && ((ARP_TABLE_SIZE & (ARP_TABLE_SIZE - 1)) != 0))
+  #error "ARP_TABLE_SIZE must be a power of two for the hashed ARP cache, please fix it in your lwipopts.h"
+#endif
 
 
 #if ARP_QUEUEING
@@ -155,6 +174,62 @@ free_etharp_q(struct etharp_q_entry *q)
 }
 #endif
 
+/**
+ * Remove an entry from the ARP table.
+ *
+ * Frees any queued packets and then closes the hole left behind by moving
+ * later entries of the same probe chain back (backward-shift deletion), so
+ * that no tombstones are needed and every chain still ends at an empty slot.
+ * Note that this may change the index of other entries.
+ *
+ * @param i index of the entry to remove
+ */
+static void
+etharp_remove_entry(u8_t i)
+{
+  u8_t j, home;
+
+  /* remove from SNMP ARP index tree */
+  snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
+#if ARP_QUEUEING
+  /* and empty packet queue */
+  if (arp_table[i].q != NULL) {
+    /* remove all queued packets */
+    LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_remove_entry: freeing entry %"U16_F", packet queue %p.\n", (u16_t)i, (void *)(arp_table[i].q)));
+    free_etharp_q(arp_table[i].q);
+    arp_table[i].q = NULL;
+  }
+#endif
+  if (arp_table[i].state == ETHARP_STATE_STATIC) {
+    etharp_static_count--;
+  }
+  arp_table[i].state = ETHARP_STATE_EMPTY;
+
+  /* pull following entries of the chain back into the hole */
+  j = i;
+  for (;;) {
+    j = (j + 1) & ETHARP_TABLE_MASK;
+    if (arp_table[j].state == ETHARP_STATE_EMPTY) {
+      break;
+    }
+    home = ETHARP_HASH(&arp_table[j].ipaddr);
+    /* entry j may only move back if the hole lies between its home slot and j */
+    if (((j - home) & ETHARP_TABLE_MASK) >= ((j - i) & ETHARP_TABLE_MASK)) {
+      arp_table[i] = arp_table[j];
+#if ARP_QUEUEING
+      arp_table[j].q = NULL;
+#endif
+      arp_table[j].state = ETHARP_STATE_EMPTY;
+      i = j;
+    }
+  }
+}
+
+/** Has entry i outlived its state's maximum age? Static entries never expire. */
+#define ETHARP_ENTRY_EXPIRED(i) \
+  (((arp_table[i].state == ETHARP_STATE_STABLE) && (arp_table[i].ctime >= ARP_MAXAGE)) || \
+   ((arp_table[i].state == ETHARP_STATE_PENDING) && (arp_table[i].ctime >= ARP_MAXPENDING)))
+
 /**
  * Clears expired entries in the ARP table.
  *
@@ -167,53 +242,39 @@ etharp_tmr(void)
   u8_t i;
 
   LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer\n"));
+  /* age all dynamic entries first: removing an entry shifts others around,
+     so doing both in one sweep could age an entry twice or not at all */
+  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+    if ((arp_table[i].state == ETHARP_STATE_STABLE) ||
+        (arp_table[i].state == ETHARP_STATE_PENDING)) {
+      arp_table[i].ctime++;
+    }
+  }
   /* remove expired entries from the ARP table */
   for (i = 0; i < ARP_TABLE_SIZE; ++i) {
-    arp_table[i].ctime++;
-    if (((arp_table[i].state == ETHARP_STATE_STABLE) &&
-         (arp_table[i].ctime >= ARP_MAXAGE)) ||
-        ((arp_table[i].state == ETHARP_STATE_PENDING)  &&
-         (arp_table[i].ctime >= ARP_MAXPENDING))) {
-         /* pending or stable entry has become old! */
+    /* an entry shifted into slot i may itself be expired, so check again */
+    while (ETHARP_ENTRY_EXPIRED(i)) {
+      /* pending or stable entry has become old! */
       LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: expired %s entry %"U16_F".\n",
            arp_table[i].state == ETHARP_STATE_STABLE ? "stable" : "pending", (u16_t)i));
-      /* clean up entries that have just been expired */
-      /* remove from SNMP ARP index tree */
-      snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
-#if ARP_QUEUEING
-      /* and empty packet queue */
-      if (arp_table[i].q != NULL) {
-        /* remove all queued packets */
-        LWIP_DEBUGF(ETHARP_DEBUG, ("etharp_timer: freeing entry %"U16_F", packet queue %p.\n", (u16_t)i, (void *)(arp_table[i].q)));
-        free_etharp_q(arp_table[i].q);
-        arp_table[i].q = NULL;
-      }
-#endif
-      /* recycle entry for re-use */      
-      arp_table[i].state = ETHARP_STATE_EMPTY;
-    }
-#if ARP_QUEUEING
-    /* still pending entry? (not expired) */
-    if (arp_table[i].state == ETHARP_STATE_PENDING) {
-        /* resend an ARP query here? */
+      /* clean up entries that have just been expired and recycle for re-use */
+      etharp_remove_entry(i);
     }
-#endif
   }
 }
 
 /**
  * Search the ARP table for a matching or new entry.
  * 
- * If an IP address is given, return a pending or stable ARP entry that matches
- * the address. If no match is found, create a new entry with this address set,
- * but in state ETHARP_EMPTY. The caller must check and possibly change the
- * state of the returned entry.
- * 
- * If ipaddr is NULL, return a initialized new entry in state ETHARP_EMPTY.
+ * If an IP address is given, return a pending, stable or static ARP entry
+ * that matches the address. If no match is found, create a new entry with
+ * this address set, but in state ETHARP_EMPTY. The caller must check and
+ * possibly change the state of the returned entry.
  * 
- * In all cases, attempt to create new entries from an empty entry. If no
- * empty entries are available and ETHARP_TRY_HARD flag is set, recycle
- * old entries. Heuristic choose the least important entry for recycling.
+ * The lookup walks the probe chain starting at the address' home slot,
+ * which ends at the first empty slot. A new entry takes that empty slot.
+ * If the table is full and ETHARP_TRY_HARD flag is set, the least important
+ * dynamic entry is recycled. Static entries are never recycled.
  *
  * @param ipaddr IP address to find in ARP cache, or to add if not found.
  * @param flags
@@ -232,7 +293,7 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
 {
   s8_t old_pending = ARP_TABLE_SIZE, old_stable = ARP_TABLE_SIZE;
   s8_t empty = ARP_TABLE_SIZE;
-  u8_t i = 0, age_pending = 0, age_stable = 0;
+  u8_t i = 0, n, home, age_pending = 0, age_stable = 0;
 #if ARP_QUEUEING
   /* oldest entry with packets on queue */
   s8_t old_queue = ARP_TABLE_SIZE;
@@ -240,102 +301,46 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
   u8_t age_queue = 0;
 #endif
 
-  /* First, test if the last call to this function asked for the
-   * same address. If so, we're really fast! */
-  if (ipaddr) {
-    /* ipaddr to search for was given */
+  /* entries are keyed by IP address, anonymous entries can not be hashed */
+  if (ipaddr == NULL) {
+    return (s8_t)ERR_ARG;
+  }
+
 #if LWIP_NETIF_HWADDRHINT
-    if ((netif != NULL) && (netif->addr_hint != NULL)) {
-      /* per-pcb cached entry was given */
-      u8_t per_pcb_cache = *(netif->addr_hint);
-      if ((per_pcb_cache < ARP_TABLE_SIZE) && arp_table[per_pcb_cache].state == ETHARP_STATE_STABLE) {
-        /* the per-pcb-cached entry is stable */
-        if (ip_addr_cmp(ipaddr, &arp_table[per_pcb_cache].ipaddr)) {
-          /* per-pcb cached entry was the right one! */
-          ETHARP_STATS_INC(etharp.cachehit);
-          return per_pcb_cache;
-        }
-      }
-    }
-#else /* #if LWIP_NETIF_HWADDRHINT */
-    if (arp_table[etharp_cached_entry].state == ETHARP_STATE_STABLE) {
-      /* the cached entry is stable */
-      if (ip_addr_cmp(ipaddr, &arp_table[etharp_cached_entry].ipaddr)) {
-        /* cached entry was the right one! */
+  /* First, test if the per-pcb cached entry is the one. If so, we're really fast! */
+  if ((netif != NULL) && (netif->addr_hint != NULL)) {
+    /* per-pcb cached entry was given */
+    u8_t per_pcb_cache = *(netif->addr_hint);
+    if ((per_pcb_cache < ARP_TABLE_SIZE) && arp_table[per_pcb_cache].state >= ETHARP_STATE_STABLE) {
+      /* the per-pcb-cached entry is stable */
+      if (ip_addr_cmp(ipaddr, &arp_table[per_pcb_cache].ipaddr)) {
+        /* per-pcb cached entry was the right one! */
         ETHARP_STATS_INC(etharp.cachehit);
-        return etharp_cached_entry;
+        return per_pcb_cache;
       }
     }
-#endif /* #if LWIP_NETIF_HWADDRHINT */
   }
+#endif /* #if LWIP_NETIF_HWADDRHINT */
 
-  /**
-   * a) do a search through the cache, remember candidates
-   * b) select candidate entry
-   * c) create new entry
-   */
-
-  /* a) in a single search sweep, do all of this
-   * 1) remember the first empty entry (if any)
-   * 2) remember the oldest stable entry (if any)
-   * 3) remember the oldest pending entry without queued packets (if any)
-   * 4) remember the oldest pending entry with queued packets (if any)
-   * 5) search for a matching IP entry, either pending or stable
-   *    until 5 matches, or all entries are searched for.
-   */
-
-  for (i = 0; i < ARP_TABLE_SIZE; ++i) {
-    /* no empty entry found yet and now we do find one? */
-    if ((empty == ARP_TABLE_SIZE) && (arp_table[i].state == ETHARP_STATE_EMPTY)) {
+  /* a) walk the probe chain: it ends at a matching entry or an empty slot */
+  home = ETHARP_HASH(ipaddr);
+  for (n = 0; n < ARP_TABLE_SIZE; ++n) {
+    i = (home + n) & ETHARP_TABLE_MASK;
+    if (arp_table[i].state == ETHARP_STATE_EMPTY) {
       LWIP_DEBUGF(ETHARP_DEBUG, ("find_entry: found empty entry %"U16_F"\n", (u16_t)i));
-      /* remember first empty entry */
       empty = i;
+      break;
     }
-    /* pending entry? */
-    else if (arp_table[i].state == ETHARP_STATE_PENDING) {
-      /* if given, does IP address match IP address in ARP entry? */
-      if (ipaddr && ip_addr_cmp(ipaddr, &arp_table[i].ipaddr)) {
-        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching pending entry %"U16_F"\n", (u16_t)i));
-        /* found exact IP address match, simply bail out */
-#if LWIP_NETIF_HWADDRHINT
-        NETIF_SET_HINT(netif, i);
-#else /* #if LWIP_NETIF_HWADDRHINT */
-        etharp_cached_entry = i;
-#endif /* #if LWIP_NETIF_HWADDRHINT */
-        return i;
-#if ARP_QUEUEING
-      /* pending with queued packets? */
-      } else if (arp_table[i].q != NULL) {
-        if (arp_table[i].ctime >= age_queue) {
-          old_queue = i;
-          age_queue = arp_table[i].ctime;
-        }
-#endif
-      /* pending without queued packets? */
-      } else {
-        if (arp_table[i].ctime >= age_pending) {
-          old_pending = i;
-          age_pending = arp_table[i].ctime;
-        }
-      }        
-    }
-    /* stable entry? */
-    else if (arp_table[i].state == ETHARP_STATE_STABLE) {
-      /* if given, does IP address match IP address in ARP entry? */
-      if (ipaddr && ip_addr_cmp(ipaddr, &arp_table[i].ipaddr)) {
-        LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching stable entry %"U16_F"\n", (u16_t)i));
-        /* found exact IP address match, simply bail out */
+    if (ip_addr_cmp(ipaddr, &arp_table[i].ipaddr)) {
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: found matching entry %"U16_F" after %"U16_F" probes\n", (u16_t)i, (u16_t)n));
+      if (n == 0) {
+        /* found in its home slot */
+        ETHARP_STATS_INC(etharp.cachehit);
+      }
 #if LWIP_NETIF_HWADDRHINT
-        NETIF_SET_HINT(netif, i);
-#else /* #if LWIP_NETIF_HWADDRHINT */
-        etharp_cached_entry = i;
+      NETIF_SET_HINT(netif, i);
 #endif /* #if LWIP_NETIF_HWADDRHINT */
-        return i;
-      /* remember entry with oldest stable entry in oldest, its age in maxtime */
-      } else if (arp_table[i].ctime >= age_stable) {
-        old_stable = i;
-        age_stable = arp_table[i].ctime;
-      }
+      return i;
     }
   }
   /* { we have no match } => try to create a new entry */
@@ -347,69 +352,88 @@ find_entry(struct ip_addr *ipaddr, u8_t flags)
     LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: no empty entry found and not allowed to recycle\n"));
     return (s8_t)ERR_MEM;
   }
-  
-  /* b) choose the least destructive entry to recycle:
-   * 1) empty entry
-   * 2) oldest stable entry
-   * 3) oldest pending entry without queued packets
-   * 4) oldest pending entry with queued packets
-   * 
-   * { ETHARP_TRY_HARD is set at this point }
-   */ 
-
-  /* 1) empty entry available? */
-  if (empty < ARP_TABLE_SIZE) {
-    i = empty;
-    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting empty entry %"U16_F"\n", (u16_t)i));
-  }
-  /* 2) found recyclable stable entry? */
-  else if (old_stable < ARP_TABLE_SIZE) {
-    /* recycle oldest stable*/
-    i = old_stable;
-    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest stable entry %"U16_F"\n", (u16_t)i));
+
+  if (empty == ARP_TABLE_SIZE) {
+    /* b) the table is full, choose the least destructive entry to recycle:
+     * 1) oldest stable entry
+     * 2) oldest pending entry without queued packets
+     * 3) oldest pending entry with queued packets
+     * 
+     * { ETHARP_TRY_HARD is set at this point }
+     */ 
+    for (i = 0; i < ARP_TABLE_SIZE; ++i) {
+      if (arp_table[i].state == ETHARP_STATE_PENDING) {
 #if ARP_QUEUEING
-    /* no queued packets should exist on stable entries */
-    LWIP_ASSERT("arp_table[i].q == NULL", arp_table[i].q == NULL);
+        /* pending with queued packets? */
+        if (arp_table[i].q != NULL) {
+          if (arp_table[i].ctime >= age_queue) {
+            old_queue = i;
+            age_queue = arp_table[i].ctime;
+          }
+        } else
 #endif
-  /* 3) found recyclable pending entry without queued packets? */
-  } else if (old_pending < ARP_TABLE_SIZE) {
-    /* recycle oldest pending */
-    i = old_pending;
-    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest pending entry %"U16_F" (without queue)\n", (u16_t)i));
+        /* pending without queued packets? */
+        if (arp_table[i].ctime >= age_pending) {
+          old_pending = i;
+          age_pending = arp_table[i].ctime;
+        }
+      } else if (arp_table[i].state == ETHARP_STATE_STABLE) {
+        /* remember entry with oldest stable entry in oldest, its age in maxtime */
+        if (arp_table[i].ctime >= age_stable) {
+          old_stable = i;
+          age_stable = arp_table[i].ctime;
+        }
+      }
+    }
+
+    /* 1) found recyclable stable entry? */
+    if (old_stable < ARP_TABLE_SIZE) {
+      /* recycle oldest stable*/
+      i = old_stable;
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest stable entry %"U16_F"\n", (u16_t)i));
 #if ARP_QUEUEING
-  /* 4) found recyclable pending entry with queued packets? */
-  } else if (old_queue < ARP_TABLE_SIZE) {
-    /* recycle oldest pending */
-    i = old_queue;
-    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest pending entry %"U16_F", freeing packet queue %p\n", (u16_t)i, (void *)(arp_table[i].q)));
-    free_etharp_q(arp_table[i].q);
-    arp_table[i].q = NULL;
+      /* no queued packets should exist on stable entries */
+      LWIP_ASSERT("arp_table[i].q == NULL", arp_table[i].q == NULL);
 #endif
-    /* no empty or recyclable entries found */
-  } else {
-    return (s8_t)ERR_MEM;
+    /* 2) found recyclable pending entry without queued packets? */
+    } else if (old_pending < ARP_TABLE_SIZE) {
+      /* recycle oldest pending */
+      i = old_pending;
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest pending entry %"U16_F" (without queue)\n", (u16_t)i));
+#if ARP_QUEUEING
+    /* 3) found recyclable pending entry with queued packets? */
+    } else if (old_queue < ARP_TABLE_SIZE) {
+      /* recycle oldest pending, its queue is freed on removal */
+      i = old_queue;
+      LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting oldest pending entry %"U16_F", freeing packet queue %p\n", (u16_t)i, (void *)(arp_table[i].q)));
+#endif
+      /* no recyclable entries found (all static) */
+    } else {
+      return (s8_t)ERR_MEM;
+    }
+    etharp_remove_entry(i);
+
+    /* the chain has changed, find where it ends now */
+    for (n = 0; n < ARP_TABLE_SIZE; ++n) {
+      i = (home + n) & ETHARP_TABLE_MASK;
+      if (arp_table[i].state == ETHARP_STATE_EMPTY) {
+        break;
+      }
+    }
+    empty = i;
   }
 
-  /* { empty or recyclable entry found } */
+  /* c) { empty slot at the end of the chain found } */
+  i = empty;
   LWIP_ASSERT("i < ARP_TABLE_SIZE", i < ARP_TABLE_SIZE);
+  LWIP_ASSERT("arp_table[i].state == ETHARP_STATE_EMPTY", arp_table[i].state == ETHARP_STATE_EMPTY);
+  LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("find_entry: selecting empty entry %"U16_F"\n", (u16_t)i));
 
-  if (arp_table[i].state != ETHARP_STATE_EMPTY)
-  {
-    snmp_delete_arpidx_tree(arp_table[i].netif, &arp_table[i].ipaddr);
-  }
-  /* recycle entry (no-op for an already empty entry) */
-  arp_table[i].state = ETHARP_STATE_EMPTY;
-
-  /* IP address given? */
-  if (ipaddr != NULL) {
-    /* set IP address */
-    ip_addr_set(&arp_table[i].ipaddr, ipaddr);
-  }
+  /* set IP address */
+  ip_addr_set(&arp_table[i].ipaddr, ipaddr);
   arp_table[i].ctime = 0;
 #if LWIP_NETIF_HWADDRHINT
   NETIF_SET_HINT(netif, i);
-#else /* #if LWIP_NETIF_HWADDRHINT */
-  etharp_cached_entry = i;
 #endif /* #if LWIP_NETIF_HWADDRHINT */
   return (err_t)i;
 }
@@ -490,11 +514,19 @@ update_arp_entry(struct netif *netif, struct ip_addr *ipaddr, struct eth_addr *e
   /* bail out if no entry could be found */
   if (i < 0)
     return (err_t)i;
+
+  /* static entries are configured, never overwritten by the network */
+  if (arp_table[i].state == ETHARP_STATE_STATIC) {
+    LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("update_arp_entry: not updating static entry %"S16_F"\n", (s16_t)i));
+    return ERR_OK;
+  }
   
   /* mark it stable */
   arp_table[i].state = ETHARP_STATE_STABLE;
+#if LWIP_SNMP
   /* record network interface */
   arp_table[i].netif = netif;
+#endif
 
   /* insert in SNMP ARP index tree */
   snmp_insert_arpidx_tree(netif, &arp_table[i].ipaddr);
@@ -553,7 +585,7 @@ etharp_find_addr(struct netif *netif, struct ip_addr *ipaddr,
 #else /* LWIP_NETIF_HWADDRHINT */
   i = find_entry(ipaddr, ETHARP_FIND_ONLY);
 #endif /* LWIP_NETIF_HWADDRHINT */
-  if((i >= 0) && arp_table[i].state == ETHARP_STATE_STABLE) {
+  if((i >= 0) && arp_table[i].state >= ETHARP_STATE_STABLE) {
       *eth_ret = &arp_table[i].ethaddr;
       *ip_ret = &arp_table[i].ipaddr;
       return i;
@@ -561,6 +593,68 @@ etharp_find_addr(struct netif *netif, struct ip_addr *ipaddr,
   return -1;
 }
 
+/**
+ * Add a static (pinned) IP/MAC address pair to the ARP cache.
+ *
+ * Static entries are never aged out, never recycled to make room for other
+ * addresses and are not changed by ARP traffic. An existing dynamic entry
+ * for the address is converted. At least one slot is always left for
+ * dynamic entries.
+ *
+ * @param ipaddr IP address of the static entry
+ * @param ethaddr Ethernet address of the static entry
+ * @return
+ * - ERR_OK Entry added or updated.
+ * - ERR_ARG Non-unicast address given.
+ * - ERR_MEM No room left for another static entry.
+ */
+err_t
+etharp_add_static_entry(struct ip_addr *ipaddr, struct eth_addr *ethaddr)
+{
+  s8_t i;
+
+  if (ip_addr_isany(ipaddr) || ip_addr_ismulticast(ipaddr) ||
+      (ipaddr->addr == IP_ADDR_BROADCAST->addr)) {
+    return ERR_ARG;
+  }
+
+#if LWIP_NETIF_HWADDRHINT
+  i = find_entry(ipaddr, ETHARP_FIND_ONLY, NULL);
+#else /* LWIP_NETIF_HWADDRHINT */
+  i = find_entry(ipaddr, ETHARP_FIND_ONLY);
+#endif /* LWIP_NETIF_HWADDRHINT */
+  if ((i < 0) || (arp_table[i].state != ETHARP_STATE_STATIC)) {
+    /* a new static entry, keep one slot free for dynamic addresses */
+    if (etharp_static_count >= ARP_TABLE_SIZE - 1) {
+      return ERR_MEM;
+    }
+    if (i < 0) {
+#if LWIP_NETIF_HWADDRHINT
+      i = find_entry(ipaddr, ETHARP_TRY_HARD, NULL);
+#else /* LWIP_NETIF_HWADDRHINT */
+      i = find_entry(ipaddr, ETHARP_TRY_HARD);
+#endif /* LWIP_NETIF_HWADDRHINT */
+      if (i < 0) {
+        return (err_t)i;
+      }
+    }
+#if ARP_QUEUEING
+    if (arp_table[i].q != NULL) {
+      free_etharp_q(arp_table[i].q);
+      arp_table[i].q = NULL;
+    }
+#endif
+    etharp_static_count++;
+  }
+
+  LWIP_DEBUGF(ETHARP_DEBUG | LWIP_DBG_TRACE, ("etharp_add_static_entry: %"U16_F".%"U16_F".%"U16_F".%"U16_F" in entry %"S16_F"\n",
+                                        ip4_addr1(ipaddr), ip4_addr2(ipaddr), ip4_addr3(ipaddr), ip4_addr4(ipaddr), (s16_t)i));
+  arp_table[i].state = ETHARP_STATE_STATIC;
+  arp_table[i].ctime = 0;
+  SMEMCPY(&arp_table[i].ethaddr, ethaddr, sizeof(struct eth_addr));
+  return ERR_OK;
+}
+
 /**
  * Updates the ARP table using the given IP packet.
  *
@@ -922,13 +1016,14 @@ etharp_query(struct netif *netif, struct ip_addr *ipaddr, struct pbuf *q)
     arp_table[i].state = ETHARP_STATE_PENDING;
   }
 
-  /* { i is either a STABLE or (new or existing) PENDING entry } */
-  LWIP_ASSERT("arp_table[i].state == PENDING or STABLE",
+  /* { i is either a STABLE, STATIC or (new or existing) PENDING entry } */
+  LWIP_ASSERT("arp_table[i].state == PENDING, STABLE or STATIC",
   ((arp_table[i].state == ETHARP_STATE_PENDING) ||
-   (arp_table[i].state == ETHARP_STATE_STABLE)));
+   (arp_table[i].state >= ETHARP_STATE_STABLE)));
 
-  /* do we have a pending entry? or an implicit query request? */
-  if ((arp_table[i].state == ETHARP_STATE_PENDING) || (q == NULL)) {
+  /* do we have a pending entry? or an implicit query request for a dynamic entry? */
+  if ((arp_table[i].state == ETHARP_STATE_PENDING) ||
+      ((q == NULL) && (arp_table[i].state != ETHARP_STATE_STATIC))) {
     /* try to resolve it; send out ARP request */
     result = etharp_request(netif, ipaddr);
     if (result != ERR_OK) {
@@ -941,8 +1036,8 @@ etharp_query(struct netif *netif, struct ip_addr *ipaddr, struct pbuf *q)
   
   /* packet given? */
   if (q != NULL) {
-    /* stable entry? */
-    if (arp_table[i].state == ETHARP_STATE_STABLE) {
+    /* stable or static entry? */
+    if (arp_table[i].state >= ETHARP_STATE_STABLE) {
       /* we have a valid IP->Ethernet address mapping */
       /* send the packet */
       result = etharp_send_ip(netif, q, srcaddr, &(arp_table[i].ethaddr));
@@ -38,7 +38,7 @@ using namespace std;
 #define ARP_QUEUEING                    0
 #define LWIP_NETIF_HOSTNAME             1
 
-#define ARP_TABLE_SIZE                  4
+#define ARP_TABLE_SIZE                  8
 
 #define DNS_TABLE_SIZE                  1
 #define DNS_USES_STATIC_BUF             0
@@ -47,7 +47,12 @@ using namespace std;
 // 2 - Heap
 
 #define IP_FRAG_USES_STATIC_BUF         0
-#define LWIP_STATS                      0
+#define LWIP_STATS                      1
+// Counters are exported by clsStatistics, only keep the ones it reports
+#define LWIP_STATS_DISPLAY              0
+#define ICMP_STATS                      0
+#define IPFRAG_STATS                    0
+#define MEMP_STATS                      1
 
 #define DNS_LOCAL_HOSTLIST_IS_DYNAMIC   1
 
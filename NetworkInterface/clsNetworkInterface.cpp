@@ -10,11 +10,14 @@ void clsNetworkInterface::SetupTCP(int intUseDHCP) {
     struct ip_addr  ipNetmask;
     struct ip_addr  ipGateway;
 
-    Ticker tickFast, tickSlow, tickARP, eth_tick, dns_tick, dhcp_coarse, dhcp_fine;
     char *strHostname = "pchilton mbed 001";
 
     // Ensure the client object starts off
     m_objClientConnection = NULL;
+    for (int i=0; i<COMMAND_CONNECTIONS; i++) {
+        m_arrCommandConnections[i].pcb = NULL;
+        m_arrCommandConnections[i].intQueued = 0;
+    }
 
     // Setup network IP's to use
     IP4_ADDR(&ipIPAddress, m_arrIPAddress[0],m_arrIPAddress[1],m_arrIPAddress[2],m_arrIPAddress[3]);
@@ -33,6 +36,13 @@ void clsNetworkInterface::SetupTCP(int intUseDHCP) {
     netif->hostname = strHostname;
     netif_set_default(netif);
     
+    // Pin the static ARP entries so these hosts are never evicted from the ARP cache
+    for (int i=0; i<m_intStaticARPCount; i++) {
+        if (etharp_add_static_entry(&m_arrStaticARPIPAddress[i], &m_arrStaticARPMACAddress[i]) != ERR_OK) {
+            printf("Failed to add static ARP entry %d\n", i + 1);
+        }
+    }
+    
     // Bring the interface up (either using DHCP or directly)
     if (intUseDHCP > 0) {
         dhcp_start(netif);
@@ -49,13 +59,11 @@ void clsNetworkInterface::SetupTCP(int intUseDHCP) {
         printf("Network link 'Down'\n");
     }
     
-    // Initialise timers for TCP/IP
-    tickARP.attach_us( &etharp_tmr,  ARP_TMR_INTERVAL  * 1000);
-    tickFast.attach_us(&tcp_fasttmr, TCP_FAST_INTERVAL * 1000);
-    tickSlow.attach_us(&tcp_slowtmr, TCP_SLOW_INTERVAL * 1000);
-    dns_tick.attach_us(&dns_tmr, DNS_TMR_INTERVAL * 1000);
-    dhcp_coarse.attach_us(&dhcp_coarse_tmr, DHCP_COARSE_TIMER_MSECS * 1000);
-    dhcp_fine.attach_us(&dhcp_fine_tmr, DHCP_FINE_TIMER_MSECS * 1000);
+    // Initialise timers for TCP/IP. The ticker only counts, the timers themselves run from PollTimers in the main
+    // loop so they never interrupt the stack. (The tickers used to be locals here, so they stopped on return.)
+    m_intTimerTicks = 0;
+    m_intTimerTicksProcessed = 0;
+    m_tickTimers.attach_us(&tick_callbackTimers, TCP_TMR_INTERVAL * 1000);
 
     // Clear the temp telnet buffer
     strcpy(m_strCommsBuffer,"");
@@ -71,6 +79,9 @@ void clsNetworkInterface::SetupTCP(int intUseDHCP) {
         // Start listening on the port
         pcb = tcp_listen(pcb);
         
+        // Control priority, device_poll dispatches frames for this port ahead of the serial bridges
+        tcp_setprio(pcb, TCP_PRIO_MAX);
+        
         // Setup callback function to call when a new connection comes in on the TCP port
         tcp_accept(pcb, &accept_callback);
     } else {
@@ -115,32 +126,114 @@ void clsNetworkInterface::SetupTCP(int intUseDHCP) {
     
 }
 
+// Count lwIP timer intervals, called from the ticker interrupt
+void tick_callbackTimers() {
+    m_objNetworkInterface->m_intTimerTicks++;
+}
+
+// Run the lwIP timers that are due, call from the main loop
+void clsNetworkInterface::PollTimers() {
+    while (m_intTimerTicksProcessed != m_intTimerTicks) {
+        m_intTimerTicksProcessed++;
+        
+        // TCP fast timer every tick, slow timer every other tick
+        TRACE_BEGIN(TRACE_SPAN_TIMER, TRACE_TIMER_TCP, 0);
+        tcp_tmr();
+        TRACE_END(TRACE_SPAN_TIMER, TRACE_TIMER_TCP, 0);
+        if ((m_intTimerTicksProcessed % (ARP_TMR_INTERVAL / TCP_TMR_INTERVAL)) == 0) {
+            TRACE_BEGIN(TRACE_SPAN_TIMER, TRACE_TIMER_ARP, 0);
+            etharp_tmr();
+            TRACE_END(TRACE_SPAN_TIMER, TRACE_TIMER_ARP, 0);
+        }
+        if ((m_intTimerTicksProcessed % (DNS_TMR_INTERVAL / TCP_TMR_INTERVAL)) == 0) {
+            TRACE_BEGIN(TRACE_SPAN_TIMER, TRACE_TIMER_DNS, 0);
+            dns_tmr();
+            TRACE_END(TRACE_SPAN_TIMER, TRACE_TIMER_DNS, 0);
+        }
+        if ((m_intTimerTicksProcessed % (DHCP_FINE_TIMER_MSECS / TCP_TMR_INTERVAL)) == 0) {
+            TRACE_BEGIN(TRACE_SPAN_TIMER, TRACE_TIMER_DHCP_FINE, 0);
+            dhcp_fine_tmr();
+            TRACE_END(TRACE_SPAN_TIMER, TRACE_TIMER_DHCP_FINE, 0);
+        }
+        if ((m_intTimerTicksProcessed % (DHCP_COARSE_TIMER_MSECS / TCP_TMR_INTERVAL)) == 0) {
+            TRACE_BEGIN(TRACE_SPAN_TIMER, TRACE_TIMER_DHCP_COARSE, 0);
+            dhcp_coarse_tmr();
+            TRACE_END(TRACE_SPAN_TIMER, TRACE_TIMER_DHCP_COARSE, 0);
+        }
+    }
+}
+
+// Parse and store a static ARP entry ("192.168.0.10" and "00:02:f7:12:34:56"), returns 1 if the entry was stored
+int clsNetworkInterface::intAddStaticARPEntry(char *strIPAddress, char *strMACAddress) {
+    int ip[4];
+    int mac[6];
+    
+    if (m_intStaticARPCount >= STATIC_ARP_ENTRIES) { return 0; }
+    if (sscanf(strIPAddress, "%d.%d.%d.%d", &ip[0], &ip[1], &ip[2], &ip[3]) != 4) { return 0; }
+    if (sscanf(strMACAddress, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) != 6) { return 0; }
+    
+    IP4_ADDR(&m_arrStaticARPIPAddress[m_intStaticARPCount], ip[0], ip[1], ip[2], ip[3]);
+    for (int i=0; i<6; i++) {
+        m_arrStaticARPMACAddress[m_intStaticARPCount].addr[i] = (u8_t)mac[i];
+    }
+    m_intStaticARPCount++;
+    
+    return 1;
+}
+
 long clsNetworkInterface::lngDecodeBase128ValueInReply(int intStartChar) {
     char strTemp[6];
     int intBase128[5];
     long lngValue = 0;
     
     strncpy(strTemp, (char*)&m_strCommsBuffer[intStartChar], 5); strTemp[5] = 0;
-    if (TELNET_DEBUG) { printf("Parameter 1: %s (%d)\n", strTemp, (int)(strTemp)); }
+    if (TELNET_DEBUG) { printf("Parameter 1: %s (%d)\n", strTemp, (int)strTemp[0]); }
     for (int i=0; i<5; i++) {
         intBase128[i] = (int)strTemp[i] - 32; // Encoded byte values are offset by 32 so they are away from control characters
         lngValue *= 128; // Shift value along by 7 bits (multiply by 128 does this)
         lngValue += intBase128[i]; // Append the byte value
     }
 
-    // If number received is a negative one
-    if ((intBase128[0] && 0x08) > 0) {
-        lngValue = -(4294967296 - lngValue);
-    }
+    // Values are 32 bit two's complement, keep the low 32 bits so a negative number is sign extended wherever long is wider
+    lngValue = (long)(int)(unsigned int)lngValue;
 
     if (TELNET_DEBUG) { printf("Decoded Value: %ld\n", lngValue); }
     return lngValue;
 }
 
 void clsNetworkInterface::SendReplyValue(long lngValue) {
+    SendReplyValues(&lngValue, 1);
+}
+
+// Send a reply packet holding several values, each one encoded as a fixed 5 character base 128 value
+void clsNetworkInterface::SendReplyValues(long *arrValues, int intValueCount) {
+    char strPacket[REPLYVALUESMAX * 5 + 4];
+    int n;
+
+    n = intBuildReplyPacket(strPacket, arrValues, intValueCount);
+    if (TELNET_DEBUG) { printf("Sending reply to PC: %d ('%s')\n", n, strPacket); }
+
+    if (m_objClientConnection != NULL) {
+        TRACE_BEGIN(TRACE_SPAN_TCP_SEND, SERVICE_COMMAND, n);
+        if (!intReserveReply(strlen(strPacket))) {
+            FW_STATS_INC(replyWriteErrors);
+        } else if (tcp_write(m_objClientConnection, strPacket, strlen(strPacket), 1) != ERR_OK) {
+            //error("Failed to write data\n");
+            FW_STATS_INC(replyWriteErrors);
+            m_objServiceReservations.WriteFailed(SERVICE_COMMAND);
+        }
+        
+        tcp_output(m_objClientConnection);
+        TRACE_END(TRACE_SPAN_TCP_SEND, SERVICE_COMMAND, n);
+    }
+}
+
+// Build a reply packet into strPacket (REPLYVALUESMAX * 5 + 4 bytes), returns the packet length
+int clsNetworkInterface::intBuildReplyPacket(char *strPacket, long *arrValues, int intValueCount) {
     int n;
     char intChecksum;
-    char strPacket[9];
+
+    if (intValueCount > REPLYVALUESMAX) { intValueCount = REPLYVALUESMAX; }
 
     // Clear the comms buffer
     strcpy(strPacket,"");
@@ -150,11 +243,13 @@ void clsNetworkInterface::SendReplyValue(long lngValue) {
     strPacket[n++] = 2;  // STX
 
     // Fixed 5 character reply in base 128 format, values offset by 32 (so they are away from control characters)
-    strPacket[n++] = (int)(((lngValue>>28) & 0x7F) + 32);
-    strPacket[n++] = (int)(((lngValue>>21) & 0x7F) + 32);
-    strPacket[n++] = (int)(((lngValue>>14) & 0x7F) + 32);
-    strPacket[n++] = (int)(((lngValue>>7) & 0x7F) + 32);
-    strPacket[n++] = (int)(((lngValue) & 0x7F) + 32);
+    for (int v=0; v<intValueCount; v++) {
+        strPacket[n++] = (int)(((arrValues[v]>>28) & 0x7F) + 32);
+        strPacket[n++] = (int)(((arrValues[v]>>21) & 0x7F) + 32);
+        strPacket[n++] = (int)(((arrValues[v]>>14) & 0x7F) + 32);
+        strPacket[n++] = (int)(((arrValues[v]>>7) & 0x7F) + 32);
+        strPacket[n++] = (int)(((arrValues[v]) & 0x7F) + 32);
+    }
 
     // Calculate the checksum of the packet data - from AFTER STX
     intChecksum = 0;
@@ -171,16 +266,8 @@ void clsNetworkInterface::SendReplyValue(long lngValue) {
     strPacket[n++] = intChecksum;
     strPacket[n++] = 3;
     strPacket[n] = 0;
- 
-    if (TELNET_DEBUG) { printf("Sending reply to PC: %d ('%s')\n", n, strPacket); }
 
-    if (m_objClientConnection != NULL) {
-        if (tcp_write(m_objClientConnection, strPacket, strlen(strPacket), 1) != ERR_OK) {
-            //error("Failed to write data\n");
-        }
-        
-        tcp_output(m_objClientConnection);
-    }
+    return n;
 }
 
 void clsNetworkInterface::SendReply(char *strData, int intDataLength) {
@@ -189,11 +276,18 @@ void clsNetworkInterface::SendReply(char *strData, int intDataLength) {
     if (TELNET_DEBUG) { printf("Sending reply to PC: %d ('%s')\n", intDataLength, strData); }
 
     if (m_objClientConnection != NULL) {
-        if (tcp_write(m_objClientConnection, strData, strlen(strData), 1) != ERR_OK) {
+        TRACE_BEGIN(TRACE_SPAN_TCP_SEND, SERVICE_COMMAND, intDataLength);
+        if (!intReserveReply(strlen(strData))) {
+            FW_STATS_INC(replyWriteErrors);
+        } else if (tcp_write(m_objClientConnection, strData, strlen(strData), 1) != ERR_OK) {
             //error("Failed to write data\n");
+            FW_STATS_INC(replyWriteErrors);
+            m_objServiceReservations.WriteFailed(SERVICE_COMMAND);
         }
         
         tcp_output(m_objClientConnection);
+        CMD_TIMING_MARK(TIMING_REPLY);
+        TRACE_END(TRACE_SPAN_TCP_SEND, SERVICE_COMMAND, intDataLength);
     }
 }
 
@@ -296,7 +390,9 @@ int clsNetworkInterface::intValidatePacket(char *strData) {
       if (NETWORK_DEBUG_VALIDATE_PACKET) { printf("DATA = '%s'\n", packet); }
    } else {
       if (NETWORK_DEBUG_VALIDATE_PACKET) { printf("\n\nSTX/ETX INVALID: %d %d strlen: %d\n\n", stxPosition, etxPosition, strlen(strData)); }
-      printf("\n\nSTX/ETX INVALID: %d %d strlen: %d\n\n", stxPosition, etxPosition, strlen(strData));
+      TRACE(TRACE_COMMAND_FRAMING, stxPosition, etxPosition);
+      FW_STATS_INC(commandFramingErrors);
+      CAPTURE_TRIGGER(CAPTURE_TRIGGER_FRAMING);
       return 0;
    }
 
@@ -323,7 +419,9 @@ int clsNetworkInterface::intValidatePacket(char *strData) {
    // If the checksum character is correct
    if (intChecksum != intChecksum2) {
       if (NETWORK_DEBUG_VALIDATE_PACKET) { printf("THE CHECKSUMS DO NOT MATCH!!!!!!!!!\n"); }
-      printf("THE CHECKSUMS DO NOT MATCH!!!!!!!!!\n");
+      TRACE(TRACE_COMMAND_CHECKSUM, intChecksum, intChecksum2);
+      FW_STATS_INC(commandChecksumErrors);
+      CAPTURE_TRIGGER(CAPTURE_TRIGGER_CHECKSUM);
       // Return so more data can be received
       return 0;
    }
@@ -360,6 +458,8 @@ int clsNetworkInterface::intParseTelnetData() {
 
         if (intValidResult > 0) {
             // Valid packet, process command
+            FW_STATS_INC(commandsReceived);
+            CMD_TIMING_MARK(TIMING_PARSED);
             PacketReceived(m_strCommsBuffer, intValidResult, m_intLastPacketRXLength);
            
             // Clear the temp telnet buffer
@@ -375,6 +475,8 @@ int clsNetworkInterface::intParseTelnetData() {
         return 1;
     } else {
         if (TELNET_DEBUG) { printf("Buffer full, clearing comms input buffer\n"); }
+        FW_STATS_INC(commandBufferOverflows);
+        CAPTURE_TRIGGER(CAPTURE_TRIGGER_OVERFLOW);
         // Clear the comms buffer
         strcpy(m_strCommsBuffer,"");
     }
@@ -382,15 +484,72 @@ int clsNetworkInterface::intParseTelnetData() {
     return 0;
 }
 
+// Parse received data against the partial packet held for one command connection, so the packets of
+// different clients are never mixed
+int clsNetworkInterface::intParseCommandData(CommandConnection *objConnection) {
+    int     intResult;
+    
+    strcpy(m_strCommsBuffer, objConnection->strBuffer);
+    intResult = intParseTelnetData();
+    strcpy(objConnection->strBuffer, m_strCommsBuffer);
+    
+    return intResult;
+}
+
+// Free the slot of a command connection that has gone, replies are no longer sent to it and only its own queued data
+// stops counting against the command port
+void clsNetworkInterface::CloseCommandConnection(CommandConnection *objConnection) {
+    if (m_objClientConnection == objConnection->pcb) { m_objClientConnection = NULL; }
+    objConnection->pcb = NULL;
+    UpdateCommandQueued(objConnection);
+}
+
+// Refresh the heap held by one command connection and charge the command port with the total over every open one
+void clsNetworkInterface::UpdateCommandQueued(CommandConnection *objConnection) {
+    int intTotal = 0;
+    
+    objConnection->intQueued = (objConnection->pcb != NULL) ? clsServiceReservations::intQueuedOn(objConnection->pcb) : 0;
+    for (int i=0; i<COMMAND_CONNECTIONS; i++) {
+        if (m_arrCommandConnections[i].pcb != NULL) { intTotal += m_arrCommandConnections[i].intQueued; }
+    }
+    m_objServiceReservations.SetQueued(SERVICE_COMMAND, intTotal);
+}
+
+// Check whether a reply of intLength bytes may be queued on the client connection, returns 1 if it may
+int clsNetworkInterface::intReserveReply(int intLength) {
+    for (int i=0; i<COMMAND_CONNECTIONS; i++) {
+        if (m_arrCommandConnections[i].pcb == m_objClientConnection) {
+            UpdateCommandQueued(&m_arrCommandConnections[i]);
+            break;
+        }
+    }
+    return m_objServiceReservations.intReserve(SERVICE_COMMAND, NULL, intLength);
+}
+
+// Data on a command connection has been acknowledged, the command port now holds less of the heap
+static err_t sent_callbackCommand(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    m_objNetworkInterface->UpdateCommandQueued((CommandConnection *)arg);
+    return ERR_OK;
+}
+
+// A command connection has been aborted or reset and its pcb is already freed
+static void err_callbackCommand(void *arg, err_t err) {
+    m_objNetworkInterface->CloseCommandConnection((CommandConnection *)arg);
+}
 
 // This method is called each time data is received on the TCP connection
 err_t recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
+    CommandConnection *objConnection = (CommandConnection *)arg;
     int i;
     char *data;
 
     // Check if status is ok and data is arrived.
     if (err == ERR_OK && p != NULL) {
         if (TELNET_DEBUG) { printf("TCP RX:"); }
+        CMD_TIMING_MARK(TIMING_RECEIVED);
+        
+        // Reply on the connection the command arrived on
+        m_objNetworkInterface->m_objClientConnection = pcb;
         
         // Inform TCP that we have taken the data
         tcp_recved(pcb, p->tot_len);
@@ -417,8 +576,8 @@ err_t recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
         // Terminate received string
         m_objNetworkInterface->m_strCommsInputTemp[i] = 0;
         
-        // Check whether the data received contains a valid packet
-        m_objNetworkInterface->intParseTelnetData();
+        // Check whether the data received completes a valid packet from this client
+        m_objNetworkInterface->intParseCommandData(objConnection);
 
         /*
         // No data arrived 
@@ -428,6 +587,15 @@ err_t recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err) {
         */
     }
 
+    // The client closed the connection, its queued data no longer counts against the command port
+    if (err == ERR_OK && p == NULL) {
+        TRACE(TRACE_CONNECTION_CLOSED, pcb->local_port, 0);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+        m_objNetworkInterface->CloseCommandConnection(objConnection);
+        tcp_close(pcb);
+    }
+
     return ERR_OK;
 }
 
@@ -437,42 +605,65 @@ void clsNetworkInterface::SendSerialData(int port, char *data, int length) {
     
     if (TELNET_DEBUG) { printf("Sending reply to Ethernet Serial Port %d: '%s' (Length: %d)\n", port, data, length); }
     //printf("Sending reply to Ethernet Serial Port %d: '%s' (Length: %d)\n", port, data, length);
+    TRACE_BEGIN(TRACE_SPAN_TCP_SEND, port, length);
     
     if (port == 1) {
         if (_ethernetSerialPort1 != NULL) {
-            if (tcp_sndbuf(_ethernetSerialPort1) > 0)
+            // Only queue the data if the port is within its share of the heap, so the command port is never starved
+            if (tcp_sndbuf(_ethernetSerialPort1) > 0 && m_objServiceReservations.intReserve(SERVICE_SERIAL1, _ethernetSerialPort1, length))
             {
                 if (tcp_write(_ethernetSerialPort1, data, length, 1) != ERR_OK) {
                     //error("Failed to write data\n");
+                    FW_STATS_ADD(serialToTCPDroppedBytes[0], length);
+                    m_objServiceReservations.WriteFailed(SERVICE_SERIAL1);
+                } else {
+                    FW_STATS_ADD(serialToTCPBytes[0], length);
                 }
                 
                 tcp_output(_ethernetSerialPort1);
+            } else {
+                FW_STATS_ADD(serialToTCPDroppedBytes[0], length);
             }
         }
     } else if (port == 2) {
         if (_ethernetSerialPort2 != NULL) {
-            if (tcp_sndbuf(_ethernetSerialPort2) > 0)
+            // Only queue the data if the port is within its share of the heap, so the command port is never starved
+            if (tcp_sndbuf(_ethernetSerialPort2) > 0 && m_objServiceReservations.intReserve(SERVICE_SERIAL2, _ethernetSerialPort2, length))
             {
                 if (tcp_write(_ethernetSerialPort2, data, length, 1) != ERR_OK) {
                     //error("Failed to write data\n");
+                    FW_STATS_ADD(serialToTCPDroppedBytes[1], length);
+                    m_objServiceReservations.WriteFailed(SERVICE_SERIAL2);
+                } else {
+                    FW_STATS_ADD(serialToTCPBytes[1], length);
                 }
                 
                 tcp_output(_ethernetSerialPort2);
+            } else {
+                FW_STATS_ADD(serialToTCPDroppedBytes[1], length);
             }
         }
     } else if (port == 3) {
         if (_ethernetSerialPort3 != NULL) {
-            if (tcp_sndbuf(_ethernetSerialPort3) > 0)
+            // Only queue the data if the port is within its share of the heap, so the command port is never starved
+            if (tcp_sndbuf(_ethernetSerialPort3) > 0 && m_objServiceReservations.intReserve(SERVICE_SERIAL3, _ethernetSerialPort3, length))
             {
                 if (tcp_write(_ethernetSerialPort3, data, length, 1) != ERR_OK) {
                     //error("Failed to write data\n");
+                    FW_STATS_ADD(serialToTCPDroppedBytes[2], length);
+                    m_objServiceReservations.WriteFailed(SERVICE_SERIAL3);
+                } else {
+                    FW_STATS_ADD(serialToTCPBytes[2], length);
                 }
                 
                 tcp_output(_ethernetSerialPort3);
+            } else {
+                FW_STATS_ADD(serialToTCPDroppedBytes[2], length);
             }
         }
     }
     
+    TRACE_END(TRACE_SPAN_TCP_SEND, port, length);
 }
 
 // This method is called each time data is received on the TCP connection
@@ -492,7 +683,7 @@ err_t recv_callbackSerialPort1(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
  
         // Get the length of data received
         i = p->tot_len;
-        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; printf("Serial Port 1 Transmit Buffer Overflow\n"); }
+        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; TRACE(TRACE_BRIDGE_OVERFLOW, 1, p->tot_len); FW_STATS_INC(tcpToSerialOverflows[0]); }
         
         if (i<=0) {
             printf("Callback called with no data (%d)\n",i);
@@ -507,9 +698,18 @@ err_t recv_callbackSerialPort1(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
         if (TELNET_DEBUG) { printf("%s (%d)\n", data, p->tot_len); }
                 
         // Call data received method with the data
+        FW_STATS_ADD(tcpToSerialBytes[0], i);
         m_objNetworkInterface->EthernetSerialPortDataReceived(1, data, i);
     }
 
+    // The client closed the connection, release its share of the heap and close our side
+    if (err == ERR_OK && p == NULL) {
+        TRACE(TRACE_CONNECTION_CLOSED, pcb->local_port, 0);
+        m_objServiceReservations.Detach(SERVICE_SERIAL1, pcb);
+        if (m_objNetworkInterface->_ethernetSerialPort1 == pcb) { m_objNetworkInterface->_ethernetSerialPort1 = NULL; }
+        tcp_close(pcb);
+    }
+
     return ERR_OK;
 }
 
@@ -530,7 +730,7 @@ err_t recv_callbackSerialPort2(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
                 
         // Get the length of data received
         i = p->tot_len;
-        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; printf("Serial Port 2 Transmit Buffer Overflow\n"); }
+        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; TRACE(TRACE_BRIDGE_OVERFLOW, 2, p->tot_len); FW_STATS_INC(tcpToSerialOverflows[1]); }
         
         if (i<=0) {
             printf("Callback called with no data (%d)\n",i);
@@ -545,9 +745,18 @@ err_t recv_callbackSerialPort2(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
         if (TELNET_DEBUG) { printf("%s (%d)\n", data, p->tot_len); }
         
         // Call data received method with the data
+        FW_STATS_ADD(tcpToSerialBytes[1], i);
         m_objNetworkInterface->EthernetSerialPortDataReceived(2, data, i);
     }
 
+    // The client closed the connection, release its share of the heap and close our side
+    if (err == ERR_OK && p == NULL) {
+        TRACE(TRACE_CONNECTION_CLOSED, pcb->local_port, 0);
+        m_objServiceReservations.Detach(SERVICE_SERIAL2, pcb);
+        if (m_objNetworkInterface->_ethernetSerialPort2 == pcb) { m_objNetworkInterface->_ethernetSerialPort2 = NULL; }
+        tcp_close(pcb);
+    }
+
     return ERR_OK;
 }
 
@@ -568,7 +777,7 @@ err_t recv_callbackSerialPort3(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
         
         // Get the length of data received
         i = p->tot_len;
-        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; printf("Serial Port 3 Transmit Buffer Overflow\n"); }
+        if (i > TELNETBUFFERSIZE) { i = TELNETBUFFERSIZE; TRACE(TRACE_BRIDGE_OVERFLOW, 3, p->tot_len); FW_STATS_INC(tcpToSerialOverflows[2]); }
         
         if (i<=0) {
             printf("Callback called with no data (%d)\n",i);
@@ -583,44 +792,59 @@ err_t recv_callbackSerialPort3(void *arg, struct tcp_pcb *pcb, struct pbuf *p, e
         if (TELNET_DEBUG) { printf("%s (%d)\n", data, p->tot_len); }
         
         // Call data received method with the data
+        FW_STATS_ADD(tcpToSerialBytes[2], i);
         m_objNetworkInterface->EthernetSerialPortDataReceived(3, data, i);
     }
 
+    // The client closed the connection, release its share of the heap and close our side
+    if (err == ERR_OK && p == NULL) {
+        TRACE(TRACE_CONNECTION_CLOSED, pcb->local_port, 0);
+        m_objServiceReservations.Detach(SERVICE_SERIAL3, pcb);
+        if (m_objNetworkInterface->_ethernetSerialPort3 == pcb) { m_objNetworkInterface->_ethernetSerialPort3 = NULL; }
+        tcp_close(pcb);
+    }
+
     return ERR_OK;
 }
 
 // Accept an incoming call on the registered port 
 err_t accept_callback(void *arg, struct tcp_pcb *objClientConnection, err_t err) {
-    printf("Accepting new client connection\n");
+    CommandConnection *objConnection = NULL;
+    
+    TRACE(TRACE_CONNECTION_ACCEPT, objClientConnection->local_port, 0);
     LWIP_UNUSED_ARG(arg);
     
+    // Give the client a slot of its own for the packets it sends, refuse it (lwIP aborts the connection) when all are taken
+    for (int i=0; i<COMMAND_CONNECTIONS; i++) {
+        if (m_objNetworkInterface->m_arrCommandConnections[i].pcb == NULL) {
+            objConnection = &m_objNetworkInterface->m_arrCommandConnections[i];
+            break;
+        }
+    }
+    if (objConnection == NULL) { return ERR_MEM; }
+    objConnection->pcb = objClientConnection;
+    objConnection->strBuffer[0] = 0;
+    
     // Assign the callback function to call when data is received from this client connection
+    tcp_arg(objClientConnection, objConnection);
     tcp_recv(objClientConnection, &recv_callback);
     
-    // Store the client connection object to use
-    m_objNetworkInterface->m_objClientConnection = objClientConnection;
+    // Replies go out as soon as they are written and the connection is the last one dropped when memory runs out,
+    // the priority also has device_poll dispatch its frames ahead of the serial bridges
+    objClientConnection->flags |= TF_NODELAY;
+    tcp_setprio(objClientConnection, TCP_PRIO_MAX);
+    
+    // Track the heap held by the connection as data is sent and acknowledged, and free the slot if it is reset
+    tcp_sent(objClientConnection, &sent_callbackCommand);
+    tcp_err(objClientConnection, &err_callbackCommand);
+    m_objNetworkInterface->UpdateCommandQueued(objConnection);
     
     return ERR_OK;
 }
 
-err_t dataSent_SerialPort1(void * arg, struct tcp_pcb * tpcb, u16_t len) {
-    //printf("%d characters sent to Ethernet Serial Port 1\n", len);
-    return NULL;
-}
-
-err_t dataSent_SerialPort2(void * arg, struct tcp_pcb * tpcb, u16_t len) {
-    //printf("%d characters sent to Ethernet Serial Port 1\n", len);
-    return NULL;
-}
-
-err_t dataSent_SerialPort3(void * arg, struct tcp_pcb * tpcb, u16_t len) {
-    //printf("%d characters sent to Ethernet Serial Port 1\n", len);
-    return NULL;
-}
-
 // Accept an incoming call on the registered port 
 err_t accept_callbackSerialPort1(void *arg, struct tcp_pcb *clientConnection, err_t err) {
-    printf("Accepting new serial port 1 connection\n");
+    TRACE(TRACE_CONNECTION_ACCEPT, clientConnection->local_port, 0);
     LWIP_UNUSED_ARG(arg);
     
     // Assign the callback function to call when data is received from this client connection
@@ -629,15 +853,15 @@ err_t accept_callbackSerialPort1(void *arg, struct tcp_pcb *clientConnection, er
     // Store the client connection object to use
     m_objNetworkInterface->_ethernetSerialPort1 = clientConnection;
     
-    // Register a callback function when data has been sent through the connection
-    tcp_sent(clientConnection, &dataSent_SerialPort1);
+    // Track the heap held by the connection as data is sent and acknowledged
+    m_objServiceReservations.Attach(SERVICE_SERIAL1, clientConnection);
     
     return ERR_OK;
 }
 
 // Accept an incoming call on the registered port 
 err_t accept_callbackSerialPort2(void *arg, struct tcp_pcb *clientConnection, err_t err) {
-    printf("Accepting new serial port 2 connection\n");
+    TRACE(TRACE_CONNECTION_ACCEPT, clientConnection->local_port, 0);
     LWIP_UNUSED_ARG(arg);
     
     // Assign the callback function to call when data is received from this client connection
@@ -646,15 +870,15 @@ err_t accept_callbackSerialPort2(void *arg, struct tcp_pcb *clientConnection, er
     // Store the client connection object to use
     m_objNetworkInterface->_ethernetSerialPort2 = clientConnection;
     
-    // Register a callback function when data has been sent through the connection
-    tcp_sent(clientConnection, &dataSent_SerialPort2);
+    // Track the heap held by the connection as data is sent and acknowledged
+    m_objServiceReservations.Attach(SERVICE_SERIAL2, clientConnection);
     
     return ERR_OK;
 }
 
 // Accept an incoming call on the registered port 
 err_t accept_callbackSerialPort3(void *arg, struct tcp_pcb *clientConnection, err_t err) {
-    printf("Accepting new serial port 3 connection\n");
+    TRACE(TRACE_CONNECTION_ACCEPT, clientConnection->local_port, 0);
     LWIP_UNUSED_ARG(arg);
     
     // Assign the callback function to call when data is received from this client connection
@@ -663,8 +887,8 @@ err_t accept_callbackSerialPort3(void *arg, struct tcp_pcb *clientConnection, er
     // Store the client connection object to use
     m_objNetworkInterface->_ethernetSerialPort3 = clientConnection;
     
-    // Register a callback function when data has been sent through the connection
-    tcp_sent(clientConnection, &dataSent_SerialPort3);
+    // Track the heap held by the connection as data is sent and acknowledged
+    m_objServiceReservations.Attach(SERVICE_SERIAL3, clientConnection);
     
     return ERR_OK;
 }
@@ -8,6 +8,9 @@
 #define TELNET_DEBUG 0
 #define TELNETBUFFERSIZE 50 // Keeping this at 254 or below because you don't want it larger than the serial buffer
 #define NETWORK_DEBUG_VALIDATE_PACKET 0
+#define STATIC_ARP_ENTRIES 4 // Maximum number of pinned ARP cache entries read from the config file
+#define REPLYVALUESMAX 96 // Maximum number of values in one reply packet (see SendReplyValues)
+#define COMMAND_CONNECTIONS 4 // Clients that may be connected to the command port at once
 
 // vvvvvvvvvvv ETHERNET vvvvvvvvvvv
 // Import library from: 
@@ -26,12 +29,26 @@
 #include "netif/loopif.h"
 #include "device.h"
 // ^^^^^^^^^^^ ETHERNET ^^^^^^^^^^^
+#include "clsStatistics.h"
+#include "clsServiceReservations.h"
+#include "clsCommandTiming.h"
+#include "clsTrace.h"
+#include "clsPacketCapture.h"
+
+// A client of the command port and the part of a packet received from it so far
+struct CommandConnection {
+    struct tcp_pcb  *pcb;
+    char            strBuffer[TELNETBUFFERSIZE];
+    int             intQueued;                          // Heap held by the data queued on it (see clsServiceReservations)
+};
 
 err_t recv_callback(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
 err_t recv_callbackSerialPort1(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
 err_t recv_callbackSerialPort2(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
 err_t recv_callbackSerialPort3(void *arg, struct tcp_pcb *pcb, struct pbuf *p, err_t err);
 
+void tick_callbackTimers();
+
 err_t accept_callback(void *arg, struct tcp_pcb *npcb, err_t err);
 err_t accept_callbackSerialPort1(void *arg, struct tcp_pcb *npcb, err_t err);
 err_t accept_callbackSerialPort2(void *arg, struct tcp_pcb *npcb, err_t err);
@@ -48,10 +65,16 @@ class clsNetworkInterface {
         void            (* PacketReceived)(char *strReceivedData, int intNodeAddress, int intPacketLength);
         
         int             m_intLastPacketRXLength;
+        
+        // LWIP TIMERS
+        Ticker          m_tickTimers;
+        unsigned int    m_intTimerTicksProcessed;
+        
         int             FindCharPosition(char *data, int length, int searchValue, int startPosition);
         
     public:
-        struct tcp_pcb  *m_objClientConnection;
+        struct tcp_pcb  *m_objClientConnection;               // Connection the command being processed arrived on
+        CommandConnection m_arrCommandConnections[COMMAND_CONNECTIONS];
         struct tcp_pcb  *_ethernetSerialPort1;
         struct tcp_pcb  *_ethernetSerialPort2;
         struct tcp_pcb  *_ethernetSerialPort3;
@@ -59,8 +82,15 @@ class clsNetworkInterface {
         void            (* EthernetSerialPortDataReceived)(int portnum, char *data, int length);
         void            SendSerialData(int port, char *data, int length);
         int             m_arrIPAddress[4];
+        volatile unsigned int m_intTimerTicks;                 // lwIP timer intervals elapsed, counted by the ticker interrupt
         char            m_strCommsInputTemp[TELNETBUFFERSIZE]; // Temp buffer array used for telnet data manipulation
         
+        // STATIC ARP ENTRIES (read from the config file, added to the ARP cache by SetupTCP)
+        int             m_intStaticARPCount;
+        struct ip_addr  m_arrStaticARPIPAddress[STATIC_ARP_ENTRIES];
+        struct eth_addr m_arrStaticARPMACAddress[STATIC_ARP_ENTRIES];
+        int             intAddStaticARPEntry(char *strIPAddress, char *strMACAddress);
+        
         // Constructor
         clsNetworkInterface(
                                 void (* fncFunctionToCallWhenPacketReceived)(char *strReceivedData, int intNodeAddress, int intPacketLength),
@@ -72,6 +102,7 @@ class clsNetworkInterface {
             _ethernetSerialPort1 = NULL;
             _ethernetSerialPort2 = NULL;
             _ethernetSerialPort3 = NULL;
+            m_intStaticARPCount = 0;
         }
         
         // Destructor
@@ -80,9 +111,16 @@ class clsNetworkInterface {
         }
         
         void SetupTCP(int intUseDHCP);
+        void PollTimers();
         void SendReplyValue(long lngValue);
+        void SendReplyValues(long *arrValues, int intValueCount);
+        int intBuildReplyPacket(char *strPacket, long *arrValues, int intValueCount);
         long lngDecodeBase128ValueInReply(int intStartChar);
         int intParseTelnetData();
+        int intParseCommandData(CommandConnection *objConnection);
+        void CloseCommandConnection(CommandConnection *objConnection);
+        void UpdateCommandQueued(CommandConnection *objConnection);
+        int intReserveReply(int intLength);
         int intValidatePacket(char *strData);
         void SendReply(char *strData, int intDataLength);
 };
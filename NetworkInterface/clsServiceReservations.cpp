@@ -0,0 +1,76 @@
+#include "clsServiceReservations.h"
+
+clsServiceReservations m_objServiceReservations;
+
+// Data has been acknowledged, the service now holds less of the heap
+static err_t sent_callbackReservation(void *arg, struct tcp_pcb *pcb, u16_t len) {
+    m_objServiceReservations.Update((int)(long)arg, pcb);
+    return ERR_OK;
+}
+
+// The connection has been aborted or reset and its pcb is already freed
+static void err_callbackReservation(void *arg, err_t err) {
+    m_objServiceReservations.Update((int)(long)arg, NULL);
+}
+
+// Track a newly accepted connection for the service
+void clsServiceReservations::Attach(int intService, struct tcp_pcb *pcb) {
+    tcp_arg(pcb, (void *)(long)intService);
+    tcp_sent(pcb, &sent_callbackReservation);
+    tcp_err(pcb, &err_callbackReservation);
+    Update(intService, pcb);
+}
+
+// The connection has been closed normally, stop tracking it so its queued data is no longer charged to the service
+void clsServiceReservations::Detach(int intService, struct tcp_pcb *pcb) {
+    tcp_sent(pcb, NULL);
+    tcp_err(pcb, NULL);
+    Update(intService, NULL);
+}
+
+// Refresh the heap held by the service from the queued data on its connection
+void clsServiceReservations::Update(int intService, struct tcp_pcb *pcb) {
+    if (pcb == NULL) {
+        m_arrQueued[intService] = 0;
+        return;
+    }
+    
+    m_arrQueued[intService] = intQueuedOn(pcb);
+}
+
+// Heap held by the data queued on one connection
+int clsServiceReservations::intQueuedOn(struct tcp_pcb *pcb) {
+    return (TCP_SND_BUF - tcp_sndbuf(pcb)) + pcb->snd_queuelen * SERVICE_PBUF_COST;
+}
+
+// Check whether the service may queue another intLength bytes, returns 1 if it may. A service with several connections
+// keeps its total up to date with SetQueued and passes a NULL pcb.
+int clsServiceReservations::intReserve(int intService, struct tcp_pcb *pcb, int intLength) {
+    int intNeeded, intSharedUsed;
+    
+    if (pcb != NULL) { Update(intService, pcb); }
+    intNeeded = m_arrQueued[intService] + intLength + SERVICE_PBUF_COST;
+    
+    // Always allowed within the guaranteed minimum
+    if (intNeeded <= m_arrMinimum[intService]) { return 1; }
+    
+    // Never past the cap
+    if (intNeeded > m_arrMaximum[intService]) {
+        m_arrFailures[intService]++;
+        return 0;
+    }
+    
+    // Above the minimum the excess has to fit in what the other services have left of the shared remainder
+    intSharedUsed = 0;
+    for (int i=0; i<SERVICE_COUNT; i++) {
+        if (i != intService && m_arrQueued[i] > m_arrMinimum[i]) {
+            intSharedUsed += m_arrQueued[i] - m_arrMinimum[i];
+        }
+    }
+    if (intNeeded - m_arrMinimum[intService] > m_intShared - intSharedUsed) {
+        m_arrFailures[intService]++;
+        return 0;
+    }
+    
+    return 1;
+}
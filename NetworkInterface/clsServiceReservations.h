@@ -0,0 +1,63 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef SERVICERESERVATIONS_H
+#define SERVICERESERVATIONS_H 1
+
+#include "lwip/opt.h"
+#include "lwip/tcp.h"
+
+// Services sharing the lwIP heap for queued transmit data
+#define SERVICE_COMMAND         0
+#define SERVICE_SERIAL1         1
+#define SERVICE_SERIAL2         2
+#define SERVICE_SERIAL3         3
+#define SERVICE_COUNT           4
+
+// Heap bytes the services may hold in queued transmit data. The rest of MEM_SIZE is left to the stack itself
+// (pcbs, the frame being received, DHCP and ARP), which is not gated here.
+#define SERVICE_TX_BUDGET       2400
+#define SERVICE_PBUF_COST       96      // Heap used by each queued pbuf besides its data (pbuf, headers, segment, mem headers)
+
+// Guaranteed minimum and cap of each service, whatever is left of the budget after the minimums is shared
+#define SERVICE_COMMAND_MIN     800     // Room for the largest reply (statistics) while the bridges are saturated
+#define SERVICE_COMMAND_MAX     1200
+#define SERVICE_SERIAL_MIN      200
+#define SERVICE_SERIAL_MAX      1200
+
+class clsServiceReservations {
+    private:
+        int             m_arrQueued[SERVICE_COUNT];     // Heap held by each service, refreshed whenever one of its connections is touched
+        int             m_arrMinimum[SERVICE_COUNT];
+        int             m_arrMaximum[SERVICE_COUNT];
+        int             m_intShared;
+        
+    public:
+        u32_t           m_arrFailures[SERVICE_COUNT];   // Transmits refused by the reservation or failed in tcp_write
+        
+        // Constructor
+        clsServiceReservations() {
+            int intMinimumTotal = 0;
+            
+            for (int i=0; i<SERVICE_COUNT; i++) {
+                m_arrQueued[i] = 0;
+                m_arrFailures[i] = 0;
+                m_arrMinimum[i] = (i == SERVICE_COMMAND) ? SERVICE_COMMAND_MIN : SERVICE_SERIAL_MIN;
+                m_arrMaximum[i] = (i == SERVICE_COMMAND) ? SERVICE_COMMAND_MAX : SERVICE_SERIAL_MAX;
+                intMinimumTotal += m_arrMinimum[i];
+            }
+            m_intShared = SERVICE_TX_BUDGET - intMinimumTotal;
+        }
+        
+        void Attach(int intService, struct tcp_pcb *pcb);
+        void Detach(int intService, struct tcp_pcb *pcb);
+        void Update(int intService, struct tcp_pcb *pcb);
+        void SetQueued(int intService, int intQueued) { m_arrQueued[intService] = intQueued; }
+        static int intQueuedOn(struct tcp_pcb *pcb);
+        int intReserve(int intService, struct tcp_pcb *pcb, int intLength);
+        void WriteFailed(int intService) { m_arrFailures[intService]++; }
+};
+
+extern clsServiceReservations m_objServiceReservations;
+#endif
@@ -0,0 +1,106 @@
+#include "clsAxisSnapshot.h"
+
+clsAxisSnapshot m_objAxisSnapshot;
+
+// Propeller command for each value, before the axis is added
+static int intItemCommand(int intItem) {
+    if (intItem < SNAPSHOT_POSITION) { return 20; } // IsAxisBusy
+    if (intItem < SNAPSHOT_ESTOP) { return 24; }    // GetEncoderPosition
+    return 200;                                     // GetESTOPState
+}
+
+// Call once the Propeller has answered, the values are then read in turn from the main loop
+void clsAxisSnapshot::Setup(clsPropellerInterface *objPropeller) {
+    m_objPropeller = objPropeller;
+    m_intLastPoll = CMD_TIMING_NOW();
+    m_intWaitUs = m_intPollUs;
+}
+
+void clsAxisSnapshot::Store(int intItem, long lngValue) {
+    m_arrValue[intItem] = lngValue;
+    m_arrTime[intItem] = CMD_TIMING_NOW();
+    m_intRead |= 1 << intItem;
+}
+
+// Called on every pass of the main loop. Reads one value when the poll is due, so a pass is held up by one Propeller
+// transaction at most. A read the Propeller does not answer has already blocked the loop through intTX's retries, so the
+// reads stop for SNAPSHOT_BACKOFF_MS and the values keep their last reading, their age showing in the snapshot.
+void clsAxisSnapshot::Poll() {
+    char strPacket[12];
+    int intReplyLength, intAxis;
+
+    if (m_objPropeller == NULL || m_intPollUs == 0 || CMD_TIMING_NOW() - m_intLastPoll < m_intWaitUs) { return; }
+
+    intAxis = (m_intNext < SNAPSHOT_ESTOP) ? (m_intNext % SNAPSHOT_AXES) + 1 : 1;
+    intReplyLength = m_objPropeller->intTX(strPacket, m_objPropeller->intBuildPacket(strPacket, intItemCommand(m_intNext), intAxis, NULL));
+    if (intReplyLength > 0) {
+        Store(m_intNext, m_objPropeller->lngReplyValue(intReplyLength));
+        m_intWaitUs = m_intPollUs;
+    } else {
+        m_intPollFailures++;
+        m_intWaitUs = SNAPSHOT_BACKOFF_MS * 1000;
+    }
+    m_intLastPoll = CMD_TIMING_NOW();
+
+    m_intPolls++;
+    m_intNext = (m_intNext + 1) % SNAPSHOT_ITEMS;
+}
+
+// A node 1 command has been answered by the Propeller, keep its value if it is one of the snapshot's
+void clsAxisSnapshot::Observe(int intCommand, int intReplyLength) {
+    int intItem;
+
+    // The command byte may have come through a signed char
+    intCommand &= 0xFF;
+    if (intCommand >= 20 && intCommand < 20 + SNAPSHOT_AXES) {
+        intItem = SNAPSHOT_BUSY + intCommand - 20;
+    } else if (intCommand >= 24 && intCommand < 24 + SNAPSHOT_AXES) {
+        intItem = SNAPSHOT_POSITION + intCommand - 24;
+    } else if (intCommand == 200) {
+        intItem = SNAPSHOT_ESTOP;
+    } else {
+        return;
+    }
+
+    Store(intItem, m_objPropeller->lngReplyValue(intReplyLength));
+    m_intObserved++;
+}
+
+// Last encoder position read for an axis (1 to SNAPSHOT_AXES) and when it was read, 0 if it has not been
+long clsAxisSnapshot::lngPosition(int intAxis, u32_t *intTime) {
+    int intItem = SNAPSHOT_POSITION + intAxis - 1;
+
+    *intTime = m_arrTime[intItem];
+    return (m_intRead & (1 << intItem)) ? m_arrValue[intItem] : 0;
+}
+
+// Fill the array with the I/O and axis status, returns the number of values written. The inputs and outputs are
+// current, the axis values are the last read of each (see Poll and Observe).
+//
+// Layout:
+//   0      debounced inputs, bank 0 in the low byte
+//   1      outputs, bank 0 in the low byte
+//   2      status flags: SNAPSHOT_FLAG_BUSY << (axis - 1) for each busy axis, SNAPSHOT_FLAG_ESTOP
+//   3      age of the oldest axis value in milliseconds, -1 until every value has been read
+//   4-     encoder position of each axis
+int clsAxisSnapshot::intGetValues(long *arrValues) {
+    u32_t intNow = CMD_TIMING_NOW();
+    u32_t intAge = 0;
+    long lngFlags = 0;
+    int n = 0;
+
+    for (int i=0; i<SNAPSHOT_AXES; i++) {
+        if (m_arrValue[SNAPSHOT_BUSY + i]) { lngFlags |= SNAPSHOT_FLAG_BUSY << i; }
+    }
+    if (m_arrValue[SNAPSHOT_ESTOP]) { lngFlags |= SNAPSHOT_FLAG_ESTOP; }
+    for (int i=0; i<SNAPSHOT_ITEMS; i++) {
+        if (intNow - m_arrTime[i] > intAge) { intAge = intNow - m_arrTime[i]; }
+    }
+
+    arrValues[n++] = m_objInputMonitor.m_intState;
+    arrValues[n++] = m_objOutputDriver.m_intOutputs;
+    arrValues[n++] = lngFlags;
+    arrValues[n++] = (m_intRead == (1 << SNAPSHOT_ITEMS) - 1) ? (long)(intAge / 1000) : -1;
+    for (int i=0; i<SNAPSHOT_AXES; i++) { arrValues[n++] = m_arrValue[SNAPSHOT_POSITION + i]; }
+    return n;
+}
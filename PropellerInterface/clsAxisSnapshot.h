@@ -0,0 +1,74 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef AXISSNAPSHOT_H
+#define AXISSNAPSHOT_H 1
+
+#include "lwip/opt.h"
+#include "clsCommandTiming.h"
+#include "clsPropellerInterface.h"
+#include "clsInputMonitor.h"
+#include "clsOutputDriver.h"
+
+#define SNAPSHOT_AXES 4                 // Axes on the Propeller, the axis is added to the command (HomeAxis 4 is 4-7)
+#define SNAPSHOT_POLL_MS 0              // One axis value is read from the Propeller this often, 0 to only keep the values seen in node 1 replies
+#define SNAPSHOT_BACKOFF_MS 10000       // Background reads stop for this long after one fails, as each failure blocks the main loop for seconds
+
+// Values kept, each read by one Propeller command
+#define SNAPSHOT_BUSY 0                 // IsAxisBusy (20), one per axis
+#define SNAPSHOT_POSITION SNAPSHOT_AXES // GetEncoderPosition (24), one per axis
+#define SNAPSHOT_ESTOP (2 * SNAPSHOT_AXES) // GetESTOPState (200)
+#define SNAPSHOT_ITEMS (2 * SNAPSHOT_AXES + 1)
+
+// Status flags in a snapshot reply
+#define SNAPSHOT_FLAG_BUSY 0x01         // Shifted left by the axis number less one
+#define SNAPSHOT_FLAG_ESTOP 0x10
+
+#define SNAPSHOT_VALUES (4 + SNAPSHOT_AXES) // Number of values returned by intGetValues
+
+class clsAxisSnapshot {
+    private:
+        clsPropellerInterface *m_objPropeller;
+        long            m_arrValue[SNAPSHOT_ITEMS];
+        u32_t           m_arrTime[SNAPSHOT_ITEMS];      // When each value was read, on the command timing clock
+        unsigned int    m_intRead;                      // One bit per value read at least once
+        int             m_intNext;                      // Value the next background read is for
+        u32_t           m_intLastPoll;                  // End of the last background read
+        u32_t           m_intWaitUs;                    // Time from then to the next read, longer after a failure
+
+        void            Store(int intItem, long lngValue);
+
+    public:
+        unsigned int    m_intPollUs;
+        unsigned int    m_intPolls;                     // Background reads
+        unsigned int    m_intPollFailures;              // Background reads the Propeller did not answer
+        unsigned int    m_intObserved;                  // Values taken from node 1 replies
+
+        // Constructor
+        clsAxisSnapshot() {
+            m_objPropeller = NULL;
+            for (int i=0; i<SNAPSHOT_ITEMS; i++) {
+                m_arrValue[i] = 0;
+                m_arrTime[i] = 0;
+            }
+            m_intRead = 0;
+            m_intNext = 0;
+            m_intLastPoll = 0;
+            m_intWaitUs = 0;
+            m_intPollUs = SNAPSHOT_POLL_MS * 1000;
+            m_intPolls = 0;
+            m_intPollFailures = 0;
+            m_intObserved = 0;
+        }
+
+        void Setup(clsPropellerInterface *objPropeller);
+        void SetPoll(int intPollMs) { m_intPollUs = intPollMs * 1000; m_intWaitUs = m_intPollUs; }
+        void Poll();
+        void Observe(int intCommand, int intReplyLength);
+        long lngPosition(int intAxis, u32_t *intTime);
+        int intGetValues(long *arrValues);
+};
+
+extern clsAxisSnapshot m_objAxisSnapshot;
+#endif
@@ -0,0 +1,148 @@
+#include "clsPositionCapture.h"
+#include "clsAxisSnapshot.h"
+
+clsPositionCapture m_objPositionCapture;
+
+// Arm or disarm an input, returns 0 if the word is not valid
+int clsPositionCapture::intArm(unsigned int intWord) {
+    int intInput = intWord & 0x0F;
+    int intAxis = (intWord >> 8) & 0x0F;
+
+    intWord &= 0x1F30;
+    if (intWord & (POSITION_RISE | POSITION_FALL) << 4) {
+        if (intAxis < 1 || intAxis > SNAPSHOT_AXES) { return 0; }
+    } else {
+        intWord = 0;
+    }
+
+    // The sampler reads the arming from its interrupt
+    __disable_irq();
+    m_arrArm[intInput] = intWord;
+    if (intWord) {
+        m_intArmed |= 1 << intInput;
+    } else {
+        m_intArmed &= ~(1 << intInput);
+    }
+    __enable_irq();
+    return 1;
+}
+
+void clsPositionCapture::Complete(PositionCapture *c, long lngPosition, u32_t intReadTime, int intFlags) {
+    c->position = lngPosition;
+    c->readTime = intReadTime;
+    c->flags = intFlags;
+}
+
+// Called through POSITION_CAPTURE_EDGES by the input sampler, with the debounced inputs after the edges. A capture from
+// the snapshot is complete straight away, the rest wait for the main loop to read the encoder.
+void clsPositionCapture::Edges(unsigned int intChanged, unsigned int intState, u32_t intTime) {
+    unsigned int intEdges = intChanged & m_intArmed;
+
+    for (int i=0; i<POSITION_INPUTS; i++) {
+        if (!(intEdges & (1 << i))) { continue; }
+
+        unsigned int intArm = m_arrArm[i];
+        int intEdge = (intState & (1 << i)) ? POSITION_RISE : POSITION_FALL;
+        if (!((intArm >> 4) & intEdge)) { continue; }
+
+        // Overwrites the oldest capture, even one still waiting for its read
+        PositionCapture *c = &m_arrCaptures[m_intSequence % POSITION_CAPTURES];
+        if (c->flags & POSITION_PENDING) { m_intPending--; }
+        c->time = intTime;
+        c->input = i;
+        c->edge = intEdge;
+        c->axis = (intArm >> 8) & 0x0F;
+        if (intArm & POSITION_SNAPSHOT) {
+            u32_t intReadTime;
+            long lngPosition = m_objAxisSnapshot.lngPosition(c->axis, &intReadTime);
+            Complete(c, lngPosition, intReadTime, POSITION_FROM_SNAPSHOT);
+        } else {
+            c->flags = POSITION_PENDING;
+            m_intPending++;
+        }
+        m_intSequence++;
+    }
+}
+
+// Called on every pass of the main loop, ahead of everything else. Reads the encoder of the axis of the oldest capture
+// waiting, and completes every capture waiting on that axis with it; other axes are read on the passes after.
+void clsPositionCapture::Poll() {
+    char strPacket[12];
+    unsigned int intFrom, intSequence;
+    int intAxis, intReplyLength, intFlags;
+    long lngPosition;
+    u32_t intReadTime;
+
+    if (m_intPending == 0 || m_objPropeller == NULL) { return; }
+
+    // Oldest first
+    intSequence = m_intSequence;
+    intFrom = (intSequence > POSITION_CAPTURES) ? intSequence - POSITION_CAPTURES : 0;
+    intAxis = 0;
+    for (unsigned int i=intFrom; i<intSequence && intAxis == 0; i++) {
+        if (m_arrCaptures[i % POSITION_CAPTURES].flags & POSITION_PENDING) { intAxis = m_arrCaptures[i % POSITION_CAPTURES].axis; }
+    }
+    if (intAxis == 0) { return; }
+
+    intReplyLength = m_objPropeller->intTX(strPacket, m_objPropeller->intBuildPacket(strPacket, 24, intAxis, NULL)); // GetEncoderPosition
+    intReadTime = CMD_TIMING_NOW();
+    lngPosition = (intReplyLength > 0) ? m_objPropeller->lngReplyValue(intReplyLength) : 0;
+    intFlags = (intReplyLength > 0) ? 0 : POSITION_FAILED;
+    m_intReads++;
+
+    // Captures made during the read are as late as it, so they take it too
+    __disable_irq();
+    intSequence = m_intSequence;
+    intFrom = (intSequence > POSITION_CAPTURES) ? intSequence - POSITION_CAPTURES : 0;
+    for (unsigned int i=intFrom; i<intSequence; i++) {
+        PositionCapture *c = &m_arrCaptures[i % POSITION_CAPTURES];
+        if ((c->flags & POSITION_PENDING) && c->axis == intAxis) {
+            Complete(c, lngPosition, intReadTime, intFlags);
+            m_intPending--;
+        }
+    }
+    __enable_irq();
+}
+
+// Fill the array with the captures from sequence number lngFrom on, returns the number of values written. Stops at the
+// first capture still waiting for its read, captures already overwritten are skipped.
+//
+// Layout:
+//   0      sequence number of the first capture returned
+//   1      captures returned
+//   2      sequence number to ask for next
+//   3      encoder reads made
+//   4-     each capture: time of the edge in microseconds on the command timing clock,
+//          input | edge << 8 | axis << 16 | flags << 24, encoder position, microseconds from the edge to the read
+//          (negative for a snapshot read before the edge)
+int clsPositionCapture::intGetCaptures(long lngFrom, long *arrValues, int intMaxValues) {
+    unsigned int intFrom, intCount, intSequence;
+    int n = POSITION_LOG_HEADER;
+
+    __disable_irq();
+    intSequence = m_intSequence;
+    if (lngFrom < 0) {
+        intFrom = intSequence;
+    } else {
+        intFrom = lngFrom;
+        if (intFrom > intSequence) { intFrom = intSequence; }
+        if (intSequence - intFrom > POSITION_CAPTURES) { intFrom = intSequence - POSITION_CAPTURES; }
+    }
+    intCount = 0;
+    while (intFrom + intCount < intSequence && n + POSITION_LOG_VALUES <= intMaxValues) {
+        PositionCapture *c = &m_arrCaptures[(intFrom + intCount) % POSITION_CAPTURES];
+        if (c->flags & POSITION_PENDING) { break; }
+        arrValues[n++] = c->time;
+        arrValues[n++] = c->input | (c->edge << 8) | (c->axis << 16) | ((long)c->flags << 24);
+        arrValues[n++] = c->position;
+        arrValues[n++] = (long)(c->readTime - c->time);
+        intCount++;
+    }
+    __enable_irq();
+
+    arrValues[0] = intFrom;
+    arrValues[1] = intCount;
+    arrValues[2] = intFrom + intCount;
+    arrValues[3] = m_intReads;
+    return n;
+}
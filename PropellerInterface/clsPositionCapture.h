@@ -0,0 +1,79 @@
+#ifndef MBED_H
+#include "mbed.h"
+#endif
+
+#ifndef POSITIONCAPTURE_H
+#define POSITIONCAPTURE_H 1
+
+#include "lwip/opt.h"
+#include "clsCommandTiming.h"
+#include "clsPropellerInterface.h"
+
+#define POSITION_INPUTS 16              // Inputs that can be armed, as clsInputMonitor
+#define POSITION_CAPTURES 32            // Captures held, oldest overwritten first
+#define POSITION_LOG_HEADER 4           // Values before the captures in a command 247 reply (see intGetCaptures)
+#define POSITION_LOG_VALUES 4           // Values per capture in a command 247 reply
+
+// Arming word, node 3 command 246
+//   bits 0-3   input
+//   bits 4-5   edges that capture (POSITION_RISE, POSITION_FALL), none disarms the input
+//   bits 8-11  axis, 1 to 4
+//   bit 12     POSITION_SNAPSHOT
+#define POSITION_RISE 0x01
+#define POSITION_FALL 0x02
+#define POSITION_SNAPSHOT 0x1000        // Take the last position read by clsAxisSnapshot, straight away, rather than reading the encoder
+
+// Capture flags
+#define POSITION_PENDING 0x01           // The encoder read is still to be made
+#define POSITION_FROM_SNAPSHOT 0x02     // The position and read time are the snapshot's
+#define POSITION_FAILED 0x04            // The Propeller did not answer, the position is not valid
+
+// A single test on the input sampler's edge path while no input is armed
+#define POSITION_CAPTURE_EDGES(changed, state, time) do { if (m_objPositionCapture.m_intArmed & (changed)) { m_objPositionCapture.Edges((changed), (state), (time)); } } while (0)
+
+// One armed edge
+struct PositionCapture {
+    u32_t           time;                           // Microseconds, on the command timing clock, of the sample that completed the edge
+    u32_t           readTime;                       // When the position was read
+    s32_t           position;                       // Encoder position
+    u8_t            input;
+    u8_t            edge;                           // POSITION_RISE or POSITION_FALL
+    u8_t            axis;
+    u8_t            flags;
+};
+
+class clsPositionCapture {
+    private:
+        clsPropellerInterface *m_objPropeller;
+        PositionCapture m_arrCaptures[POSITION_CAPTURES];
+        unsigned int    m_arrArm[POSITION_INPUTS];      // Arming word of each input, without the input number
+        unsigned int    m_intPending;                   // Captures with POSITION_PENDING set
+
+        void            Complete(PositionCapture *c, long lngPosition, u32_t intReadTime, int intFlags);
+
+    public:
+        volatile unsigned int m_intArmed;               // One bit per armed input
+        volatile unsigned int m_intSequence;            // Sequence number of the next capture
+        unsigned int    m_intReads;                     // Encoder reads, one may complete several captures on an axis
+
+        // Constructor
+        clsPositionCapture() {
+            m_objPropeller = NULL;
+            for (int i=0; i<POSITION_INPUTS; i++) { m_arrArm[i] = 0; }
+            for (int i=0; i<POSITION_CAPTURES; i++) { m_arrCaptures[i].flags = 0; }
+            m_intPending = 0;
+            m_intArmed = 0;
+            m_intSequence = 0;
+            m_intReads = 0;
+        }
+
+        void Setup(clsPropellerInterface *objPropeller) { m_objPropeller = objPropeller; }
+        int intArm(unsigned int intWord);
+        unsigned int intGetArm(int intInput) { return m_arrArm[intInput]; }
+        void Edges(unsigned int intChanged, unsigned int intState, u32_t intTime);
+        void Poll();
+        int intGetCaptures(long lngFrom, long *arrValues, int intMaxValues);
+};
+
+extern clsPositionCapture m_objPositionCapture;
+#endif
@@ -1,24 +1,52 @@
 #include "clsPropellerInterface.h"
 
-// Setup the propeller interface, ensuring pin designations are set and that the port is ready to receive data
-void clsPropellerInterface::SetupPropellerInterface(BusInOut *bus_PropellerDataBUS, DigitalIn *in_PropellerControlRX, DigitalOut *out_PropellerControlTX, PwmOut *statusLed) {
-    // Assign pins
-    m_bus_PropellerDataBUS = bus_PropellerDataBUS;
-    m_in_PropellerControlRX = in_PropellerControlRX;
-    m_out_PropellerControlTX = out_PropellerControlTX;
+// Setup the propeller interface, ensuring that the port is ready to receive data.
+// The handshake lines are fixed at compile time (see clsFastGPIO), the data bus is driven through the bus arbiter, which leaves it floating.
+void clsPropellerInterface::SetupPropellerInterface(PwmOut *statusLed) {
     _statusLed = statusLed;
     
-    // Set bus as input pins ready for receiving our first data nibble
-    m_bus_PropellerDataBUS->input();
     // Set TX line high as ready to receive
-    m_out_PropellerControlTX->write(1);
+    PropellerTCLK::high();
 }
 
 // Send a command to the propeller and obtain a response
 long clsPropellerInterface::lngSendCommand(int intCommand, int intAxis, long lngParameterValue) {
+    char strPacket[12]; // Maximum packet size with a value
+
+    // Send the command to the propeller and receive the reply
+    int intPacketLength = intTX(strPacket, intBuildPacket(strPacket, intCommand, intAxis, lngParameterValue));
+    if (intPacketLength > 0) {
+        return lngReplyValue(intPacketLength);
+    }
+    
+    if (PROPELLER_DEBUG) { printf("No Reply...\r\n"); }
+
+    // Failed to receive response from propeller!
+    return NULL;
+}
+
+// Parse the value of the reply in m_strReply, of intReplyLength bytes as returned by intTX
+long clsPropellerInterface::lngReplyValue(int intReplyLength) {
+    if (intReplyLength > 5) {
+    	if (PROPELLER_DEBUG) { printf("Decoding Base128 Value...\r\n"); }
+
+        // Parse and return the reply value
+        return lngDecodeBase128ValueInReply();
+    }
+    
+	if (PROPELLER_DEBUG) { printf("Decoding Value...\r\n"); }
+
+	// Value is a single number response (boolean)
+    int intValue = (int)m_strReply[1];
+    if (intValue == 49) { return 1; }
+    if (intValue == 48) { return 0; }
+    return intValue;
+}
+
+// Build a command packet for the propeller into strPacket (12 bytes or more), returns the packet length
+int clsPropellerInterface::intBuildPacket(char *strPacket, int intCommand, int intAxis, long lngParameterValue) {
     int n;
     char intChecksum;
-    char strPacket[12]; // Maximum packet size with a value
 
     // Command is offset by the axis number
     char bytCommand = intCommand + (intAxis - 1);
@@ -56,28 +84,8 @@ long clsPropellerInterface::lngSendCommand(int intCommand, int intAxis, long lng
     strPacket[n++] = intChecksum; // Checksum
     strPacket[n++] = 3; // ETX
     strPacket[n] = 0;
- 
-    // Send the command to the propeller and receive the reply
-    int intPacketLength = intTX(strPacket, n);
-    if (intPacketLength > 5) {
-    	if (PROPELLER_DEBUG) { printf("Decoding Base128 Value...\r\n"); }
-
-        // Parse and return the reply value
-        return lngDecodeBase128ValueInReply();
-    } else if (intPacketLength > 0) {
-    	if (PROPELLER_DEBUG) { printf("Decoding Value...\r\n"); }
-
-    	// Value is a single number response (boolean)
-        int intValue = (int)m_strReply[1];
-        if (intValue == 49) { return 1; }
-        if (intValue == 48) { return 0; }
-        return intValue;
-    }
     
-    if (PROPELLER_DEBUG) { printf("No Reply...\r\n"); }
-
-    // Failed to receive response from propeller!
-    return NULL;
+    return n;
 }
 
 // Decode the reply value from a propeller reply
@@ -96,10 +104,8 @@ long clsPropellerInterface::lngDecodeBase128ValueInReply() {
         lngValue += intBase128[i]; // Append the byte value
     }
             
-    // If number received is a negative one
-    if ((intBase128[0] && 0x08) > 0) {
-        lngValue = -(4294967296 - lngValue);
-    }
+    // Values are 32 bit two's complement, keep the low 32 bits so a negative number is sign extended wherever long is wider
+    lngValue = (long)(int)(unsigned int)lngValue;
 
     if (PROPELLER_DEBUG) { printf("Decoded Value: %ld\n", lngValue); }
     return lngValue;
@@ -108,15 +114,23 @@ long clsPropellerInterface::lngDecodeBase128ValueInReply() {
 // Transmits a packet to the propller and obtains a response.
 // Function returns the length of the reply data received back from the propller
 int clsPropellerInterface::intTX(char* strPacket, int intPacketLength) {
+    FW_STATS_INC(propellerTransactions);
+    TRACE_BEGIN(TRACE_SPAN_PROPELLER, strPacket[2], intPacketLength);
+    
     // Attempt to send packets to the propeller multiple times to give us the best chance of good comms
     for (int intRetry=0; intRetry<3; intRetry++) {
+        if (intRetry > 0) { FW_STATS_INC(propellerRetries); }
         _statusLed->write(1);
         
+        // The data bus is shared with the expanders, their queued cycles run between the bytes sent (see clsBusArbiter)
+        m_objBusArbiter.Acquire();
+        
         // Send the received command to the propeller
         TX(strPacket, intPacketLength);
 
         // Get a reply from the prop
         int intReplyLength = RX();
+        m_objBusArbiter.Release();
         
         _statusLed->write(0);
         
@@ -141,29 +155,31 @@ int clsPropellerInterface::intTX(char* strPacket, int intPacketLength) {
         if (intReplyLength > 0) {
             // Check that the reply was valid
             if (intValidatePacket(m_strReply) > 0) {
+                TRACE_END(TRACE_SPAN_PROPELLER, strPacket[2], intReplyLength);
                 return intReplyLength;
             } else {
-                printf("Checksum from propeller is invalid\n");
+                TRACE(TRACE_PROPELLER_CHECKSUM, intRetry, intReplyLength);
+                FW_STATS_INC(propellerChecksumErrors);
             }
         }
     }
     
     // Unable to get a response from the propller
+    FW_STATS_INC(propellerFailures);
+    CAPTURE_TRIGGER(CAPTURE_TRIGGER_PROPELLER);
+    TRACE_END(TRACE_SPAN_PROPELLER, strPacket[2], 0);
     return 0;
 }
 
 // Transmit a packet to the propeller
 void clsPropellerInterface::TX(char* strPacket, int intPacketLength) {
     // Check the slave is ready to receive data
-    if (m_in_PropellerControlRX->read() == 0) {
+    if (PropellerRCLK::read() == 0) {
     	if (PROPELLER_DEBUG_HIGHLEVEL) { printf("Slave is not ready to accept commands\n"); }
         // Slave is not ready
         return;
     }
     
-    // Set data pins to outputs
-    m_bus_PropellerDataBUS->output();
-
     int intByteCharacter;
     if (PROPELLER_DEBUG_HIGHLEVEL) { printf("Sending packet to propeller: "); }
     
@@ -182,49 +198,54 @@ void clsPropellerInterface::TX(char* strPacket, int intPacketLength) {
             //    m_bus_PropellerDataBUS->write((intByteCharacter & 0xF0) >> 4);
             //}
             
-            // Set data
-            m_bus_PropellerDataBUS->write(intByteCharacter);
+            // Set data, the bus is turned to output by the first write
+            m_objBusArbiter.Drive(intByteCharacter);
 
             // Set TCLK low
-            m_out_PropellerControlTX->write(0);
+            PropellerTCLK::low();
 
             Timer tmrTimeout;
             tmrTimeout.start();
             
             // Wait for RCLK to be pulled low (slave received data)
-            while (m_in_PropellerControlRX->read() != 0) {
+            while (PropellerRCLK::read() != 0) {
                 // Check for a timeout waiting for a reply from the propeller
                 if(tmrTimeout.read_ms() > 1000) {
-                    printf("Timed out waiting for propeller to acknowledge data\n");
+                    TRACE(TRACE_PROPELLER_TX_TIMEOUT, intByte, 0);
+                    FW_STATS_INC(propellerTimeouts);
                     return;
                 }
             }
             
             // Set TCLK high
-            m_out_PropellerControlTX->write(1);
+            PropellerTCLK::high();
 
             tmrTimeout.reset();
             // Wait for RCLK to be pulled high again (slave ready for next nibble)
-            while (m_in_PropellerControlRX->read() == 0) {
+            while (PropellerRCLK::read() == 0) {
                 // Check for a timeout waiting for a reply from the propeller
                 if(tmrTimeout.read_ms() > 1000) {
-                    printf("Timed out waiting for propeller to be ready after acknowledging data\n");
+                    TRACE(TRACE_PROPELLER_TX_TIMEOUT, intByte, 1);
+                    FW_STATS_INC(propellerTimeouts);
                     return;
                 }
             }
+            
+            // The propeller has the byte, queued expander cycles can use the bus before the next
+            BUS_YIELD();
         //}
     }
 
     if (PROPELLER_DEBUG_HIGHLEVEL) { printf("\n"); }
 
     // Set data pins to inputs again
-    m_bus_PropellerDataBUS->input();
+    m_objBusArbiter.Float();
 }
 
 // Receive a response from the propller
 int clsPropellerInterface::RX() {
     // Set TCLK high before we start processing (it should be anyway)
-    m_out_PropellerControlTX->write(1);
+    PropellerTCLK::high();
 
     // Keep track of whether we are reading an upper or lower nibble
     //int intNibble = 0;
@@ -236,10 +257,11 @@ int clsPropellerInterface::RX() {
     tmrTimeout.start();
     
     // Wait until the slave is transmitting data (RCLK LOW)
-    while (m_in_PropellerControlRX->read() == 1) {
+    while (PropellerRCLK::read() != 0) {
         // Check for a timeout waiting for a reply from the propeller
         if(tmrTimeout.read_ms() > 1000) {
-            printf("Timed out waiting for propeller to start replying\n");
+            TRACE(TRACE_PROPELLER_RX_TIMEOUT, 0, 0);
+            FW_STATS_INC(propellerTimeouts);
             return 0;
         }
     }
@@ -250,7 +272,7 @@ int clsPropellerInterface::RX() {
     if (PROPELLER_DEBUG_HIGHLEVEL) { printf("Receiving packet from propeller: "); }
     
     // Check the slave is transmitting data (RCLK LOW)
-    while (m_in_PropellerControlRX->read() == 0) {
+    while (PropellerRCLK::read() == 0) {
         // Set the data character
         //if (intNibble == 0) {
         //    // Read data from the bus
@@ -263,7 +285,7 @@ int clsPropellerInterface::RX() {
         //}
 
         // Read data from the bus
-        intData = m_bus_PropellerDataBUS->read();
+        intData = m_objBusArbiter.intRead();
         m_strReply[intByte] = intData;
         if (PROPELLER_DEBUG_HIGHLEVEL) { printf("%d ", intData); }
         
@@ -272,20 +294,24 @@ int clsPropellerInterface::RX() {
         m_strReply[intByte + 1] = 0;
         
         // Take TCLK low to ACK reception
-        m_out_PropellerControlTX->write(0);
+        PropellerTCLK::low();
         
         tmrTimeout.reset();
         // Wait for RCLK to be high again (transmitting unit has received the ACK)
-        while (m_in_PropellerControlRX->read() == 0) {
+        while (PropellerRCLK::read() == 0) {
             // Check for a timeout waiting for a reply from the propeller
             if(tmrTimeout.read_ms() > 1000) {
-                printf("Timed out waiting for propeller to send reply\n");
+                TRACE(TRACE_PROPELLER_RX_TIMEOUT, intByte, 1);
+                FW_STATS_INC(propellerTimeouts);
                 return 0;
             }
         }
         
+        // The propeller waits for TCLK before the next byte, so queued expander cycles can run first (see BUS_SLOT_REPLY)
+        if (BUS_SLOT_REPLY) { BUS_YIELD(); }
+        
         // Reset TCLK to indicate we are ready for out next nibble
-        m_out_PropellerControlTX->write(1);
+        PropellerTCLK::high();
         
         // Cycle nibble tracker variable
         //intNibble++;
@@ -308,10 +334,11 @@ int clsPropellerInterface::RX() {
         
         // Wait until the slave is transmitting data (RCLK LOW)
         tmrTimeout.reset();
-        while (m_in_PropellerControlRX->read() == 1) {
+        while (PropellerRCLK::read() != 0) {
             // Check for a timeout waiting for a reply from the propeller
             if(tmrTimeout.read_us() > 1000) {
-                printf("Timed out waiting for propeller to send reply\n");
+                TRACE(TRACE_PROPELLER_RX_TIMEOUT, intByte, 2);
+                FW_STATS_INC(propellerTimeouts);
                 return 0;
             }
         }
@@ -3,6 +3,14 @@
 #include "mbed.h"
 #endif
 
+#ifndef PROPELLERINTERFACE_H
+#define PROPELLERINTERFACE_H 1
+
+#include "clsStatistics.h"
+#include "clsTrace.h"
+#include "clsPacketCapture.h"
+#include "clsBusArbiter.h"
+
 #define PROPELLER_DEBUG 0
 #define PROPELLER_DEBUG_VALIDATE_PACKET 0
 #define PROPELLER_DEBUG_HIGHLEVEL 0
@@ -12,23 +20,23 @@
 
 class clsPropellerInterface {
     private:
-        BusInOut    *m_bus_PropellerDataBUS;
-        DigitalIn   *m_in_PropellerControlRX;
-        DigitalOut  *m_out_PropellerControlTX;
         PwmOut      *_statusLed;
         
         void        TX(char* strPacket, int intPacketLength);
         int         RX();
-        int         intValidatePacket(char *strData);
         int         FindCharPosition(char *data, int length, int searchValue, int startPosition);
         
     public:
         char        m_strReply[255];
         int         m_intLastPacketRXLength;
                 
-        void        SetupPropellerInterface(BusInOut *bus_PropellerDataBUS, DigitalIn *in_PropellerControlRX, DigitalOut *out_PropellerControlTX, PwmOut *statusLed);
+        void        SetupPropellerInterface(PwmOut *statusLed);
         int         intTX(char* strPacket, int intPacketLength);
         long        lngSendCommand(int intCommand, int intAxis, long lngParameterValue);
+        int         intBuildPacket(char *strPacket, int intCommand, int intAxis, long lngParameterValue);
         long        lngDecodeBase128ValueInReply();
+        long        lngReplyValue(int intReplyLength);
+        int         intValidatePacket(char *strData);
         
 };
+#endif
@@ -0,0 +1,57 @@
+/*
+ * Host (Linux, LP64) port of LWIP/arch/cc.h. Found ahead of it on the include path by the
+ * host build, only the pointer sized type and the assert differ.
+ */
+#ifndef __LWIP_ARCH_CC_H__
+#define __LWIP_ARCH_CC_H__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef LITTLE_ENDIAN
+#define LITTLE_ENDIAN 1234
+#endif
+
+#ifndef BYTE_ORDER
+#define BYTE_ORDER  LITTLE_ENDIAN
+#endif
+
+typedef unsigned char   u8_t;
+typedef signed char     s8_t;
+typedef unsigned short  u16_t;
+typedef signed short    s16_t;
+typedef unsigned int    u32_t;
+typedef signed int      s32_t;
+typedef uintptr_t       mem_ptr_t;
+
+#ifndef NULL
+#define NULL 0
+#endif
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define LWIP_PLATFORM_DIAG(x) printf x
+#define LWIP_PLATFORM_ASSERT(x) do { fprintf(stderr, "lwIP assert: %s (%s:%d)\n", x, __FILE__, __LINE__); abort(); } while(0)
+
+#define LWIP_PROVIDE_ERRNO
+
+#define U16_F "hu"
+#define S16_F "hd"
+#define X16_F "hx"
+#define U32_F "u"
+#define S32_F "d"
+#define X32_F "x"
+
+#define PACK_STRUCT_FIELD(x) x
+#define PACK_STRUCT_STRUCT  __attribute__((packed))
+#define PACK_STRUCT_BEGIN
+#define PACK_STRUCT_END
+
+#endif /* __LWIP_ARCH_CC_H__ */
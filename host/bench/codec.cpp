@@ -0,0 +1,320 @@
+/* Microbenchmark for the packet codecs on every request's path, linked against the firmware's own code:
+ *
+ *   clsPropellerInterface::intBuildPacket             command encoder (lngSendCommand)
+ *   clsPropellerInterface::lngDecodeBase128ValueInReply
+ *   clsPropellerInterface::intValidatePacket          propeller reply framing and checksum
+ *   clsNetworkInterface::intBuildReplyPacket          reply encoder (SendReplyValue/SendReplyValues)
+ *   clsNetworkInterface::intValidatePacket            command port framing and checksum
+ *   clsNetworkInterface::intParseTelnetData           command port path: append, validate, dispatch, decode
+ *
+ * Reports ns/op and bytes per cycle (TSC reference cycles on x86) over packet sizes and noise patterns,
+ * including adversarial runs of stray STX bytes, after round trip checks of every encoder/decoder pair
+ * over edge and random values (negative values included). Exits non-zero if a check fails.
+ */
+#include "clsNetworkInterface.h"
+#include "clsPropellerInterface.h"
+
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define MIN_RUN_NS 200000000ULL     // Each case runs for at least 0.2 s
+#define COMMAND_BUFFER 50           // Size of the command port buffer (TELNETBUFFERSIZE in clsNetworkInterface.h)
+#define PROPELLER_BUFFER 80         // Size of the propeller packet buffer (TELNETBUFFERSIZE in clsPropellerInterface.h)
+
+// Globals normally defined in main.cpp
+clsNetworkInterface *m_objNetworkInterface;
+clsPropellerInterface *m_objPropellerInterface;
+
+// Results go here, anything the firmware prints on stdout is discarded
+static FILE *m_fileOut;
+
+static long m_lngDecoded;
+static int m_intDispatched;
+static int m_intDecodeInCallback;
+
+static void PacketReceived(char *strReceivedData, int intNodeAddress, int intPacketLength) {
+    m_intDispatched++;
+    if (m_intDecodeInCallback && intPacketLength >= 10) { m_lngDecoded = m_objNetworkInterface->lngDecodeBase128ValueInReply(3); }
+}
+
+static void EthernetSerialPortDataReceived(int portnum, char *data, int length) {}
+
+// Static so the private buffers start zeroed, as the firmware's heap allocated instance does
+static clsNetworkInterface m_objNetwork(&PacketReceived, &EthernetSerialPortDataReceived);
+static clsPropellerInterface m_objPropeller;
+
+static unsigned long long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned long long cycles() {
+#ifdef HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static unsigned int m_intRandom = 2463534242u;
+static unsigned int random32() {
+    m_intRandom ^= m_intRandom << 13;
+    m_intRandom ^= m_intRandom >> 17;
+    m_intRandom ^= m_intRandom << 5;
+    return m_intRandom;
+}
+
+// Printable noise that never contains STX, ETX or a zero
+static void noise(char *p, int n) {
+    for (int i=0; i<n; i++) { p[i] = 32 + random32() % 95; }
+}
+
+// ===========================================================================================================================================================================================
+// ROUND TRIP CHECKS
+// ===========================================================================================================================================================================================
+
+static int m_intChecks, m_intFailures;
+
+static void check(int ok, const char *what, long value) {
+    m_intChecks++;
+    if (!ok) {
+        m_intFailures++;
+        if (m_intFailures <= 20) { fprintf(m_fileOut, "FAIL: %s (value %ld)\n", what, value); }
+    }
+}
+
+// Propeller command encoder -> command port validation and decoder, as a command relayed to the propeller is seen by both
+static void check_command(long value) {
+    char packet[12];
+    int n = m_objPropeller.intBuildPacket(packet, 8, 1, value);
+    
+    if (value == 0) {
+        // lngSendCommand sends no value for zero (the parameter is compared with NULL)
+        check(n == 5, "zero parameter is sent without a value", value);
+        return;
+    }
+    check(n == 10, "command packet length", value);
+    
+    // The command port expects node + 10, patch the node byte and its checksum contribution
+    packet[8] ^= packet[1] ^ 11;
+    packet[1] = 11;
+    
+    strcpy(m_objNetwork.m_strCommsInputTemp, packet);
+    m_intDispatched = 0;
+    m_intDecodeInCallback = 1;
+    m_objNetwork.intParseTelnetData();
+    check(m_intDispatched == 1, "command packet accepted by the command port", value);
+    check(m_lngDecoded == (long)(int)value, "command value decoded by the command port", value);
+}
+
+// Reply encoder -> propeller reply validation and decoder (the same format the propeller replies in)
+static void check_reply(long *values, int count) {
+    char packet[REPLYVALUESMAX * 5 + 4];
+    int n = m_objNetwork.intBuildReplyPacket(packet, values, count);
+    
+    check(n == count * 5 + 3 && (int)strlen(packet) == n, "reply packet length", values[0]);
+    
+    // Longer replies would overflow the propeller's packet buffer, only the values are checked for those
+    if (n < PROPELLER_BUFFER) {
+        strcpy(m_objPropeller.m_strReply, packet);
+        check(m_objPropeller.intValidatePacket(m_objPropeller.m_strReply) > 0, "reply packet validates", values[0]);
+    }
+    
+    for (int v=0; v<count; v++) {
+        m_objPropeller.m_strReply[0] = 2;
+        memcpy(&m_objPropeller.m_strReply[1], &packet[1 + v * 5], 5);
+        m_objPropeller.m_strReply[6] = 0;
+        check(m_objPropeller.lngDecodeBase128ValueInReply() == (long)(int)values[v], "reply value decoded", values[v]);
+    }
+}
+
+// A single bit error anywhere in the value or checksum must be caught
+static void check_corruption(long value) {
+    char packet[12], copy[12];
+    int n = m_objPropeller.intBuildPacket(packet, 8, 1, value);
+    packet[n - 2] ^= packet[1] ^ 11;
+    packet[1] = 11;
+    
+    for (int i=3; i<n-1; i++) {
+        for (int bit=0; bit<7; bit++) {
+            memcpy(copy, packet, sizeof(copy));
+            copy[i] ^= 1 << bit;
+            if (copy[i] == 0 || copy[i] == 2 || copy[i] == 3) { continue; }
+            check(m_objNetwork.intValidatePacket(copy) <= 0, "corrupted command rejected", value);
+        }
+    }
+}
+
+static void run_checks() {
+    const long edges[] = { 0, 1, -1, 2, -2, 127, 128, -127, -128, 16383, 16384, -16384, 0x7F7F7F7F, 0x1FFFFF,
+                           -0x200000, INT_MAX, INT_MIN, INT_MAX - 1, INT_MIN + 1, 100, -100, 500000, -500000 };
+    long values[REPLYVALUESMAX];
+    
+    for (size_t i=0; i<sizeof(edges) / sizeof(edges[0]); i++) {
+        check_command(edges[i]);
+        check_reply((long *)&edges[i], 1);
+        if (edges[i] != 0) { check_corruption(edges[i]); }
+    }
+    for (int i=0; i<20000; i++) {
+        long value = (long)(int)random32();
+        check_command(value);
+        check_reply(&value, 1);
+    }
+    for (int count=1; count<=REPLYVALUESMAX; count*=2) {
+        for (int v=0; v<count; v++) { values[v] = (long)(int)random32(); }
+        check_reply(values, count);
+    }
+    
+    fprintf(m_fileOut, "round trip checks: %d, failures: %d\n\n", m_intChecks, m_intFailures);
+}
+
+// ===========================================================================================================================================================================================
+// BENCHMARKS
+// ===========================================================================================================================================================================================
+
+// Run the case until MIN_RUN_NS has passed, doubling the batch size each time
+#define BENCH(name, bytes, body) do { \
+    unsigned long long _iterations = 0, _batch = 64, _start = now_ns(), _cycles = cycles(), _elapsed; \
+    do { \
+        for (unsigned long long _i=0; _i<_batch; _i++) { body; } \
+        _iterations += _batch; \
+        _batch *= 2; \
+        _elapsed = now_ns() - _start; \
+    } while (_elapsed < MIN_RUN_NS); \
+    report(name, bytes, _iterations, _elapsed, cycles() - _cycles); \
+} while (0)
+
+static void report(const char *name, int bytes, unsigned long long iterations, unsigned long long ns, unsigned long long cyc) {
+    double nsPerOp = (double)ns / iterations;
+    if (cyc > 0) {
+        fprintf(m_fileOut, "%-52s %6d %10.1f %10.1f %10.3f\n", name, bytes, nsPerOp, (double)cyc / iterations, (double)bytes * iterations / cyc);
+    } else {
+        fprintf(m_fileOut, "%-52s %6d %10.1f %10s %10s\n", name, bytes, nsPerOp, "-", "-");
+    }
+}
+
+static volatile long m_lngSink;
+
+// Build a command port packet of node 1 carrying intValues values, with lead-in bytes before it
+static int command_packet(char *buffer, int intLeadIn, int intLeadChar, int intValues, int intCorrupt) {
+    int n = 0, checksum = 0;
+    
+    if (intLeadChar) {
+        memset(buffer, intLeadChar, intLeadIn);
+    } else {
+        noise(buffer, intLeadIn);
+    }
+    n = intLeadIn;
+    int start = n;
+    buffer[n++] = 2;
+    buffer[n++] = 11;
+    buffer[n++] = 28;
+    for (int v=0; v<intValues * 5; v++) { buffer[n++] = 32 + random32() % 128; }
+    for (int i=start+1; i<n; i++) { checksum ^= (unsigned char)buffer[i]; }
+    buffer[n++] = (checksum | 0x80) ^ (intCorrupt ? 1 : 0);
+    buffer[n++] = 3;
+    buffer[n] = 0;
+    return n;
+}
+
+static void run_benchmarks() {
+    char packet[REPLYVALUESMAX * 5 + 4], buffer[COMMAND_BUFFER * 2];
+    long values[REPLYVALUESMAX];
+    int n;
+    
+    fprintf(m_fileOut, "%-52s %6s %10s %10s %10s\n", "case", "bytes", "ns/op", "cycles/op", "bytes/cyc");
+    
+    // Encoders
+    const long commandValues[] = { 0, 1000, -1000, INT_MIN };
+    const char *commandNames[] = { "command encode, no value", "command encode, small value", "command encode, negative value", "command encode, INT_MIN" };
+    for (int i=0; i<4; i++) {
+        n = m_objPropeller.intBuildPacket(packet, 8, 1, commandValues[i]);
+        BENCH(commandNames[i], n, m_lngSink += m_objPropeller.intBuildPacket(packet, 8, 1, commandValues[i]));
+    }
+    for (int count=1; count<=REPLYVALUESMAX; count*=4) {
+        char name[64];
+        for (int v=0; v<count; v++) { values[v] = (long)(int)random32(); }
+        n = m_objNetwork.intBuildReplyPacket(packet, values, count);
+        snprintf(name, sizeof(name), "reply encode, %d value(s)", count);
+        BENCH(name, n, m_lngSink += m_objNetwork.intBuildReplyPacket(packet, values, count));
+    }
+    
+    // Checksum alone, the loop shared by the encoders and validators
+    for (int size=8; size<=512; size*=8) {
+        char name[64];
+        noise(packet, size);
+        snprintf(name, sizeof(name), "xor checksum, %d bytes", size);
+        BENCH(name, size, {
+            char intChecksum = 0;
+            for (int i=1; i<size; i++) { intChecksum ^= (int)(packet[i]); }
+            m_lngSink += intChecksum | 0x80;
+        });
+    }
+    
+    // Decoders
+    values[0] = -123456789;
+    m_objNetwork.intBuildReplyPacket(m_objPropeller.m_strReply, values, 1);
+    BENCH("propeller reply decode", 5, m_lngSink += m_objPropeller.lngDecodeBase128ValueInReply());
+    
+    // Validation on the command port, across sizes and noise
+    struct { const char *name; int leadIn; int leadChar; int values; int corrupt; } cases[] = {
+        { "command validate, clean, no value", 0, 0, 0, 0 },
+        { "command validate, clean, 1 value", 0, 0, 1, 0 },
+        { "command validate, clean, 8 values", 0, 0, 8, 0 },
+        { "command validate, 20 noise bytes, 1 value", 20, 0, 1, 0 },
+        { "command validate, bad checksum, 1 value", 0, 0, 1, 1 },
+        { "command validate, 38 stray STX, 1 value", 38, 2, 1, 0 },
+        { "command validate, 38 stray ETX, 1 value", 38, 3, 1, 0 },
+        { "command validate, 43 stray STX, no value", 43, 2, 0, 0 },
+    };
+    for (size_t c=0; c<sizeof(cases) / sizeof(cases[0]); c++) {
+        n = command_packet(buffer, cases[c].leadIn, cases[c].leadChar, cases[c].values, cases[c].corrupt);
+        if (n >= COMMAND_BUFFER) { continue; }
+        BENCH(cases[c].name, n, m_lngSink += m_objNetwork.intValidatePacket(buffer));
+    }
+    
+    // No ETX at all, the framer scans the whole buffer
+    memset(buffer, 2, COMMAND_BUFFER - 1);
+    buffer[COMMAND_BUFFER - 1] = 0;
+    BENCH("command validate, 49 STX and no ETX", COMMAND_BUFFER - 1, m_lngSink += m_objNetwork.intValidatePacket(buffer));
+    
+    // Propeller reply validation
+    values[0] = 42;
+    n = m_objNetwork.intBuildReplyPacket(packet, values, 1);
+    BENCH("propeller reply validate, value", n, m_lngSink += m_objPropeller.intValidatePacket(packet));
+    strcpy(packet, "\002" "1" "\261" "\003");
+    BENCH("propeller reply validate, flag", 4, m_lngSink += m_objPropeller.intValidatePacket(packet));
+    
+    // The whole command port path: append, validate, dispatch and decode the value
+    m_intDecodeInCallback = 1;
+    n = command_packet(buffer, 0, 0, 1, 0);
+    BENCH("command port parse + decode, 1 value", n, {
+        memcpy(m_objNetwork.m_strCommsInputTemp, buffer, n + 1);
+        m_objNetwork.intParseTelnetData();
+    });
+    n = command_packet(buffer, 30, 2, 1, 0);
+    BENCH("command port parse + decode, 30 stray STX", n, {
+        memcpy(m_objNetwork.m_strCommsInputTemp, buffer, n + 1);
+        m_objNetwork.intParseTelnetData();
+    });
+}
+
+int main(int argc, char **argv) {
+    m_fileOut = fdopen(dup(1), "w");
+    setvbuf(m_fileOut, NULL, _IOLBF, 0);
+    freopen("/dev/null", "w", stdout);
+    
+    m_objNetworkInterface = &m_objNetwork;
+    m_objPropellerInterface = &m_objPropeller;
+    
+    run_checks();
+    if (argc < 2 || strcmp(argv[1], "-c") != 0) { run_benchmarks(); }
+    
+    return m_intFailures > 0;
+}
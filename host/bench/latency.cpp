@@ -0,0 +1,399 @@
+/* End to end command latency benchmark for the command port (TCP 23).
+ *
+ * Sends framed propeller commands (node 1) over one or more connections, closed loop or at a fixed
+ * total rate, and reports latency percentiles and throughput per command. With -s each command is
+ * followed by a timing query (node 3, command 237) and the firmware's stage stamps are reported too.
+ * Works against the host build (build/bod with the simulated propeller) or a real board.
+ *
+ *   build/bench-latency -H 192.168.7.2 -c 4 -r 400 -d 10 -m "GetLogicalPosition*4,IsAxisBusy,SetDriveSpeed/1000" -s
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <algorithm>
+#include <vector>
+
+#define MAX_MIX 16
+#define MAX_CONNECTIONS 64
+#define STAGES 5
+#define TIMING_COMMAND 237
+
+struct CommandName { const char *name; int code; };
+
+// Propeller commands, as listed in main.cpp
+static const CommandName m_arrCommandNames[] = {
+    { "HomeAxis", 4 }, { "MoveABS", 8 }, { "MoveINC", 12 }, { "StopAxis", 16 }, { "IsAxisBusy", 20 },
+    { "GetEncoderPosition", 24 }, { "GetLogicalPosition", 28 }, { "SetStartSpeed", 32 }, { "SetDriveSpeed", 36 },
+    { "SetHomeSpeed", 40 }, { "SetAccelerationRate", 44 }, { "SetMotorDirection", 48 }, { "SetEncoderDirection", 52 },
+    { "GetInitialSpeed", 56 }, { "GetDriveSpeed", 60 }, { "GetHomeSpeed", 64 }, { "GetAccelerationRate", 68 },
+    { "GetMotorDirection", 72 }, { "GetEncoderDirection", 76 }, { "SetEncoderPosition", 80 }, { "SetLogicalPosition", 84 },
+    { "LineMoveABS", 88 }, { "LineMoveINC", 92 }, { "QueryHomeInput", 96 }, { "QueryHomeStatus", 100 },
+    { "SwitchAuxOutput", 104 }, { "SetHomeTimeout", 108 }, { "SetHomeOffsetSpeed", 112 },
+    { "SetHomeChangeDirectionDelay", 116 }, { "ToggleEnableLine", 120 }, { "GetESTOPState", 200 },
+    { "ClearESTOPState", 204 }, { "QueryResetFlag", 208 }, { "ClearResetFlag", 212 }, { "GetVersionInfo", 216 },
+    { "MoveContinuous", 220 }, { "SlowStop", 224 }
+};
+#define COMMAND_NAMES (sizeof(m_arrCommandNames) / sizeof(m_arrCommandNames[0]))
+
+static const char *m_arrStageNames[STAGES] = { "network receive", "framing", "dispatch", "bus transaction", "reply transmit" };
+
+struct MixEntry {
+    int             code;
+    long            value;
+    int             weight;
+    char            name[80];
+};
+
+struct Results {
+    std::vector<unsigned int> latency[MAX_MIX];             // Microseconds, successful requests only
+    std::vector<unsigned int> stages[MAX_MIX][STAGES];
+    unsigned int    errors[MAX_MIX];
+    unsigned int    timeouts[MAX_MIX];
+    unsigned int    stageMisses;                            // Timing replies that belonged to another command
+};
+
+// Settings
+static const char *m_strHost = "192.168.7.2";
+static const char *m_strPort = "23";
+static int m_intConnections = 1;
+static double m_dblRate = 0;
+static long m_lngCount = 1000;
+static double m_dblDuration = 0;
+static int m_intAxis = 1;
+static int m_intStages = 0;
+static int m_intTimeoutMs = 2000;
+static MixEntry m_arrMix[MAX_MIX];
+static int m_intMixCount = 0;
+static int m_intMixWeight = 0;
+
+static unsigned long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(unsigned long long t) {
+    unsigned long long n = now_us();
+    if (t > n) {
+        struct timespec ts = { (time_t)((t - n) / 1000000), (long)((t - n) % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+// STX, node + 10, command, [5 character base 128 value], checksum, ETX. A zero value is not sent, as in lngSendCommand.
+static int build_packet(unsigned char *packet, int node, int command, long value) {
+    int n = 0, checksum = 0;
+    packet[n++] = 2;
+    packet[n++] = node + 10;
+    packet[n++] = command;
+    if (value != 0) {
+        for (int shift=28; shift>=0; shift-=7) { packet[n++] = ((value >> shift) & 0x7F) + 32; }
+    }
+    for (int i=1; i<n; i++) { checksum ^= packet[i]; }
+    packet[n++] = checksum | 0x80;
+    packet[n++] = 3;
+    return n;
+}
+
+// Read one reply up to its ETX, returns its length, 0 on timeout, -1 if the connection failed
+static int read_reply(int fd, unsigned char *reply, int size, int timeoutMs) {
+    int n = 0;
+    unsigned long long deadline = now_us() + (unsigned long long)timeoutMs * 1000;
+    
+    while (n < size) {
+        long long remaining = (long long)(deadline - now_us());
+        if (remaining <= 0) { return 0; }
+        
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)(remaining / 1000) + 1) <= 0) { continue; }
+        int r = recv(fd, &reply[n], 1, 0);
+        if (r <= 0) { return -1; }
+        if (n == 0 && reply[0] != 2) { continue; }
+        if (reply[n++] == 3) { return n; }
+    }
+    return -1;
+}
+
+static int valid_reply(const unsigned char *reply, int length) {
+    int checksum = 0;
+    if (length < 4 || reply[0] != 2 || reply[length - 1] != 3) { return 0; }
+    for (int i=1; i<length-2; i++) { checksum ^= reply[i]; }
+    return (checksum | 0x80) == reply[length - 2];
+}
+
+static long decode_value(const unsigned char *data) {
+    unsigned long value = 0;
+    for (int i=0; i<5; i++) { value = value * 128 + (data[i] - 32); }
+    return (long)(int)(unsigned int)value;
+}
+
+// Discard anything left over from a request that timed out
+static void drain(int fd) {
+    unsigned char buffer[256];
+    while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0) {}
+}
+
+static int open_connection() {
+    struct addrinfo hints, *addresses;
+    int fd = -1, one = 1;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(m_strHost, m_strPort, &hints, &addresses) != 0) { return -1; }
+    
+    fd = socket(addresses->ai_family, addresses->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0) { setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); }
+    return fd;
+}
+
+struct Worker {
+    pthread_t       thread;
+    int             index;
+    int             fd;
+    unsigned long long start;
+    Results         results;
+};
+
+static int choose_command(unsigned int *seed) {
+    int r = rand_r(seed) % m_intMixWeight;
+    for (int i=0; i<m_intMixCount; i++) {
+        r -= m_arrMix[i].weight;
+        if (r < 0) { return i; }
+    }
+    return 0;
+}
+
+static void *run_worker(void *arg) {
+    Worker *worker = (Worker *)arg;
+    Results *results = &worker->results;
+    unsigned char packet[16], reply[600];
+    unsigned int seed = 12345 + worker->index;
+    long lastSequence = -1;
+    double interval = (m_dblRate > 0) ? 1000000.0 * m_intConnections / m_dblRate : 0;
+    unsigned long long end = worker->start + (unsigned long long)(m_dblDuration * 1000000);
+    
+    // Spread the connections over the interval so the total rate is even
+    unsigned long long scheduled = worker->start + (unsigned long long)(interval * worker->index / m_intConnections);
+    
+    for (long i=0; m_dblDuration > 0 || i<m_lngCount; i++) {
+        int m = choose_command(&seed);
+        int n = build_packet(packet, 1, m_arrMix[m].code + (m_intAxis - 1), m_arrMix[m].value);
+        
+        // At a fixed rate latency is measured from the scheduled time, so a stall also counts against the requests queued behind it
+        if (interval > 0) {
+            sleep_until(scheduled);
+        } else {
+            scheduled = now_us();
+        }
+        if (m_dblDuration > 0 && scheduled >= end) { break; }
+        
+        if (send(worker->fd, packet, n, 0) != n) { results->errors[m]++; break; }
+        int length = read_reply(worker->fd, reply, sizeof(reply), m_intTimeoutMs);
+        unsigned long long done = now_us();
+        
+        if (length < 0) { results->errors[m]++; break; }
+        if (length == 0) {
+            results->timeouts[m]++;
+            drain(worker->fd);
+        } else if (!valid_reply(reply, length)) {
+            results->errors[m]++;
+        } else {
+            results->latency[m].push_back((unsigned int)(done - scheduled));
+        }
+        
+        // The firmware keeps the stamps of the last propeller command, which with several connections may not be ours
+        if (m_intStages && length > 0) {
+            n = build_packet(packet, 3, TIMING_COMMAND, 0);
+            if (send(worker->fd, packet, n, 0) != n) { break; }
+            length = read_reply(worker->fd, reply, sizeof(reply), m_intTimeoutMs);
+            if (length == 3 + 5 * (2 + STAGES) && valid_reply(reply, length)) {
+                long sequence = decode_value(&reply[1]);
+                long command = decode_value(&reply[6]);
+                if (command == m_arrMix[m].code + (m_intAxis - 1) && sequence != lastSequence) {
+                    for (int s=0; s<STAGES; s++) { results->stages[m][s].push_back((unsigned int)decode_value(&reply[11 + s * 5])); }
+                } else {
+                    results->stageMisses++;
+                }
+                lastSequence = sequence;
+            } else {
+                drain(worker->fd);
+            }
+        }
+        
+        scheduled += (unsigned long long)interval;
+    }
+    return NULL;
+}
+
+static unsigned int percentile(std::vector<unsigned int> &values, double p) {
+    if (values.empty()) { return 0; }
+    size_t i = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[i];
+}
+
+static void print_row(const char *name, std::vector<unsigned int> &values, unsigned int errors, unsigned int timeouts, double seconds) {
+    std::sort(values.begin(), values.end());
+    printf("%-28s %8u %6u %6u %9u %9u %9u %9u %9.1f\n", name, (unsigned int)values.size(), errors, timeouts,
+           percentile(values, 50), percentile(values, 99), percentile(values, 99.9),
+           values.empty() ? 0 : values.back(), values.size() / seconds);
+}
+
+// "name-or-code[/value][*weight],..."
+static int parse_mix(const char *mix) {
+    char entry[64];
+    
+    while (*mix && m_intMixCount < MAX_MIX) {
+        size_t length = strcspn(mix, ",");
+        if (length >= sizeof(entry)) { return 0; }
+        memcpy(entry, mix, length);
+        entry[length] = 0;
+        mix += length + (mix[length] == ',');
+        
+        MixEntry *e = &m_arrMix[m_intMixCount];
+        char *weight = strchr(entry, '*');
+        char *value = strchr(entry, '/');
+        e->weight = weight ? atoi(weight + 1) : 1;
+        e->value = value ? atol(value + 1) : 0;
+        if (weight) { *weight = 0; }
+        if (value) { *value = 0; }
+        
+        e->code = -1;
+        for (size_t i=0; i<COMMAND_NAMES; i++) {
+            if (strcmp(entry, m_arrCommandNames[i].name) == 0) { e->code = m_arrCommandNames[i].code; }
+        }
+        if (e->code < 0) { e->code = atoi(entry); }
+        if (e->code <= 3 || e->code > 255 || e->weight <= 0) { return 0; }
+        
+        snprintf(e->name, sizeof(e->name), "%s", entry);
+        for (size_t i=0; i<COMMAND_NAMES; i++) {
+            if (e->code == m_arrCommandNames[i].code) { snprintf(e->name, sizeof(e->name), "%s", m_arrCommandNames[i].name); }
+        }
+        if (e->value != 0) {
+            size_t used = strlen(e->name);
+            snprintf(e->name + used, sizeof(e->name) - used, "/%ld", e->value);
+        }
+        
+        m_intMixWeight += e->weight;
+        m_intMixCount++;
+    }
+    return m_intMixCount > 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: bench-latency [options]\n"
+        "  -H host      firmware address (default $BOD_HOST or 192.168.7.2)\n"
+        "  -P port      command port (23)\n"
+        "  -c n         concurrent connections (1, the firmware accepts up to 4)\n"
+        "  -r rate      total requests per second, 0 for closed loop (0)\n"
+        "  -n count     requests per connection (1000)\n"
+        "  -d seconds   run for a time instead of a count\n"
+        "  -m mix       command mix, name or code with optional /value and *weight (GetLogicalPosition)\n"
+        "  -a axis      axis 1-4 (1)\n"
+        "  -s           query the firmware stage timing after each request\n"
+        "  -t ms        reply timeout (2000)\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static Worker workers[MAX_CONNECTIONS];
+    const char *mix = "GetLogicalPosition";
+    int opt;
+    
+    if (getenv("BOD_HOST") != NULL) { m_strHost = getenv("BOD_HOST"); }
+    while ((opt = getopt(argc, argv, "H:P:c:r:n:d:m:a:st:")) != -1) {
+        switch (opt) {
+            case 'H': m_strHost = optarg; break;
+            case 'P': m_strPort = optarg; break;
+            case 'c': m_intConnections = atoi(optarg); break;
+            case 'r': m_dblRate = atof(optarg); break;
+            case 'n': m_lngCount = atol(optarg); break;
+            case 'd': m_dblDuration = atof(optarg); break;
+            case 'm': mix = optarg; break;
+            case 'a': m_intAxis = atoi(optarg); break;
+            case 's': m_intStages = 1; break;
+            case 't': m_intTimeoutMs = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (m_intConnections < 1 || m_intConnections > MAX_CONNECTIONS || m_intAxis < 1 || m_intAxis > 4 || !parse_mix(mix)) { usage(); }
+    
+    for (int i=0; i<m_intConnections; i++) {
+        workers[i].index = i;
+        workers[i].fd = open_connection();
+        if (workers[i].fd < 0) {
+            fprintf(stderr, "bench-latency: cannot connect to %s:%s (%s)\n", m_strHost, m_strPort, strerror(errno));
+            return 1;
+        }
+    }
+    
+    unsigned long long start = now_us();
+    for (int i=0; i<m_intConnections; i++) {
+        workers[i].start = start;
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    for (int i=0; i<m_intConnections; i++) {
+        pthread_join(workers[i].thread, NULL);
+        close(workers[i].fd);
+    }
+    double seconds = (now_us() - start) / 1000000.0;
+    
+    // Merge the per connection results
+    Results total;
+    std::vector<unsigned int> all;
+    unsigned int allErrors = 0, allTimeouts = 0;
+    total.stageMisses = 0;
+    for (int m=0; m<m_intMixCount; m++) {
+        total.errors[m] = total.timeouts[m] = 0;
+        for (int i=0; i<m_intConnections; i++) {
+            Results *r = &workers[i].results;
+            total.latency[m].insert(total.latency[m].end(), r->latency[m].begin(), r->latency[m].end());
+            for (int s=0; s<STAGES; s++) { total.stages[m][s].insert(total.stages[m][s].end(), r->stages[m][s].begin(), r->stages[m][s].end()); }
+            total.errors[m] += r->errors[m];
+            total.timeouts[m] += r->timeouts[m];
+            if (m == 0) { total.stageMisses += r->stageMisses; }
+        }
+        all.insert(all.end(), total.latency[m].begin(), total.latency[m].end());
+        allErrors += total.errors[m];
+        allTimeouts += total.timeouts[m];
+    }
+    
+    printf("%s:%s, %d connection(s), %s, %.1f s\n\n", m_strHost, m_strPort, m_intConnections, m_dblRate > 0 ? "fixed rate" : "closed loop", seconds);
+    printf("%-28s %8s %6s %6s %9s %9s %9s %9s %9s\n", "command", "count", "errors", "t/outs", "p50(us)", "p99(us)", "p99.9(us)", "max(us)", "req/s");
+    for (int m=0; m<m_intMixCount; m++) {
+        print_row(m_arrMix[m].name, total.latency[m], total.errors[m], total.timeouts[m], seconds);
+    }
+    print_row("all", all, allErrors, allTimeouts, seconds);
+    
+    if (m_intStages) {
+        printf("\n%-28s %8s %6s %6s %9s %9s %9s %9s\n", "stage", "samples", "", "", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+        for (int m=0; m<m_intMixCount; m++) {
+            printf("%s\n", m_arrMix[m].name);
+            for (int s=0; s<STAGES; s++) {
+                std::vector<unsigned int> &values = total.stages[m][s];
+                std::sort(values.begin(), values.end());
+                printf("  %-26s %8u %6s %6s %9u %9u %9u %9u\n", m_arrStageNames[s], (unsigned int)values.size(), "", "",
+                       percentile(values, 50), percentile(values, 99), percentile(values, 99.9), values.empty() ? 0 : values.back());
+            }
+        }
+        if (total.stageMisses > 0) { printf("(%u timing samples belonged to another connection's command)\n", total.stageMisses); }
+    }
+    
+    return allErrors + allTimeouts > 0;
+}
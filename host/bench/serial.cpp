@@ -0,0 +1,301 @@
+/* Serial bridge throughput and loss benchmark for the bridge ports (TCP 10001-10003).
+ *
+ * Each port's serial line must be looped back: BOD_SERIAL_LOOPBACK=all on the host build, or a
+ * loopback plug on a board. Data sent to a bridge port goes out of the UART, comes straight back
+ * in and returns on the same connection, so one stream exercises both bridge directions.
+ *
+ * The stream is 8 byte records (sequence number and its complement), which lets the receiver
+ * resynchronise after a loss and timestamp every record. Bursts are sent while the bytes in flight
+ * stay within the window.
+ *
+ * CPU time per byte comes from the firmware's own bridge busy time in the statistics blob, as the
+ * main loop never sleeps and process CPU time is the wall time.
+ *
+ *   BOD_SERIAL_LOOPBACK=all BOD_SERIAL_BAUD=115200 BOD_TAP=bod0 build/bod &
+ *   build/bench-serial -p 1,2,3 -b 115200 -B 32 -w 256 -d 10
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <algorithm>
+#include <vector>
+
+#define RECORD_SIZE 8
+#define RECORD_CHECK 0xA5C3E1F0u
+#define MAX_PORTS 3
+#define STATISTICS_PORT "10010"
+#define STATISTICS_VALUES 96
+#define STATISTICS_SERIAL 51        // First serial counter in the statistics blob (see clsStatistics.cpp)
+#define STATISTICS_RESERVATIONS 64  // Serial 1 transmit reservation failures
+#define STATISTICS_BRIDGE_TIME 75   // Serial 1 to TCP busy time, then the other ports and TCP to serial
+
+struct Port {
+    pthread_t       thread;
+    int             number;
+    int             fd;
+    unsigned long long sentRecords;
+    unsigned long long receivedRecords;
+    unsigned long long lostRecords;
+    unsigned long long garbageBytes;     // Bytes that were not part of a valid record
+    unsigned int    stalls;              // Times the window was given up on as nothing came back
+    std::vector<unsigned long long> sendTime;
+    std::vector<unsigned int> latency;   // Microseconds from send to receipt, one per record
+};
+
+// Settings
+static const char *m_strHost = "192.168.7.2";
+static int m_arrPortNumbers[MAX_PORTS] = { 1 };
+static int m_intPortCount = 1;
+static int m_intBaud = 0;
+static int m_intBurst = 32;
+static int m_intWindow = 256;
+static double m_dblDuration = 5;
+static double m_dblRate = 0;
+static int m_intStallMs = 500;
+
+static unsigned long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static void put_u32(unsigned char *p, unsigned int v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static unsigned int get_u32(const unsigned char *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static int open_connection(const char *port, int type) {
+    struct addrinfo hints, *addresses;
+    int fd = -1, one = 1;
+    
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = type;
+    if (getaddrinfo(m_strHost, port, &hints, &addresses) != 0) { return -1; }
+    
+    fd = socket(addresses->ai_family, addresses->ai_socktype, 0);
+    if (fd >= 0 && type == SOCK_STREAM) {
+        // The socket buffers are sized to the window so the kernel does not hide it
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &m_intWindow, sizeof(m_intWindow));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &m_intWindow, sizeof(m_intWindow));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    if (fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Parse whole records out of the receive buffer, returns the number of bytes consumed
+static int parse_records(Port *port, const unsigned char *data, int length, unsigned long long t) {
+    int i = 0;
+    
+    while (length - i >= RECORD_SIZE) {
+        unsigned int sequence = get_u32(&data[i]);
+        if ((get_u32(&data[i + 4]) ^ RECORD_CHECK) != sequence || sequence < port->receivedRecords + port->lostRecords
+            || sequence >= port->sentRecords) {
+            // Not aligned on a record, a partial record was lost
+            port->garbageBytes++;
+            i++;
+            continue;
+        }
+        
+        port->lostRecords += sequence - (port->receivedRecords + port->lostRecords);
+        port->receivedRecords++;
+        port->latency.push_back((unsigned int)(t - port->sendTime[sequence]));
+        i += RECORD_SIZE;
+    }
+    return i;
+}
+
+static void *run_port(void *arg) {
+    Port *port = (Port *)arg;
+    unsigned char burst[4096], buffer[4096];
+    int buffered = 0;
+    int records = std::max(1, m_intBurst / RECORD_SIZE);
+    unsigned long long start = now_us(), end = start + (unsigned long long)(m_dblDuration * 1000000);
+    unsigned long long lastProgress = start, stallBase = 0;
+    double credit = 0;
+    
+    while (1) {
+        unsigned long long t = now_us();
+        unsigned long long accounted = std::max(port->receivedRecords + port->lostRecords, stallBase);
+        int sending = t < end;
+        
+        // Nothing has come back for a while, the bytes in flight were lost somewhere
+        if (port->sentRecords > accounted && t - lastProgress > (unsigned long long)m_intStallMs * 1000) {
+            if (!sending) { break; }
+            port->stalls++;
+            stallBase = port->sentRecords;
+            lastProgress = t;
+            continue;
+        }
+        if (!sending && port->sentRecords == accounted) { break; }
+        
+        // Optional rate limit, in bytes per second
+        if (m_dblRate > 0) {
+            credit = std::min((double)m_intWindow, credit + m_dblRate * (t - start) / 1000000.0);
+            start = t;
+        }
+        
+        if (sending && (port->sentRecords - accounted + records) * RECORD_SIZE <= (unsigned long long)m_intWindow
+            && (m_dblRate <= 0 || credit >= records * RECORD_SIZE)) {
+            for (int r=0; r<records; r++) {
+                put_u32(&burst[r * RECORD_SIZE], (unsigned int)(port->sentRecords + r));
+                put_u32(&burst[r * RECORD_SIZE + 4], (unsigned int)(port->sentRecords + r) ^ RECORD_CHECK);
+                port->sendTime.push_back(t);
+            }
+            if (send(port->fd, burst, records * RECORD_SIZE, 0) != records * RECORD_SIZE) { break; }
+            port->sentRecords += records;
+            credit -= records * RECORD_SIZE;
+            if (port->sentRecords == (unsigned long long)records) { lastProgress = t; }
+            continue;
+        }
+        
+        struct pollfd pfd = { port->fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 1) <= 0) { continue; }
+        int n = recv(port->fd, &buffer[buffered], sizeof(buffer) - buffered, 0);
+        if (n <= 0) { break; }
+        buffered += n;
+        lastProgress = now_us();
+        
+        int used = parse_records(port, buffer, buffered, lastProgress);
+        memmove(buffer, &buffer[used], buffered - used);
+        buffered -= used;
+    }
+    
+    port->lostRecords = port->sentRecords - port->receivedRecords;
+    return NULL;
+}
+
+// Firmware counters from the UDP statistics query, returns 0 if there was no answer
+static int read_statistics(unsigned int *values) {
+    unsigned char reply[STATISTICS_VALUES * 4];
+    int fd = open_connection(STATISTICS_PORT, SOCK_DGRAM), n = 0;
+    
+    if (fd < 0) { return 0; }
+    if (send(fd, "s", 1, 0) == 1) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 500) > 0) { n = recv(fd, reply, sizeof(reply), 0); }
+    }
+    close(fd);
+    
+    if (n < (STATISTICS_BRIDGE_TIME + 6) * 4) { return 0; }
+    for (int i=0; i<n / 4; i++) { values[i] = get_u32(&reply[i * 4]); }
+    return 1;
+}
+
+static unsigned int percentile(std::vector<unsigned int> &values, double p) {
+    if (values.empty()) { return 0; }
+    return values[(size_t)(p / 100.0 * (values.size() - 1) + 0.5)];
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: bench-serial [options]\n"
+        "  -H host      firmware address (default $BOD_HOST or 192.168.7.2)\n"
+        "  -p ports     bridge ports to drive, 1-3 (1)\n"
+        "  -b baud      line rate, to report utilisation (must match the firmware)\n"
+        "  -B bytes     burst size per send (32)\n"
+        "  -w bytes     window: most bytes in flight per port, also the socket buffer sizes (256)\n"
+        "  -r rate      bytes per second per port, 0 for as fast as the window allows (0)\n"
+        "  -d seconds   duration (5)\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static Port ports[MAX_PORTS];
+    unsigned int before[STATISTICS_VALUES], after[STATISTICS_VALUES];
+    int opt;
+    
+    if (getenv("BOD_HOST") != NULL) { m_strHost = getenv("BOD_HOST"); }
+    while ((opt = getopt(argc, argv, "H:p:b:B:w:r:d:")) != -1) {
+        switch (opt) {
+            case 'H': m_strHost = optarg; break;
+            case 'p':
+                m_intPortCount = 0;
+                for (const char *p = optarg; *p && m_intPortCount < MAX_PORTS; p++) {
+                    if (*p >= '1' && *p <= '3') { m_arrPortNumbers[m_intPortCount++] = *p - '0'; }
+                }
+                break;
+            case 'b': m_intBaud = atoi(optarg); break;
+            case 'B': m_intBurst = atoi(optarg); break;
+            case 'w': m_intWindow = atoi(optarg); break;
+            case 'r': m_dblRate = atof(optarg); break;
+            case 'd': m_dblDuration = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (m_intPortCount == 0 || m_intBurst < RECORD_SIZE || m_intBurst > 4096 || m_intWindow < m_intBurst) { usage(); }
+    
+    for (int i=0; i<m_intPortCount; i++) {
+        char service[16];
+        snprintf(service, sizeof(service), "%d", 10000 + m_arrPortNumbers[i]);
+        ports[i].number = m_arrPortNumbers[i];
+        ports[i].fd = open_connection(service, SOCK_STREAM);
+        if (ports[i].fd < 0) {
+            fprintf(stderr, "bench-serial: cannot connect to %s:%s (%s)\n", m_strHost, service, strerror(errno));
+            return 1;
+        }
+    }
+    
+    int statistics = read_statistics(before);
+    unsigned long long start = now_us();
+    
+    for (int i=0; i<m_intPortCount; i++) { pthread_create(&ports[i].thread, NULL, run_port, &ports[i]); }
+    for (int i=0; i<m_intPortCount; i++) { pthread_join(ports[i].thread, NULL); close(ports[i].fd); }
+    
+    double seconds = (now_us() - start) / 1000000.0;
+    statistics = statistics && read_statistics(after);
+    
+    printf("%s, burst %d, window %d, %.1f s\n\n", m_strHost, m_intBurst, m_intWindow, seconds);
+    printf("%-5s %10s %10s %8s %8s %6s %10s %6s %9s %9s %9s %9s\n", "port", "sent(B)", "echoed(B)", "lost(B)", "junk(B)", "stalls",
+           "B/s", "util%", "p50(us)", "p99(us)", "p99.9(us)", "max(us)");
+    
+    for (int i=0; i<m_intPortCount; i++) {
+        Port *port = &ports[i];
+        unsigned long long echoed = port->receivedRecords * RECORD_SIZE;
+        char utilisation[16] = "-";
+        
+        std::sort(port->latency.begin(), port->latency.end());
+        if (m_intBaud > 0) { snprintf(utilisation, sizeof(utilisation), "%.1f", 100.0 * echoed * 10 / seconds / m_intBaud); }
+        printf("%-5d %10llu %10llu %8llu %8llu %6u %10.0f %6s %9u %9u %9u %9u\n", port->number,
+               port->sentRecords * RECORD_SIZE, echoed, port->lostRecords * RECORD_SIZE, port->garbageBytes, port->stalls,
+               echoed / seconds, utilisation, percentile(port->latency, 50), percentile(port->latency, 99),
+               percentile(port->latency, 99.9), port->latency.empty() ? 0 : port->latency.back());
+    }
+    
+    if (statistics) {
+        // serialToTCPBytes[3], serialToTCPDroppedBytes[3], tcpToSerialBytes[3], tcpToSerialOverflows[3], then reservation failures
+        printf("\nfirmware counters over the run\n");
+        printf("%-5s %14s %12s %14s %12s %10s %14s %14s\n", "port", "tcp->serial(B)", "truncations", "serial->tcp(B)", "dropped(B)",
+               "reserve", "tcp->ser us/B", "ser->tcp us/B");
+        for (int i=0; i<m_intPortCount; i++) {
+            int p = ports[i].number - 1;
+            #define DELTA(x) (after[(x)] - before[(x)])
+            unsigned int toSerial = DELTA(STATISTICS_SERIAL + 6 + p), toTCP = DELTA(STATISTICS_SERIAL + p);
+            printf("%-5d %14u %12u %14u %12u %10u %14.2f %14.2f\n", ports[i].number, toSerial, DELTA(STATISTICS_SERIAL + 9 + p),
+                   toTCP, DELTA(STATISTICS_SERIAL + 3 + p), DELTA(STATISTICS_RESERVATIONS + p),
+                   toSerial ? (double)DELTA(STATISTICS_BRIDGE_TIME + 3 + p) / toSerial : 0.0,
+                   toTCP ? (double)DELTA(STATISTICS_BRIDGE_TIME + p) / toTCP : 0.0);
+        }
+        printf("(us/B is firmware busy time per byte, tcp->serial includes waiting on the UART at the line rate)\n");
+    }
+    
+    return 0;
+}
@@ -0,0 +1,132 @@
+/* Host Ethernet: a TAP device or an in-process packet pipe */
+#include "mbed.h"
+#include "host_hal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <pthread.h>
+
+#define HOST_FRAME_SIZE 1536
+#define HOST_PIPE_FRAMES 64
+
+static int m_intTAP = -1;
+static void (*m_fncPipeTransmit)(const char *data, int length);
+
+// Frames injected into the pipe, may be pushed from another thread
+static pthread_mutex_t m_objPipeLock = PTHREAD_MUTEX_INITIALIZER;
+static char m_arrPipeFrames[HOST_PIPE_FRAMES][HOST_FRAME_SIZE];
+static int m_arrPipeLengths[HOST_PIPE_FRAMES];
+static int m_intPipeIn, m_intPipeOut;
+
+// Frame being read and frame being written by the firmware
+static char m_arrRX[HOST_FRAME_SIZE];
+static int m_intRXLength, m_intRXPosition;
+static char m_arrTX[HOST_FRAME_SIZE];
+static int m_intTXLength;
+
+int host_ethernet_open_tap(const char *name) {
+    struct ifreq ifr;
+
+    m_intTAP = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+    if (m_intTAP < 0) { return 0; }
+
+    memset(&ifr, 0, sizeof(ifr));
+    ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if (ioctl(m_intTAP, TUNSETIFF, &ifr) < 0) {
+        close(m_intTAP);
+        m_intTAP = -1;
+        return 0;
+    }
+    return 1;
+}
+
+void host_ethernet_open_pipe(void (*fncTransmit)(const char *data, int length)) {
+    m_fncPipeTransmit = fncTransmit;
+}
+
+// Queue a frame for the firmware, dropped like the EMAC would if the queue is full
+void host_ethernet_inject(const char *data, int length) {
+    if (length > HOST_FRAME_SIZE) { return; }
+
+    pthread_mutex_lock(&m_objPipeLock);
+    if ((m_intPipeIn + 1) % HOST_PIPE_FRAMES != m_intPipeOut) {
+        memcpy(m_arrPipeFrames[m_intPipeIn], data, length);
+        m_arrPipeLengths[m_intPipeIn] = length;
+        m_intPipeIn = (m_intPipeIn + 1) % HOST_PIPE_FRAMES;
+    }
+    pthread_mutex_unlock(&m_objPipeLock);
+}
+
+Ethernet::Ethernet() {
+    const char *strTAP = getenv("BOD_TAP");
+
+    if (m_intTAP < 0 && m_fncPipeTransmit == NULL && strTAP != NULL) {
+        if (!host_ethernet_open_tap(strTAP)) {
+            fprintf(stderr, "Unable to open TAP device %s\n", strTAP);
+        }
+    }
+}
+
+int Ethernet::write(const char *data, int size) {
+    if (size > HOST_FRAME_SIZE - m_intTXLength) { size = HOST_FRAME_SIZE - m_intTXLength; }
+    memcpy(&m_arrTX[m_intTXLength], data, size);
+    m_intTXLength += size;
+    return size;
+}
+
+int Ethernet::send() {
+    int length = m_intTXLength;
+
+    m_intTXLength = 0;
+    if (m_intTAP >= 0) {
+        if (::write(m_intTAP, m_arrTX, length) != length) { return 0; }
+    } else if (m_fncPipeTransmit != NULL) {
+        m_fncPipeTransmit(m_arrTX, length);
+    }
+    return length;
+}
+
+// Make the next received frame current (dropping the previous one), returns its length or 0
+int Ethernet::receive() {
+    int length = 0;
+
+    host_dispatch();
+
+    m_intRXLength = 0;
+    m_intRXPosition = 0;
+    if (m_intTAP >= 0) {
+        length = ::read(m_intTAP, m_arrRX, sizeof(m_arrRX));
+        if (length < 0) { length = 0; }
+    } else {
+        pthread_mutex_lock(&m_objPipeLock);
+        if (m_intPipeOut != m_intPipeIn) {
+            length = m_arrPipeLengths[m_intPipeOut];
+            memcpy(m_arrRX, m_arrPipeFrames[m_intPipeOut], length);
+            m_intPipeOut = (m_intPipeOut + 1) % HOST_PIPE_FRAMES;
+        }
+        pthread_mutex_unlock(&m_objPipeLock);
+    }
+    m_intRXLength = length;
+    return length;
+}
+
+int Ethernet::read(char *data, int size) {
+    if (size > m_intRXLength - m_intRXPosition) { size = m_intRXLength - m_intRXPosition; }
+    memcpy(data, &m_arrRX[m_intRXPosition], size);
+    m_intRXPosition += size;
+    return size;
+}
+
+void Ethernet::address(char *mac) {
+    const char *strMAC = getenv("BOD_MAC");
+    int arrMAC[6] = { 0x00, 0x02, 0xf7, 0xf0, 0x00, 0x01 };
+
+    if (strMAC != NULL) {
+        sscanf(strMAC, "%x:%x:%x:%x:%x:%x", &arrMAC[0], &arrMAC[1], &arrMAC[2], &arrMAC[3], &arrMAC[4], &arrMAC[5]);
+    }
+    for (int i=0; i<6; i++) { mac[i] = (char)arrMAC[i]; }
+}
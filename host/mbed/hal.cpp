@@ -0,0 +1,431 @@
+/* Host implementation of the mbed stand-in: clock, timer events, pins, serial ports and files */
+#include "mbed.h"
+#include "host_hal.h"
+
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+
+#define HOST_WATCHERS 8
+#define HOST_UARTS 4
+
+static int m_arrPins[HOST_PIN_COUNT];
+static int m_arrPinOutput[HOST_PIN_COUNT];     // Direction, as FIODIR
+static host_pin_watcher m_arrPinWatchers[HOST_WATCHERS];
+static void (*m_arrDispatchWatchers[HOST_WATCHERS])(void);
+static int m_intIRQMask;       // Bit per IRQn disabled with NVIC_DisableIRQ
+static int m_intIRQDisabled;   // __disable_irq nesting
+static int m_intDispatching;   // Interrupt handlers never nest
+
+// ===========================================================================================================================================================================================
+// CLOCK AND INTERRUPTS
+// ===========================================================================================================================================================================================
+
+unsigned int host_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned int)((unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+uint32_t SystemCoreClock = 96000000;
+volatile uint32_t host_dwt_demcr;
+volatile uint32_t host_dwt_control;
+
+// Counts only once enabled, like the real counter
+uint32_t host_dwt_cyccnt() {
+    struct timespec ts;
+    if (!(host_dwt_demcr & (1UL << 24)) || !(host_dwt_control & 1)) { return 0; }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec) * (SystemCoreClock / 1000000) / 1000);
+}
+
+// Top of the main thread's stack, which stands in for the initial stack pointer
+unsigned int *host_stack_top() {
+    static unsigned int *top;
+    pthread_attr_t attr;
+    void *addr;
+    size_t size;
+
+    if (top == NULL && pthread_getattr_np(pthread_self(), &attr) == 0) {
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) { top = (unsigned int *)((char *)addr + size); }
+        pthread_attr_destroy(&attr);
+    }
+    return top;
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) { m_intIRQMask &= ~(1 << IRQn); }
+void NVIC_DisableIRQ(IRQn_Type IRQn) { m_intIRQMask |= (1 << IRQn); }
+void __disable_irq(void) { m_intIRQDisabled++; }
+void __enable_irq(void) { if (m_intIRQDisabled > 0) m_intIRQDisabled--; }
+
+void host_dispatch() {
+    if (m_intDispatching || m_intIRQDisabled) { return; }
+    m_intDispatching = 1;
+
+    for (int i=0; i<HOST_WATCHERS; i++) {
+        if (m_arrDispatchWatchers[i] != NULL) { m_arrDispatchWatchers[i](); }
+    }
+    if (!(m_intIRQMask & (1 << TIMER3_IRQn))) { TimerEvent::irq(); }
+    Serial::irq();
+
+    m_intDispatching = 0;
+}
+
+int host_dispatch_watch(void (*fnc)(void)) {
+    for (int i=0; i<HOST_WATCHERS; i++) {
+        if (m_arrDispatchWatchers[i] == NULL) { m_arrDispatchWatchers[i] = fnc; return 1; }
+    }
+    return 0;
+}
+
+void wait_us(int us) {
+    unsigned int start = host_us();
+    host_dispatch();
+    while ((int)(host_us() - start) < us) {
+        host_dispatch();
+    }
+}
+
+void wait_ms(int ms) { wait_us(ms * 1000); }
+void wait(float s) { wait_us((int)(s * 1000000.0f)); }
+
+void error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    exit(1);
+}
+
+// ===========================================================================================================================================================================================
+// TIMER EVENTS (us_ticker on TIMER3 on the LPC1768)
+// ===========================================================================================================================================================================================
+
+TimerEvent *TimerEvent::_head = NULL;
+
+TimerEvent::TimerEvent() : _timestamp(0), _next(NULL) {}
+TimerEvent::~TimerEvent() { remove(); }
+
+unsigned int TimerEvent::timestamp() { return host_us(); }
+
+void TimerEvent::insert(unsigned int timestamp) {
+    _timestamp = timestamp;
+    TimerEvent **p = &_head;
+    while (*p != NULL && (int)((*p)->_timestamp - timestamp) <= 0) { p = &(*p)->_next; }
+    _next = *p;
+    *p = this;
+}
+
+void TimerEvent::remove() {
+    for (TimerEvent **p = &_head; *p != NULL; p = &(*p)->_next) {
+        if (*p == this) { *p = _next; break; }
+    }
+    _next = NULL;
+}
+
+void TimerEvent::irq() {
+    unsigned int now = timestamp();
+    while (_head != NULL && (int)(_head->_timestamp - now) <= 0) {
+        TimerEvent *e = _head;
+        _head = e->_next;
+        e->_next = NULL;
+        e->handler();
+    }
+}
+
+Timer::Timer() : _running(0), _start(0), _time(0) { reset(); }
+
+int Timer::slicetime() {
+    host_dispatch();
+    return _running ? (int)(host_us() - _start) : 0;
+}
+
+void Timer::start() { if (!_running) { _start = host_us(); _running = 1; } }
+void Timer::stop() { _time += slicetime(); _running = 0; }
+void Timer::reset() { _start = host_us(); _time = 0; }
+int Timer::read_us() { return _time + slicetime(); }
+int Timer::read_ms() { return read_us() / 1000; }
+float Timer::read() { return (float)read_us() / 1000000.0f; }
+
+// ===========================================================================================================================================================================================
+// PINS
+// ===========================================================================================================================================================================================
+
+int host_pin_get(PinName pin) {
+    if (pin < 0 || pin >= HOST_PIN_COUNT) { return 0; }
+    return m_arrPins[pin];
+}
+
+// Drive a pin from a simulated peripheral
+void host_pin_set(PinName pin, int value) {
+    if (pin < 0 || pin >= HOST_PIN_COUNT) { return; }
+    m_arrPins[pin] = value ? 1 : 0;
+}
+
+int host_pin_watch(host_pin_watcher fnc) {
+    for (int i=0; i<HOST_WATCHERS; i++) {
+        if (m_arrPinWatchers[i] == NULL) { m_arrPinWatchers[i] = fnc; return 1; }
+    }
+    return 0;
+}
+
+// Drive a pin from the firmware and tell the simulated peripherals
+static void host_pin_output(PinName pin, int value) {
+    if (pin < 0 || pin >= HOST_PIN_COUNT) { return; }
+    m_arrPins[pin] = value ? 1 : 0;
+    for (int i=0; i<HOST_WATCHERS; i++) {
+        if (m_arrPinWatchers[i] != NULL) { m_arrPinWatchers[i](pin, m_arrPins[pin]); }
+    }
+}
+
+static void host_pin_direction(PinName pin, int output) {
+    if (pin < 0 || pin >= HOST_PIN_COUNT) { return; }
+    m_arrPinOutput[pin] = output;
+}
+
+// Fast GPIO port access, pins are numbered port * 32 + bit
+unsigned int host_gpio_read(int port, unsigned int mask) {
+    unsigned int value = 0;
+    host_dispatch();
+    for (int i=0; i<32; i++) {
+        if ((mask & (1u << i)) && host_pin_get((PinName)(port * 32 + i))) { value |= 1u << i; }
+    }
+    return value;
+}
+
+void host_gpio_write(int port, unsigned int mask, unsigned int value) {
+    for (int i=0; i<32; i++) {
+        PinName pin = (PinName)(port * 32 + i);
+        if ((mask & (1u << i)) && pin < HOST_PIN_COUNT && m_arrPinOutput[pin]) { host_pin_output(pin, (value >> i) & 1); }
+    }
+}
+
+void host_gpio_direction(int port, unsigned int mask, int output) {
+    for (int i=0; i<32; i++) {
+        if (mask & (1u << i)) { host_pin_direction((PinName)(port * 32 + i), output); }
+    }
+}
+
+DigitalIn::DigitalIn(PinName pin, const char *name) : _pin(pin) {}
+int DigitalIn::read() { host_dispatch(); return host_pin_get(_pin); }
+
+DigitalOut::DigitalOut(PinName pin, const char *name) : _pin(pin) { host_pin_direction(pin, 1); }
+void DigitalOut::write(int value) { host_pin_output(_pin, value); }
+int DigitalOut::read() { return host_pin_get(_pin); }
+
+DigitalInOut::DigitalInOut(PinName pin, const char *name) : _pin(pin), _output(0) {}
+void DigitalInOut::write(int value) { if (_output) { host_pin_output(_pin, value); } }
+int DigitalInOut::read() { host_dispatch(); return host_pin_get(_pin); }
+void DigitalInOut::output() { _output = 1; host_pin_direction(_pin, 1); }
+void DigitalInOut::input() { _output = 0; host_pin_direction(_pin, 0); }
+
+BusInOut::BusInOut(PinName p0, PinName p1, PinName p2, PinName p3, PinName p4, PinName p5, PinName p6, PinName p7,
+                   PinName p8, PinName p9, PinName p10, PinName p11, PinName p12, PinName p13, PinName p14, PinName p15,
+                   const char *name) : _output(0) {
+    PinName pins[16] = { p0, p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11, p12, p13, p14, p15 };
+    memcpy(_pin, pins, sizeof(_pin));
+}
+
+void BusInOut::write(int value) {
+    if (!_output) { return; }
+    for (int i=0; i<16; i++) {
+        if (_pin[i] != NC) { host_pin_output(_pin[i], (value >> i) & 1); }
+    }
+}
+
+int BusInOut::read() {
+    int value = 0;
+    host_dispatch();
+    for (int i=0; i<16; i++) {
+        if (_pin[i] != NC && host_pin_get(_pin[i])) { value |= (1 << i); }
+    }
+    return value;
+}
+
+void BusInOut::output() {
+    _output = 1;
+    for (int i=0; i<16; i++) { host_pin_direction(_pin[i], 1); }
+}
+
+void BusInOut::input() {
+    _output = 0;
+    for (int i=0; i<16; i++) { host_pin_direction(_pin[i], 0); }
+}
+
+PwmOut::PwmOut(PinName pin, const char *name) : _pin(pin), _value(0) {}
+void PwmOut::write(float value) { _value = value < 0 ? 0 : (value > 1 ? 1 : value); host_pin_output(_pin, _value >= 0.5f); }
+float PwmOut::read() { return _value; }
+
+// ===========================================================================================================================================================================================
+// SERIAL PORTS (USBTX is stdout, the UARTs are pseudo terminals)
+// ===========================================================================================================================================================================================
+
+Serial *Serial::_serials = NULL;
+static char m_arrSerialNames[HOST_UARTS][64];
+static Serial *m_arrSerialPorts[HOST_UARTS];
+
+Serial::Serial(PinName tx, PinName rx, const char *name) : _fd(-1), _peek(-1), _rxirq(NULL),
+    _baud(9600), _frameBits(10), _txDone(0), _loopback(0), _wireHead(0), _wireCount(0), _fifoHead(0), _fifoCount(0), _overruns(0) {
+    const char *loopback = getenv("BOD_SERIAL_LOOPBACK");
+
+    switch (tx) {
+        case USBTX: _uidx = 0; break;
+        case p9: _uidx = 1; break;
+        case p28: _uidx = 2; break;
+        default: _uidx = 3; break;
+    }
+    m_arrSerialPorts[_uidx] = this;
+    baud(_baud);
+
+    if (_uidx == 0) {
+        _fd = STDIN_FILENO;
+    } else if (loopback != NULL && (strcmp(loopback, "all") == 0 || strchr(loopback, '0' + _uidx) != NULL)) {
+        _loopback = 1;
+    } else {
+        _fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd >= 0 && grantpt(_fd) == 0 && unlockpt(_fd) == 0) {
+            snprintf(m_arrSerialNames[_uidx], sizeof(m_arrSerialNames[_uidx]), "%s", ptsname(_fd));
+        }
+    }
+
+    _nextSerial = _serials;
+    _serials = this;
+}
+
+const char *host_serial_name(int uidx) {
+    if (uidx < 1 || uidx >= HOST_UARTS || m_arrSerialNames[uidx][0] == 0) { return NULL; }
+    return m_arrSerialNames[uidx];
+}
+
+unsigned int host_serial_overruns(int uidx) {
+    if (uidx < 1 || uidx >= HOST_UARTS || m_arrSerialPorts[uidx] == NULL) { return 0; }
+    return m_arrSerialPorts[uidx]->overruns();
+}
+
+void Serial::baud(int baudrate) {
+    const char *override = getenv("BOD_SERIAL_BAUD");
+    if (_uidx != 0 && override != NULL && atoi(override) > 0) { baudrate = atoi(override); }
+    if (baudrate > 0) { _baud = baudrate; }
+}
+
+void Serial::format(int bits, Parity parity, int stop_bits) {
+    _frameBits = 1 + bits + (parity != None) + stop_bits;
+}
+
+int Serial::readable() {
+    unsigned char c;
+    if (_loopback) {
+        // Bytes that have finished arriving move into the receive FIFO, or are lost if it is full
+        while (_wireCount > 0 && (int)(host_us() - _wireTime[_wireHead]) >= 0) {
+            if (_fifoCount < HOST_UART_FIFO) {
+                _fifo[(_fifoHead + _fifoCount) % HOST_UART_FIFO] = _wire[_wireHead];
+                _fifoCount++;
+            } else {
+                _overruns++;
+            }
+            _wireHead = (_wireHead + 1) % HOST_UART_LOOP;
+            _wireCount--;
+        }
+        return _fifoCount > 0;
+    }
+    if (_peek >= 0) { return 1; }
+    if (_fd < 0) { return 0; }
+
+    struct pollfd pfd = { _fd, POLLIN, 0 };
+    if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN)) { return 0; }
+    if (read(_fd, &c, 1) != 1) { return 0; }
+    _peek = c;
+    return 1;
+}
+
+int Serial::getc() {
+    int c;
+    while (!readable()) { host_dispatch(); }
+    if (_loopback) {
+        c = _fifo[_fifoHead];
+        _fifoHead = (_fifoHead + 1) % HOST_UART_FIFO;
+        _fifoCount--;
+        return c;
+    }
+    c = _peek;
+    _peek = -1;
+    return c;
+}
+
+int Serial::putc(int c) {
+    unsigned char b = (unsigned char)c;
+    if (_uidx == 0) { return fputc(c, stdout); }
+
+    // Each byte takes a frame time on the wire, block while the transmit FIFO is full as the UART driver does
+    // The line is idle once the last byte is done (or so long ago that the clock has wrapped past it)
+    unsigned int frame = (unsigned int)(_frameBits * 1000000LL / _baud);
+    if (_txDone - host_us() > (HOST_UART_FIFO + 1) * frame) { _txDone = host_us(); }
+    while ((int)(_txDone - host_us()) > (int)(HOST_UART_FIFO * frame)) { host_dispatch(); }
+    _txDone += frame;
+
+    if (_loopback) {
+        if (_wireCount < HOST_UART_LOOP) {
+            _wire[(_wireHead + _wireCount) % HOST_UART_LOOP] = b;
+            _wireTime[(_wireHead + _wireCount) % HOST_UART_LOOP] = _txDone;
+            _wireCount++;
+        }
+        return c;
+    }
+    if (_fd >= 0 && write(_fd, &b, 1) != 1) { return -1; }
+    return c;
+}
+
+int Serial::printf(const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    for (int i=0; i<n && i<(int)sizeof(buffer) - 1; i++) { putc(buffer[i]); }
+    return n;
+}
+
+void Serial::attach(void (*fptr)(void), IrqType type) {
+    if (type == RxIrq) { _rxirq = fptr; }
+}
+
+// Run the receive interrupt of every port with data waiting, unless its UART IRQ is disabled
+void Serial::irq() {
+    for (Serial *s = _serials; s != NULL; s = s->_nextSerial) {
+        if (s->_rxirq == NULL || (m_intIRQMask & (1 << (UART0_IRQn + s->_uidx)))) { continue; }
+        if (s->readable()) { s->_rxirq(); }
+    }
+}
+
+// ===========================================================================================================================================================================================
+// LOCAL FILE SYSTEM (fopen is wrapped at link time, see Makefile)
+// ===========================================================================================================================================================================================
+
+static char m_strLocalName[32];
+
+LocalFileSystem::LocalFileSystem(const char* n) {
+    snprintf(m_strLocalName, sizeof(m_strLocalName), "/%s/", n);
+}
+
+extern "C" FILE *__real_fopen(const char *path, const char *mode);
+
+extern "C" FILE *__wrap_fopen(const char *path, const char *mode) {
+    char strPath[512];
+    const char *strDir;
+    size_t len = strlen(m_strLocalName);
+
+    if (len > 0 && strncmp(path, m_strLocalName, len) == 0) {
+        strDir = getenv("BOD_LOCAL_DIR");
+        snprintf(strPath, sizeof(strPath), "%s/%s", strDir ? strDir : "local", path + len);
+        return __real_fopen(strPath, mode);
+    }
+    return __real_fopen(path, mode);
+}
+
+// The USB serial port is unbuffered on the mbed, keep stdout the same so output interleaves with stderr
+static struct HostInit {
+    HostInit() { setvbuf(stdout, NULL, _IONBF, 0); }
+} m_objHostInit;
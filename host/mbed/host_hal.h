@@ -0,0 +1,37 @@
+/* Host-only hooks into the mbed stand-in, for simulated peripherals and benchmarks */
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include "mbed.h"
+
+/* Pin state table. Simulated peripherals drive firmware inputs with host_pin_set and
+ * are told about firmware outputs through a watcher. */
+typedef void (*host_pin_watcher)(PinName pin, int value);
+
+int host_pin_get(PinName pin);
+void host_pin_set(PinName pin, int value);
+int host_pin_watch(host_pin_watcher fnc);
+
+/* Microsecond clock used by Timer, Ticker and Timeout */
+unsigned int host_us();
+
+/* Run due timer events and serial receive interrupts (called from wait, Timer reads and Ethernet polls) */
+void host_dispatch();
+
+/* Hook called on every dispatch, lets simulated peripherals advance in time */
+int host_dispatch_watch(void (*fnc)(void));
+
+/* Ethernet backends. With neither, frames written by the firmware are discarded. */
+int host_ethernet_open_tap(const char *name);
+void host_ethernet_open_pipe(void (*fncTransmit)(const char *data, int length));
+void host_ethernet_inject(const char *data, int length);
+
+/* Serial ports other than USBTX are pseudo terminals, returns the slave name or NULL.
+ * Transmit is paced at the baud rate (BOD_SERIAL_BAUD overrides the firmware's setting) and
+ * BOD_SERIAL_LOOPBACK ("all" or a list such as "1,3") wires a port's transmit to its own receive. */
+const char *host_serial_name(int uidx);
+
+/* Bytes lost on a looped back port as its receive FIFO was full */
+unsigned int host_serial_overruns(int uidx);
+
+#endif
@@ -0,0 +1,339 @@
+/* Host stand-in for the mbed library (version 29 API subset used by the firmware).
+ *
+ * Pins are kept in a state table that simulated peripherals read and drive through
+ * host_hal.h. Interrupts (Ticker, Timeout, Serial RX) are dispatched cooperatively
+ * whenever the firmware waits, reads a Timer or polls Ethernet, which are the points
+ * where the real firmware spends its time, so handlers never run in the middle of
+ * other code.
+ */
+#ifndef MBED_H
+#define MBED_H
+
+#define MBED_LIBRARY_VERSION 29
+#define TARGET_LPC1768 1
+#define TARGET_HOST 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <stdint.h>
+
+/* Pin names, encoded as port * 32 + pin rather than GPIO addresses */
+enum PinName {
+    P0_0 = 0, P0_1, P0_2, P0_3, P0_4, P0_5, P0_6, P0_7
+      , P0_8, P0_9, P0_10, P0_11, P0_12, P0_13, P0_14, P0_15
+      , P0_16, P0_17, P0_18, P0_19, P0_20, P0_21, P0_22, P0_23
+      , P0_24, P0_25, P0_26, P0_27, P0_28, P0_29, P0_30, P0_31
+      , P1_0, P1_1, P1_2, P1_3, P1_4, P1_5, P1_6, P1_7
+      , P1_8, P1_9, P1_10, P1_11, P1_12, P1_13, P1_14, P1_15
+      , P1_16, P1_17, P1_18, P1_19, P1_20, P1_21, P1_22, P1_23
+      , P1_24, P1_25, P1_26, P1_27, P1_28, P1_29, P1_30, P1_31
+      , P2_0, P2_1, P2_2, P2_3, P2_4, P2_5, P2_6, P2_7
+      , P2_8, P2_9, P2_10, P2_11, P2_12, P2_13, P2_14, P2_15
+      , P2_16, P2_17, P2_18, P2_19, P2_20, P2_21, P2_22, P2_23
+      , P2_24, P2_25, P2_26, P2_27, P2_28, P2_29, P2_30, P2_31
+
+    // mbed DIP Pin Names
+      , p5 = P0_9
+      , p6 = P0_8
+      , p7 = P0_7
+      , p8 = P0_6
+      , p9 = P0_0
+      , p10 = P0_1
+      , p11 = P0_18
+      , p12 = P0_17
+      , p13 = P0_15
+      , p14 = P0_16
+      , p15 = P0_23
+      , p16 = P0_24
+      , p17 = P0_25
+      , p18 = P0_26
+      , p19 = P1_30
+      , p20 = P1_31
+      , p21 = P2_5
+      , p22 = P2_4
+      , p23 = P2_3
+      , p24 = P2_2
+      , p25 = P2_1
+      , p26 = P2_0
+      , p27 = P0_11
+      , p28 = P0_10
+      , p29 = P0_5
+      , p30 = P0_4
+
+    // Other mbed Pin Names
+      , LED1 = P1_18
+      , LED2 = P1_20
+      , LED3 = P1_21
+      , LED4 = P1_23
+      , USBTX = P0_2
+      , USBRX = P0_3
+
+    , NC = -1
+};
+typedef enum PinName PinName;
+
+#define HOST_PIN_COUNT 96
+#define HOST_UART_FIFO 16       // Transmit and receive FIFO depth of the LPC1768 UARTs
+#define HOST_UART_LOOP 64       // Bytes on the wire of a looped back UART
+
+enum PinMode {
+    PullUp = 0
+    , PullDown = 3
+    , PullNone = 2
+    , OpenDrain = 4
+};
+typedef enum PinMode PinMode;
+
+/* Interrupt numbers used with NVIC_EnableIRQ/NVIC_DisableIRQ */
+typedef enum IRQn {
+    TIMER0_IRQn = 1,
+    TIMER1_IRQn = 2,
+    TIMER2_IRQn = 3,
+    TIMER3_IRQn = 4,
+    UART0_IRQn = 5,
+    UART1_IRQn = 6,
+    UART2_IRQn = 7,
+    UART3_IRQn = 8,
+    EINT3_IRQn = 21,
+    ENET_IRQn = 28
+} IRQn_Type;
+
+/* Core clock and the Cortex-M3 DWT cycle counter, which counts host time scaled to the core clock */
+extern uint32_t SystemCoreClock;
+extern volatile uint32_t host_dwt_demcr;
+extern volatile uint32_t host_dwt_control;
+uint32_t host_dwt_cyccnt();
+#define DWT_DEMCR host_dwt_demcr
+#define DWT_CONTROL host_dwt_control
+#define DWT_CYCCNT (host_dwt_cyccnt())
+
+/* Main stack bounds for stack painting. The host has no shared SRAM block, so the top of the thread's stack stands in
+ * for the initial stack pointer and the heap is taken to end HOST_SRAM_SIZE below it, the size of the LPC1768 main block */
+#define HOST_SRAM_SIZE 32768
+unsigned int *host_stack_top();
+#define MEMORY_STACK_TOP() host_stack_top()
+#define MEMORY_STACK_POINTER() ((unsigned int *)__builtin_frame_address(0))
+#define MEMORY_HEAP_TOP() (host_stack_top() - HOST_SRAM_SIZE / sizeof(unsigned int))
+
+/* Port register access for the fast GPIO layer (clsFastGPIO.h), on the pin state table. Writes only reach pins set
+ * as outputs, either here or by a DigitalOut, DigitalInOut or BusInOut, and reads run due interrupts like DigitalIn */
+unsigned int host_gpio_read(int port, unsigned int mask);
+void host_gpio_write(int port, unsigned int mask, unsigned int value);
+void host_gpio_direction(int port, unsigned int mask, int output);
+#define FAST_GPIO_READ(port, mask) host_gpio_read((port), (mask))
+#define FAST_GPIO_WRITE(port, mask, value) host_gpio_write((port), (mask), (value))
+#define FAST_GPIO_DIRECTION(port, mask, output) host_gpio_direction((port), (mask), (output))
+
+static inline uint32_t __RBIT(uint32_t value) {
+    uint32_t result = 0;
+    for (int i=0; i<32; i++) { result = (result << 1) | ((value >> i) & 1); }
+    return result;
+}
+
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+void __disable_irq(void);
+void __enable_irq(void);
+
+void error(const char* format, ...);
+void wait(float s);
+void wait_ms(int ms);
+void wait_us(int us);
+
+namespace mbed {
+
+class DigitalIn {
+public:
+    DigitalIn(PinName pin, const char *name = NULL);
+    int read();
+    void mode(PinMode pull) {}
+    operator int() { return read(); }
+protected:
+    PinName _pin;
+};
+
+class DigitalOut {
+public:
+    DigitalOut(PinName pin, const char *name = NULL);
+    void write(int value);
+    int read();
+    DigitalOut& operator= (int value) { write(value); return *this; }
+    DigitalOut& operator= (DigitalOut& rhs) { write(rhs.read()); return *this; }
+    operator int() { return read(); }
+protected:
+    PinName _pin;
+};
+
+class DigitalInOut {
+public:
+    DigitalInOut(PinName pin, const char *name = NULL);
+    void write(int value);
+    int read();
+    void output();
+    void input();
+    void mode(PinMode pull) {}
+    DigitalInOut& operator= (int value) { write(value); return *this; }
+    operator int() { return read(); }
+protected:
+    PinName _pin;
+    int _output;
+};
+
+class BusInOut {
+public:
+    BusInOut(PinName p0, PinName p1 = NC, PinName p2 = NC, PinName p3 = NC,
+             PinName p4 = NC, PinName p5 = NC, PinName p6 = NC, PinName p7 = NC,
+             PinName p8 = NC, PinName p9 = NC, PinName p10 = NC, PinName p11 = NC,
+             PinName p12 = NC, PinName p13 = NC, PinName p14 = NC, PinName p15 = NC,
+             const char *name = NULL);
+    virtual ~BusInOut() {}
+    void write(int value);
+    int read();
+    void output();
+    void input();
+    void mode(PinMode pull) {}
+    BusInOut& operator= (int v) { write(v); return *this; }
+    operator int() { return read(); }
+protected:
+    PinName _pin[16];
+    int _output;
+};
+
+class PwmOut {
+public:
+    PwmOut(PinName pin, const char *name = NULL);
+    void write(float value);
+    float read();
+    void period(float seconds) {}
+    void period_ms(int ms) {}
+    void period_us(int us) {}
+    void pulsewidth(float seconds) {}
+    void pulsewidth_ms(int ms) {}
+    void pulsewidth_us(int us) {}
+    PwmOut& operator= (float value) { write(value); return *this; }
+    operator float() { return read(); }
+protected:
+    PinName _pin;
+    float _value;
+};
+
+/* Common base of Ticker and Timeout, events are kept in a list ordered by due time */
+class TimerEvent {
+public:
+    TimerEvent();
+    virtual ~TimerEvent();
+    static void irq();
+protected:
+    virtual void handler() = 0;
+    void insert(unsigned int timestamp);
+    void remove();
+    static unsigned int timestamp();
+    static TimerEvent *_head;
+    unsigned int _timestamp;
+    TimerEvent *_next;
+};
+
+class Timer {
+public:
+    Timer();
+    void start();
+    void stop();
+    void reset();
+    float read();
+    int read_ms();
+    int read_us();
+    operator float() { return read(); }
+protected:
+    int slicetime();
+    int _running;
+    unsigned int _start;
+    int _time;
+};
+
+class Ticker : public TimerEvent {
+public:
+    Ticker() : _function(NULL), _delay(0) {}
+    void attach(void (*fptr)(void), float t) { attach_us(fptr, (unsigned int)(t * 1000000.0f)); }
+    void attach_us(void (*fptr)(void), unsigned int t) { _function = fptr; setup(t); }
+    void detach() { remove(); _function = NULL; }
+protected:
+    void setup(unsigned int t) { remove(); _delay = t; insert(_delay + timestamp()); }
+    virtual void handler() { insert(_timestamp + _delay); if (_function) _function(); }
+    void (*_function)(void);
+    unsigned int _delay;
+};
+
+class Timeout : public TimerEvent {
+public:
+    Timeout() : _function(NULL) {}
+    void attach(void (*fptr)(void), float t) { attach_us(fptr, (unsigned int)(t * 1000000.0f)); }
+    void attach_us(void (*fptr)(void), unsigned int t) { remove(); _function = fptr; insert(timestamp() + t); }
+    void detach() { remove(); _function = NULL; }
+protected:
+    virtual void handler() { if (_function) _function(); }
+    void (*_function)(void);
+};
+
+class Serial {
+public:
+    Serial(PinName tx, PinName rx, const char *name = NULL);
+    enum Parity { None = 0, Odd, Even, Forced1, Forced0 };
+    enum IrqType { RxIrq = 0, TxIrq };
+    void baud(int baudrate);
+    void format(int bits = 8, Parity parity = Serial::None, int stop_bits = 1);
+    int putc(int c);
+    int getc();
+    int printf(const char* format, ...);
+    int readable();
+    int writeable() { return 1; }
+    void attach(void (*fptr)(void), IrqType type = RxIrq);
+    static void irq();
+    unsigned int overruns() const { return _overruns; }   // Host only, see host_serial_overruns
+protected:
+    int _uidx;
+    int _fd;
+    int _peek;
+    void (*_rxirq)(void);
+    int _baud;
+    int _frameBits;                                 // Start, data, parity and stop bits
+    unsigned int _txDone;                           // host_us() when the last byte written has been shifted out
+    int _loopback;                                  // Transmit wired to receive (BOD_SERIAL_LOOPBACK)
+    unsigned char _wire[HOST_UART_LOOP];            // Looped back bytes still being shifted, with their arrival times
+    unsigned int _wireTime[HOST_UART_LOOP];
+    int _wireHead, _wireCount;
+    unsigned char _fifo[HOST_UART_FIFO];            // Looped back bytes received and not yet read
+    int _fifoHead, _fifoCount;
+    unsigned int _overruns;
+    Serial *_nextSerial;
+    static Serial *_serials;
+};
+
+class Ethernet {
+public:
+    Ethernet();
+    virtual ~Ethernet() {}
+    enum Mode { AutoNegotiate, HalfDuplex10, FullDuplex10, HalfDuplex100, FullDuplex100 };
+    int write(const char *data, int size);
+    int send();
+    int receive();
+    int read(char *data, int size);
+    void address(char *mac);
+    int link() { return 1; }
+    void set_link(Mode mode) {}
+};
+
+/* Files opened as "/<name>/..." are served from the directory in BOD_LOCAL_DIR (default ./local) */
+class LocalFileSystem {
+public:
+    LocalFileSystem(const char* n);
+};
+
+} // namespace mbed
+
+using namespace mbed;
+using namespace std;
+
+#endif
@@ -0,0 +1,87 @@
+#include "clsExpanderSimulator.h"
+
+#include <stdlib.h>
+
+// Bus bit order, as wired in main.cpp
+static const PinName m_arrBusPins[8] = { p21, p22, p23, p24, p25, p26, p16, p15 };
+static const PinName m_arrOutputLatchPins[EXPSIM_OUTPUT_LATCHES] = { p6, p18, p19, p20, p29, p30 };
+static const int m_arrOutputLatchNames[EXPSIM_OUTPUT_LATCHES] = { 6, 18, 19, 20, 29, 30 };
+
+clsExpanderSimulator m_objExpanderSimulator;
+
+static void ExpanderSimulatorPinChanged(PinName pin, int value) { m_objExpanderSimulator.PinChanged(pin, value); }
+
+clsExpanderSimulator::clsExpanderSimulator() {
+    m_intStart = host_us();
+    m_intInputs = 0;
+    memset(m_arrOutputs, 0, sizeof(m_arrOutputs));
+    m_intOutputLatches = 0;
+    m_intInputLatches = 0;
+    memset(m_arrHalfPeriod, 0, sizeof(m_arrHalfPeriod));
+    
+    Configure(getenv("BOD_INPUTS"));
+    host_pin_watch(ExpanderSimulatorPinChanged);
+}
+
+// Parse "input=half period,..." settings
+void clsExpanderSimulator::Configure(const char *strConfig) {
+    unsigned int intInput, intHalfPeriod;
+    int intUsed;
+    
+    while (strConfig != NULL && sscanf(strConfig, " %u = %u%n", &intInput, &intHalfPeriod, &intUsed) == 2) {
+        if (intInput < EXPSIM_INPUTS) {
+            m_arrHalfPeriod[intInput] = intHalfPeriod;
+        } else {
+            fprintf(stderr, "BOD_INPUTS: no input %u\n", intInput);
+        }
+        
+        strConfig += intUsed;
+        if (*strConfig != ',') { break; }
+        strConfig++;
+    }
+}
+
+// Input levels now, every square wave starts off
+unsigned int clsExpanderSimulator::intInputs() {
+    unsigned int intElapsed = host_us() - m_intStart;
+    unsigned int intValue = m_intInputs;
+    
+    for (int i=0; i<EXPSIM_INPUTS; i++) {
+        if (m_arrHalfPeriod[i] != 0 && (intElapsed / m_arrHalfPeriod[i]) & 1) { intValue |= 1 << i; }
+    }
+    return intValue;
+}
+
+void clsExpanderSimulator::SetBus(int intValue) {
+    for (int i=0; i<8; i++) { host_pin_set(m_arrBusPins[i], (intValue >> i) & 1); }
+}
+
+int clsExpanderSimulator::intGetBus() {
+    int intValue = 0;
+    for (int i=0; i<8; i++) { intValue |= host_pin_get(m_arrBusPins[i]) << i; }
+    return intValue;
+}
+
+void clsExpanderSimulator::PinChanged(PinName pin, int value) {
+    for (int i=0; i<EXPSIM_OUTPUT_LATCHES; i++) {
+        if (pin != m_arrOutputLatchPins[i] || !value) { continue; }
+        
+        unsigned int intOutputs = intGetBus();
+        if (intOutputs != m_arrOutputs[i] || m_intOutputLatches == 0) {
+            fprintf(stderr, "%10u expsim: outputs latched by p%d = 0x%02X\n", host_us(), m_arrOutputLatchNames[i], intOutputs);
+        }
+        m_arrOutputs[i] = intOutputs;
+        m_intOutputLatches++;
+    }
+    
+    // The inputs are active low on the bus
+    if (pin == EXPSIM_INPUT_LATCH && value) {
+        if (!host_pin_get(EXPSIM_INPUT_CS2)) {
+            SetBus(~intInputs() & 0xFF);
+            m_intInputLatches++;
+        } else if (!host_pin_get(EXPSIM_INPUT_CS1)) {
+            SetBus((~intInputs() >> 8) & 0xFF);
+            m_intInputLatches++;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/* Simulated I/O expanders on the 8 bit data bus: two latched input banks and the output bank latches.
+ *
+ * An input bank is put on the bus while its chip select is low and the input latch is raised.
+ * The inputs are square waves set with BOD_INPUTS, a list of input=half period in microseconds
+ * counted from start up, e.g.
+ *   BOD_INPUTS="5=1000,12=250"
+ * so the times of the edges the firmware logs are known in advance. Inputs not listed stay off.
+ *
+ * An output bank is latched on the rising edge of its latch line, p6 for bank 0 and any of the pins the
+ * firmware allows for Output<n>Latch. Each change of a bank's outputs is printed to stderr.
+ */
+#ifndef EXPANDERSIMULATOR_H
+#define EXPANDERSIMULATOR_H 1
+
+#include "mbed.h"
+#include "host_hal.h"
+
+#define EXPSIM_INPUTS 16
+
+// Control pins, as wired in main.cpp
+#define EXPSIM_OUTPUT_LATCHES 6 // p6 then the pins clsOutputDriver allows for banks 1 to 3
+#define EXPSIM_INPUT_LATCH p7
+#define EXPSIM_INPUT_CS1 p5     // Bank 1, inputs 8-15
+#define EXPSIM_INPUT_CS2 p8     // Bank 0, inputs 0-7
+
+class clsExpanderSimulator {
+    private:
+        unsigned int    m_intStart;
+        unsigned int    m_arrHalfPeriod[EXPSIM_INPUTS];     // 0 for an input that never changes
+        
+        void            SetBus(int intValue);
+        int             intGetBus();
+        
+    public:
+        unsigned int    m_intInputs;            // Forced input levels, ORed with the square waves
+        unsigned int    m_arrOutputs[EXPSIM_OUTPUT_LATCHES]; // Last byte latched by each latch line
+        unsigned int    m_intOutputLatches;     // Times the outputs have been latched
+        unsigned int    m_intInputLatches;
+        
+        clsExpanderSimulator();
+        void            Configure(const char *strConfig);
+        unsigned int    intInputs();
+        
+        // Hook from the host HAL
+        void            PinChanged(PinName pin, int value);
+};
+
+extern clsExpanderSimulator m_objExpanderSimulator;
+#endif
@@ -0,0 +1,409 @@
+#include "clsPropellerSimulator.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+// Bus bit order, as wired in main.cpp
+static const PinName m_arrBusPins[8] = { p21, p22, p23, p24, p25, p26, p16, p15 };
+
+// Transitions of a reply byte the mbed never acknowledges are abandoned after this long (it gives up after 1000ms)
+#define PROPSIM_ABANDON_US 1500000
+
+clsPropellerSimulator m_objPropellerSimulator;
+
+static void PropellerSimulatorPinChanged(PinName pin, int value) { m_objPropellerSimulator.PinChanged(pin, value); }
+static void PropellerSimulatorPoll() { m_objPropellerSimulator.Poll(); }
+
+clsPropellerSimulator::clsPropellerSimulator() {
+    const char *strConfig = getenv("BOD_PROPSIM");
+    
+    m_objConfig.intAckLatencyUs = 5;
+    m_objConfig.intReplyDelayUs = 100;
+    m_objConfig.intByteGapUs = 5;
+    m_objConfig.dblDropAckRate = 0;
+    m_objConfig.dblCorruptRate = 0;
+    m_objConfig.intSeed = 1;
+    Reset();
+    
+    // Leave the bus unconnected, the firmware then waits forever for the version reply
+    if (strConfig != NULL && strcmp(strConfig, "off") == 0) { return; }
+    
+    Configure(strConfig);
+    host_pin_watch(PropellerSimulatorPinChanged);
+    host_dispatch_watch(PropellerSimulatorPoll);
+}
+
+// Parse "key=value,..." settings: ack, reply, gap (microseconds), drop, corrupt (probability 0-1) and seed
+void clsPropellerSimulator::Configure(const char *strConfig) {
+    char strKey[16];
+    double dblValue;
+    int intUsed;
+    
+    while (strConfig != NULL && sscanf(strConfig, " %15[a-z] = %lf%n", strKey, &dblValue, &intUsed) == 2) {
+        if (strcmp(strKey, "ack") == 0) { m_objConfig.intAckLatencyUs = (unsigned int)dblValue; }
+        else if (strcmp(strKey, "reply") == 0) { m_objConfig.intReplyDelayUs = (unsigned int)dblValue; }
+        else if (strcmp(strKey, "gap") == 0) { m_objConfig.intByteGapUs = (unsigned int)dblValue; }
+        else if (strcmp(strKey, "drop") == 0) { m_objConfig.dblDropAckRate = dblValue; }
+        else if (strcmp(strKey, "corrupt") == 0) { m_objConfig.dblCorruptRate = dblValue; }
+        else if (strcmp(strKey, "seed") == 0) { m_objConfig.intSeed = (unsigned int)dblValue; }
+        else { fprintf(stderr, "BOD_PROPSIM: unknown setting '%s'\n", strKey); }
+        
+        strConfig += intUsed;
+        if (*strConfig != ',') { break; }
+        strConfig++;
+    }
+    
+    Seed();
+}
+
+// Power up: idle and ready to receive, all axes stopped at zero with the reset flag set
+void clsPropellerSimulator::Reset() {
+    m_intState = IDLE;
+    m_intTCLK = 1;
+    m_intPacketLength = 0;
+    m_intReplyLength = 0;
+    m_intReplyIndex = 0;
+    Seed();
+    m_intLastUpdate = host_us();
+    m_intESTOP = 0;
+    m_intResetFlag = 1;
+    memset(&m_objCounters, 0, sizeof(m_objCounters));
+    memset(m_arrAxes, 0, sizeof(m_arrAxes));
+    
+    for (int i=0; i<PROPSIM_AXES; i++) {
+        m_arrAxes[i].lngStartSpeed = 100;
+        m_arrAxes[i].lngDriveSpeed = 1000;
+        m_arrAxes[i].lngHomeSpeed = 500;
+        m_arrAxes[i].lngAccelerationRate = 10000;
+        m_arrAxes[i].intEnabled = 1;
+    }
+    
+    host_pin_set(PROPSIM_RCLK, 1);
+}
+
+// Small seeds give runs of small values from xorshift, so spread the seed over all 32 bits first
+void clsPropellerSimulator::Seed() {
+    m_intRandom = (m_objConfig.intSeed + 1) * 2654435761u;
+    m_intRandom ^= m_intRandom >> 16;
+    if (m_intRandom == 0) { m_intRandom = 1; }
+}
+
+// xorshift32, so a seed always gives the same sequence of faults
+double clsPropellerSimulator::dblRandom() {
+    m_intRandom ^= m_intRandom << 13;
+    m_intRandom ^= m_intRandom >> 17;
+    m_intRandom ^= m_intRandom << 5;
+    return (double)m_intRandom / 4294967296.0;
+}
+
+void clsPropellerSimulator::SetBus(int intValue) {
+    for (int i=0; i<8; i++) { host_pin_set(m_arrBusPins[i], (intValue >> i) & 1); }
+}
+
+int clsPropellerSimulator::intGetBus() {
+    int intValue = 0;
+    for (int i=0; i<8; i++) { intValue |= host_pin_get(m_arrBusPins[i]) << i; }
+    return intValue;
+}
+
+void clsPropellerSimulator::Schedule(int intState, unsigned int intDelayUs) {
+    m_intState = intState;
+    m_intDue = host_us() + intDelayUs;
+}
+
+// Handshake edges driven by the mbed. Only TCLK matters, the bus is sampled when a byte is latched.
+void clsPropellerSimulator::PinChanged(PinName pin, int value) {
+    if (pin != PROPSIM_TCLK || value == m_intTCLK) { return; }
+    m_intTCLK = value;
+    
+    if (value == 0) {
+        switch (m_intState) {
+            case IDLE:
+                // Data is on the bus, acknowledge it once the cog has picked it up (or never)
+                if (m_objConfig.dblDropAckRate > 0 && dblRandom() < m_objConfig.dblDropAckRate) {
+                    m_objCounters.intDroppedAcks++;
+                    m_intState = DROPPED;
+                } else {
+                    Schedule(LATCHING, m_objConfig.intAckLatencyUs);
+                }
+                break;
+                
+            case PRESENTED:
+                // The mbed has read the reply byte
+                host_pin_set(PROPSIM_RCLK, 1);
+                m_intState = ACKED;
+                break;
+        }
+        return;
+    }
+    
+    switch (m_intState) {
+        case LATCHED:
+            // Ready for the next byte, or process the command once the ETX is in
+            host_pin_set(PROPSIM_RCLK, 1);
+            m_intState = IDLE;
+            if (m_arrPacket[m_intPacketLength - 1] == 3) {
+                ProcessPacket();
+                m_intPacketLength = 0;
+                if (m_intReplyLength > 0) { Schedule(REPLY_DELAY, m_objConfig.intReplyDelayUs); }
+            }
+            break;
+            
+        case LATCHING:
+        case DROPPED:
+            // The mbed timed out waiting for the acknowledge and has moved on to receiving
+            m_objCounters.intAborted++;
+            m_intPacketLength = 0;
+            m_intState = IDLE;
+            break;
+            
+        case ACKED:
+            // Straight back to idle after the ETX, the mbed may retry at once if the reply was bad
+            if (m_intReplyIndex >= m_intReplyLength) {
+                m_intReplyLength = 0;
+                m_intState = IDLE;
+            } else {
+                Schedule(NEXT_BYTE, m_objConfig.intByteGapUs);
+            }
+            break;
+    }
+}
+
+// Timed transitions and motion, called on every host dispatch
+void clsPropellerSimulator::Poll() {
+    if ((int)(host_us() - m_intLastUpdate) >= 1000) { UpdateMotion(); }
+    
+    switch (m_intState) {
+        case LATCHING:
+        case REPLY_DELAY:
+        case NEXT_BYTE:
+        case PRESENTED:
+            if ((int)(host_us() - m_intDue) < 0) { return; }
+            break;
+            
+        default:
+            return;
+    }
+    
+    switch (m_intState) {
+        case LATCHING:
+            if (m_intPacketLength >= PROPSIM_PACKETSIZE) { m_intPacketLength = 0; }
+            m_arrPacket[m_intPacketLength++] = (char)intGetBus();
+            m_objCounters.intBytesReceived++;
+            host_pin_set(PROPSIM_RCLK, 0);
+            m_intState = LATCHED;
+            break;
+            
+        case REPLY_DELAY:
+        case NEXT_BYTE:
+            SetBus(m_arrReply[m_intReplyIndex++]);
+            m_objCounters.intBytesSent++;
+            host_pin_set(PROPSIM_RCLK, 0);
+            Schedule(PRESENTED, PROPSIM_ABANDON_US);
+            break;
+            
+        case PRESENTED:
+            // The mbed gave up on this reply
+            m_objCounters.intAborted++;
+            m_intReplyLength = 0;
+            host_pin_set(PROPSIM_RCLK, 1);
+            m_intState = IDLE;
+            break;
+    }
+}
+
+// Validate a received command and build the reply. Bad packets are not answered, as on the real part.
+void clsPropellerSimulator::ProcessPacket() {
+    unsigned char *arrPacket = (unsigned char *)m_arrPacket;
+    int intChecksum = 0;
+    int intIsValue = 0;
+    long lngValue = 0, lngResult;
+    
+    m_intReplyLength = 0;
+    m_intReplyIndex = 0;
+    
+    // STX, node, command, [5 value chars], checksum, ETX
+    if ((m_intPacketLength != 5 && m_intPacketLength != 10) || arrPacket[0] != 2) {
+        m_objCounters.intBadPackets++;
+        return;
+    }
+    for (int i=1; i<m_intPacketLength-2; i++) { intChecksum ^= arrPacket[i]; }
+    if ((intChecksum | 0x80) != arrPacket[m_intPacketLength - 2]) {
+        m_objCounters.intBadPackets++;
+        return;
+    }
+    
+    // A zero parameter is never sent, the command then carries no value
+    if (m_intPacketLength == 10) {
+        for (int i=3; i<8; i++) { lngValue = lngValue * 128 + (arrPacket[i] - 32); }
+        lngValue = (long)(int)(unsigned int)lngValue;
+    }
+    
+    // Command codes are a multiple of four, offset by the axis number
+    m_objCounters.intCommands++;
+    UpdateMotion();
+    lngResult = lngExecute(arrPacket[2] & ~3, &m_arrAxes[arrPacket[2] & 3], lngValue, &intIsValue);
+    
+    if (intIsValue) {
+        ReplyValue(lngResult);
+    } else {
+        ReplyFlag(lngResult != 0);
+    }
+    
+    // Checksum of the reply data, bit 7 set, then ETX
+    intChecksum = 0;
+    for (int i=1; i<m_intReplyLength; i++) { intChecksum ^= (unsigned char)m_arrReply[i]; }
+    intChecksum |= 0x80;
+    if (m_objConfig.dblCorruptRate > 0 && dblRandom() < m_objConfig.dblCorruptRate) {
+        // Flip one data bit, bit 7 stays set so the byte still frames like a checksum
+        intChecksum ^= 1 << (m_intRandom % 7);
+        m_objCounters.intCorruptedReplies++;
+    }
+    m_arrReply[m_intReplyLength++] = (char)intChecksum;
+    m_arrReply[m_intReplyLength++] = 3;
+}
+
+// STX, '1' or '0', checksum, ETX
+void clsPropellerSimulator::ReplyFlag(int intValue) {
+    m_arrReply[0] = 2;
+    m_arrReply[1] = intValue ? '1' : '0';
+    m_intReplyLength = 2;
+}
+
+// STX, 5 character base 128 value offset by 32, checksum, ETX
+void clsPropellerSimulator::ReplyValue(long lngValue) {
+    m_arrReply[0] = 2;
+    for (int i=0; i<5; i++) { m_arrReply[1 + i] = (char)(((lngValue >> (28 - i * 7)) & 0x7F) + 32); }
+    m_intReplyLength = 6;
+}
+
+long clsPropellerSimulator::lngExecute(int intCommand, PropellerSimulatorAxis *objAxis, long lngValue, int *intIsValue) {
+    long lngResult = 1;
+    
+    *intIsValue = 0;
+    switch (intCommand) {
+        case 4: // HomeAxis
+            if (m_intESTOP) { lngResult = 0; break; }
+            objAxis->intHoming = 1;
+            objAxis->intHomed = 0;
+            objAxis->intStopping = 0;
+            objAxis->dblTarget = 0;
+            objAxis->intMoving = 1;
+            break;
+        case 8: // MoveABS
+        case 88: // LineMoveABS (single axis, interpolation is not modelled)
+        case 12: // MoveINC
+        case 92: // LineMoveINC
+            if (m_intESTOP) { lngResult = 0; break; }
+            objAxis->dblTarget = (intCommand == 8 || intCommand == 88) ? lngValue : floor(objAxis->dblPosition + 0.5) + lngValue;
+            objAxis->intHoming = 0;
+            objAxis->intStopping = 0;
+            objAxis->intMoving = 1;
+            break;
+        case 16: // StopAxis
+            objAxis->dblVelocity = 0;
+            objAxis->intMoving = 0;
+            objAxis->intHoming = 0;
+            break;
+        case 20: lngResult = objAxis->intMoving != 0; break; // IsAxisBusy
+        case 24: *intIsValue = 1; lngResult = (long)floor(objAxis->dblPosition + objAxis->dblEncoderOffset + 0.5); break; // GetEncoderPosition
+        case 28: *intIsValue = 1; lngResult = (long)floor(objAxis->dblPosition + 0.5); break; // GetLogicalPosition
+        case 32: objAxis->lngStartSpeed = lngValue; break;
+        case 36: objAxis->lngDriveSpeed = lngValue; break;
+        case 40: objAxis->lngHomeSpeed = lngValue; break;
+        case 44: objAxis->lngAccelerationRate = lngValue; break;
+        case 48: objAxis->lngMotorDirection = lngValue; break;
+        case 52: objAxis->lngEncoderDirection = lngValue; break;
+        case 56: *intIsValue = 1; lngResult = objAxis->lngStartSpeed; break;
+        case 60: *intIsValue = 1; lngResult = objAxis->lngDriveSpeed; break;
+        case 64: *intIsValue = 1; lngResult = objAxis->lngHomeSpeed; break;
+        case 68: *intIsValue = 1; lngResult = objAxis->lngAccelerationRate; break;
+        case 72: *intIsValue = 1; lngResult = objAxis->lngMotorDirection; break;
+        case 76: *intIsValue = 1; lngResult = objAxis->lngEncoderDirection; break;
+        case 80: objAxis->dblEncoderOffset = lngValue - objAxis->dblPosition; break; // SetEncoderPosition
+        case 84: // SetLogicalPosition, the encoder keeps its count
+            objAxis->dblEncoderOffset += objAxis->dblPosition - lngValue;
+            objAxis->dblPosition = lngValue;
+            break;
+        case 96: lngResult = objAxis->dblPosition <= 0; break; // QueryHomeInput, the switch is at zero
+        case 100: lngResult = objAxis->intHomed; break; // QueryHomeStatus
+        case 104: objAxis->intAuxOutput = (lngValue != 0); break;
+        case 108: objAxis->lngHomeTimeout = lngValue; break;
+        case 112: objAxis->lngHomeOffsetSpeed = lngValue; break;
+        case 116: objAxis->lngHomeChangeDirectionDelay = lngValue; break;
+        case 120: objAxis->intEnabled = !objAxis->intEnabled; break; // ToggleEnableLine
+        case 200: lngResult = m_intESTOP; break;
+        case 204: m_intESTOP = 0; break;
+        case 208: lngResult = m_intResetFlag; break;
+        case 212: m_intResetFlag = 0; break;
+        case 216: *intIsValue = 1; lngResult = PROPSIM_VERSION; break;
+        case 220: // MoveContinuous, a zero value is never sent so anything not positive is reverse
+            if (m_intESTOP) { lngResult = 0; break; }
+            objAxis->dblTarget = lngValue > 0 ? 1 : -1;
+            objAxis->intHoming = 0;
+            objAxis->intStopping = 0;
+            objAxis->intMoving = 2;
+            break;
+        case 224: objAxis->intStopping = (objAxis->intMoving != 0); break; // SlowStop
+        default: lngResult = 0; break;
+    }
+    
+    return lngResult;
+}
+
+// Advance each axis along a trapezoidal profile: start speed, acceleration to the drive (or home) speed, deceleration to stop on target
+void clsPropellerSimulator::UpdateMotion() {
+    unsigned int intNow = host_us();
+    double dblDelta = (intNow - m_intLastUpdate) / 1000000.0;
+    m_intLastUpdate = intNow;
+    
+    for (int i=0; i<PROPSIM_AXES; i++) {
+        PropellerSimulatorAxis *objAxis = &m_arrAxes[i];
+        double dblSpeed, dblAccel, dblDirection, dblRemaining, dblStep;
+        
+        if (objAxis->intMoving == 0) { continue; }
+        if (m_intESTOP || !objAxis->intEnabled) {
+            objAxis->dblVelocity = 0;
+            objAxis->intMoving = 0;
+            objAxis->intHoming = 0;
+            continue;
+        }
+        
+        dblSpeed = fabs(objAxis->dblVelocity);
+        dblAccel = objAxis->lngAccelerationRate > 0 ? objAxis->lngAccelerationRate : 1e12;
+        if (objAxis->intMoving == 2) {
+            dblDirection = objAxis->dblTarget;
+            dblRemaining = 1e18;
+        } else {
+            dblDirection = objAxis->dblTarget >= objAxis->dblPosition ? 1 : -1;
+            dblRemaining = fabs(objAxis->dblTarget - objAxis->dblPosition);
+        }
+        
+        if (dblSpeed < objAxis->lngStartSpeed && !objAxis->intStopping) { dblSpeed = objAxis->lngStartSpeed; }
+        if (objAxis->intStopping || dblRemaining <= dblSpeed * dblSpeed / (2 * dblAccel)) {
+            dblSpeed -= dblAccel * dblDelta;
+        } else {
+            dblSpeed += dblAccel * dblDelta;
+            if (dblSpeed > (objAxis->intHoming ? objAxis->lngHomeSpeed : objAxis->lngDriveSpeed)) {
+                dblSpeed = objAxis->intHoming ? objAxis->lngHomeSpeed : objAxis->lngDriveSpeed;
+            }
+        }
+        
+        // Never stall short of the target while decelerating onto it
+        if (dblSpeed < 1 && !objAxis->intStopping) { dblSpeed = 1; }
+        
+        dblStep = dblSpeed * dblDelta;
+        if (dblSpeed <= 0 || dblStep >= dblRemaining) {
+            objAxis->dblPosition = (dblSpeed <= 0) ? floor(objAxis->dblPosition + 0.5) : objAxis->dblTarget;
+            objAxis->dblVelocity = 0;
+            objAxis->intMoving = 0;
+            objAxis->intStopping = 0;
+            if (objAxis->intHoming && dblSpeed > 0) { objAxis->intHomed = 1; }
+            objAxis->intHoming = 0;
+            continue;
+        }
+        
+        objAxis->dblPosition += dblDirection * dblStep;
+        objAxis->dblVelocity = dblDirection * dblSpeed;
+    }
+}
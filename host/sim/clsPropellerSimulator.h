@@ -0,0 +1,100 @@
+/* Simulated Propeller motion controller on the far side of the 8 bit bus + RCLK/TCLK handshake.
+ *
+ * Driven entirely from pin watchers and host_dispatch(), so it runs inside the firmware's own
+ * busy-wait loops. Timing and faults are configured with BOD_PROPSIM, e.g.
+ *   BOD_PROPSIM="ack=20,reply=150,gap=10,drop=0.01,corrupt=0.02,seed=7"
+ * or with Configure() from a benchmark. BOD_PROPSIM=off leaves the bus unconnected.
+ */
+#ifndef PROPELLERSIMULATOR_H
+#define PROPELLERSIMULATOR_H 1
+
+#include "mbed.h"
+#include "host_hal.h"
+
+#define PROPSIM_AXES 4
+#define PROPSIM_PACKETSIZE 32
+#define PROPSIM_VERSION 100
+
+// Handshake pins, as wired in main.cpp
+#define PROPSIM_RCLK p11
+#define PROPSIM_TCLK p12
+
+struct PropellerSimulatorConfig {
+    unsigned int    intAckLatencyUs;    // Time to latch each byte received from the mbed
+    unsigned int    intReplyDelayUs;    // Time between the ETX of a command and the first reply byte
+    unsigned int    intByteGapUs;       // Time between reply bytes (the mbed times out after 1000us)
+    double          dblDropAckRate;     // Probability that a received byte is never acknowledged
+    double          dblCorruptRate;     // Probability that a reply checksum is corrupted
+    unsigned int    intSeed;            // Seed of the fault injection generator
+};
+
+struct PropellerSimulatorCounters {
+    unsigned int    intBytesReceived;
+    unsigned int    intBytesSent;
+    unsigned int    intCommands;
+    unsigned int    intBadPackets;      // Commands with a bad checksum or framing, not answered
+    unsigned int    intAborted;         // Transfers abandoned by the mbed part way through
+    unsigned int    intDroppedAcks;
+    unsigned int    intCorruptedReplies;
+};
+
+struct PropellerSimulatorAxis {
+    double          dblPosition;        // Logical position (steps)
+    double          dblEncoderOffset;   // Encoder position minus logical position
+    double          dblVelocity;        // Signed, steps per second
+    double          dblTarget;
+    int             intMoving;          // 0 idle, 1 to target, 2 continuous
+    int             intStopping;        // Slow stop in progress
+    int             intHoming;
+    int             intHomed;
+    long            lngStartSpeed, lngDriveSpeed, lngHomeSpeed, lngAccelerationRate;
+    long            lngMotorDirection, lngEncoderDirection;
+    long            lngHomeTimeout, lngHomeOffsetSpeed, lngHomeChangeDirectionDelay;
+    int             intEnabled;
+    int             intAuxOutput;
+};
+
+class clsPropellerSimulator {
+    private:
+        enum { IDLE, LATCHING, LATCHED, DROPPED, REPLY_DELAY, PRESENTING, PRESENTED, ACKED, NEXT_BYTE };
+        
+        int             m_intState;
+        int             m_intTCLK;              // Last level written by the mbed, writes repeat the same level
+        unsigned int    m_intDue;               // host_us() of the next timed transition
+        char            m_arrPacket[PROPSIM_PACKETSIZE];
+        int             m_intPacketLength;
+        char            m_arrReply[PROPSIM_PACKETSIZE];
+        int             m_intReplyLength;
+        int             m_intReplyIndex;
+        unsigned int    m_intRandom;
+        unsigned int    m_intLastUpdate;
+        
+        void            SetBus(int intValue);
+        int             intGetBus();
+        void            Seed();
+        double          dblRandom();
+        void            Schedule(int intState, unsigned int intDelayUs);
+        void            ProcessPacket();
+        void            ReplyFlag(int intValue);
+        void            ReplyValue(long lngValue);
+        long            lngExecute(int intCommand, PropellerSimulatorAxis *objAxis, long lngValue, int *intIsValue);
+        void            UpdateMotion();
+        
+    public:
+        PropellerSimulatorConfig    m_objConfig;
+        PropellerSimulatorCounters  m_objCounters;
+        PropellerSimulatorAxis      m_arrAxes[PROPSIM_AXES];
+        int                         m_intESTOP;
+        int                         m_intResetFlag;
+        
+        clsPropellerSimulator();
+        void            Configure(const char *strConfig);
+        void            Reset();
+        
+        // Hooks from the host HAL
+        void            PinChanged(PinName pin, int value);
+        void            Poll();
+};
+
+extern clsPropellerSimulator m_objPropellerSimulator;
+#endif
@@ -0,0 +1,286 @@
+/* Convert the firmware's trace records (Diagnostics/clsTrace.h) into Chrome trace JSON, which loads into
+ * chrome://tracing and ui.perfetto.dev.
+ *
+ * Records are captured live from the trace port (TCP 10012) or read from a raw dump written with -w.
+ * Spans (commands, propeller transactions, TCP sends, lwIP timers and serial receive interrupts) become
+ * begin/end slices, one track each. Every other event becomes an instant on the events track.
+ *
+ *   build/trace2json -c 0xdf -d 30 -w homing.raw -o homing.json
+ *   build/trace2json -i homing.raw -o homing.json
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#define RECORD_SIZE 12
+#define TRACE_PORT "10012"
+
+// Kept in step with clsTrace.h
+#define TRACE_TIMELINE 0x40
+#define TRACE_TIMELINE_ISR 0x80
+#define TRACE_SPAN_END 0x80
+#define TRACE_LOST 0
+
+struct Record {
+    unsigned long long time;        // Microseconds, unwrapped
+    unsigned int event;
+    int arg0;
+    int arg1;
+};
+
+struct EventName {
+    unsigned int event;
+    const char *name;
+    int track;                      // Tracks 1-5 are the spans, 6 holds the instants
+};
+
+static const EventName m_arrEvents[] = {
+    { 0x0101, "command framing error", 6 },
+    { 0x0102, "command checksum error", 6 },
+    { 0x0103, "unknown command", 6 },
+    { 0x0201, "propeller send timeout", 6 },
+    { 0x0202, "propeller receive timeout", 6 },
+    { 0x0203, "propeller bad reply", 6 },
+    { 0x0401, "serial bridge overflow", 6 },
+    { 0x0801, "serial data to TCP", 6 },
+    { 0x1001, "connection accepted", 6 },
+    { 0x1002, "connection closed", 6 },
+    { 0x2001, "command received", 6 },
+    { 0x4001, "command", 1 },
+    { 0x4002, "propeller", 2 },
+    { 0x4003, "tcp send", 3 },
+    { 0x4004, "lwip timer", 4 },
+    { 0x8001, "serial rx interrupt", 5 },
+};
+
+static const char *m_arrTracks[] = { "", "Commands", "Propeller", "TCP send", "lwIP timers", "Serial RX interrupts", "Events" };
+static const char *m_arrTimers[] = { "tcp_tmr", "etharp_tmr", "dns_tmr", "dhcp_fine_tmr", "dhcp_coarse_tmr" };
+static const char *m_arrServices[] = { "command", "serial 1", "serial 2", "serial 3" };
+
+static const char *m_strHost = "192.168.7.2";
+static const char *m_strPort = TRACE_PORT;
+static int m_intCategories = -1;
+static double m_dblDuration = 10;
+static const char *m_strInput = NULL;
+static const char *m_strRaw = NULL;
+static const char *m_strOutput = NULL;
+
+static unsigned long long now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static unsigned int get_u32(const unsigned char *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24); }
+static unsigned int get_u16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+static int open_connection() {
+    struct addrinfo hints, *addresses;
+    int fd;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(m_strHost, m_strPort, &hints, &addresses) != 0) { return -1; }
+    fd = socket(addresses->ai_family, addresses->ai_socktype, 0);
+    if (fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    return fd;
+}
+
+// Read raw records from the trace port for the capture duration
+static int capture(std::vector<unsigned char> &raw) {
+    unsigned char buffer[4096];
+    int fd = open_connection();
+
+    if (fd < 0) {
+        fprintf(stderr, "trace2json: cannot connect to %s:%s (%s)\n", m_strHost, m_strPort, strerror(errno));
+        return -1;
+    }
+    if (m_intCategories >= 0) {
+        unsigned char category = (unsigned char)m_intCategories;
+        if (write(fd, &category, 1) != 1) { fprintf(stderr, "trace2json: cannot set categories\n"); }
+    }
+
+    fprintf(stderr, "trace2json: capturing for %.0f s\n", m_dblDuration);
+    unsigned long long end = now_us() + (unsigned long long)(m_dblDuration * 1000000.0);
+    while (now_us() < end) {
+        struct pollfd p = { fd, POLLIN, 0 };
+        int remaining = (int)((end - now_us()) / 1000);
+        if (poll(&p, 1, remaining > 0 ? remaining : 0) <= 0) { continue; }
+        int n = read(fd, buffer, sizeof(buffer));
+        if (n <= 0) {
+            fprintf(stderr, "trace2json: connection closed\n");
+            break;
+        }
+        raw.insert(raw.end(), buffer, buffer + n);
+    }
+    close(fd);
+    return 0;
+}
+
+static int read_file(const char *path, std::vector<unsigned char> &raw) {
+    unsigned char buffer[4096];
+    FILE *f = fopen(path, "rb");
+    size_t n;
+
+    if (f == NULL) {
+        fprintf(stderr, "trace2json: cannot open %s (%s)\n", path, strerror(errno));
+        return -1;
+    }
+    while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0) { raw.insert(raw.end(), buffer, buffer + n); }
+    fclose(f);
+    return 0;
+}
+
+// Decode the records, unwrapping the 32 bit microsecond clock
+static void decode(const std::vector<unsigned char> &raw, std::vector<Record> &records) {
+    unsigned long long base = 0;
+    unsigned int last = 0;
+
+    for (size_t i=0; i + RECORD_SIZE <= raw.size(); i += RECORD_SIZE) {
+        Record r;
+        unsigned int time = get_u32(&raw[i]);
+        if (!records.empty() && time < last && last - time > 0x80000000u) { base += 0x100000000ULL; }
+        last = time;
+        r.time = base + time;
+        r.event = get_u16(&raw[i + 4]);
+        r.arg0 = (short)get_u16(&raw[i + 6]);
+        r.arg1 = (int)get_u32(&raw[i + 8]);
+        records.push_back(r);
+    }
+}
+
+static const EventName *find_event(unsigned int event) {
+    for (size_t i=0; i<sizeof(m_arrEvents) / sizeof(m_arrEvents[0]); i++) {
+        if (m_arrEvents[i].event == event) { return &m_arrEvents[i]; }
+    }
+    return NULL;
+}
+
+// Slice name of a span, from its arguments
+static void span_name(char *name, size_t size, unsigned int event, const Record &r) {
+    switch (event) {
+        case 0x4001: snprintf(name, size, "command %d (node %d)", r.arg0, r.arg1); break;
+        case 0x4002: snprintf(name, size, "propeller %d", r.arg0); break;
+        case 0x4003: snprintf(name, size, "send %s", (r.arg0 >= 0 && r.arg0 < 4) ? m_arrServices[r.arg0] : "?"); break;
+        case 0x4004: snprintf(name, size, "%s", (r.arg0 >= 0 && r.arg0 < 5) ? m_arrTimers[r.arg0] : "timer"); break;
+        case 0x8001: snprintf(name, size, "COM%d rx", r.arg0); break;
+        default: snprintf(name, size, "span %04x", event); break;
+    }
+}
+
+static void write_json(FILE *out, const std::vector<Record> &records) {
+    unsigned long long origin = records.empty() ? 0 : records[0].time;
+
+    // Timestamps are relative to the earliest record, which need not be the first (a dump from older firmware puts
+    // a lost record stamped at drain time ahead of the records it was drained with)
+    for (size_t i=1; i<records.size(); i++) {
+        if (records[i].time < origin) { origin = records[i].time; }
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"bod\"}}");
+    for (int t=1; t<=6; t++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", t, m_arrTracks[t]);
+        fprintf(out, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", t, t);
+    }
+
+    for (size_t i=0; i<records.size(); i++) {
+        const Record &r = records[i];
+        unsigned long long ts = r.time - origin;
+        int category = r.event >> 8;
+        char name[64];
+
+        if (r.event == TRACE_LOST) {
+            fprintf(out, ",\n{\"name\":\"%d records lost\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%llu,\"pid\":1,\"tid\":6}", r.arg1, ts);
+            continue;
+        }
+        if (category & (TRACE_TIMELINE | TRACE_TIMELINE_ISR)) {
+            unsigned int event = r.event & ~TRACE_SPAN_END;
+            const EventName *e = find_event(event);
+            span_name(name, sizeof(name), event, r);
+            fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%d,\"args\":{\"arg0\":%d,\"arg1\":%d}}",
+                name, e ? e->name : "span", (r.event & TRACE_SPAN_END) ? "E" : "B", ts, e ? e->track : 6, r.arg0, r.arg1);
+            continue;
+        }
+        const EventName *e = find_event(r.event);
+        if (e != NULL) {
+            snprintf(name, sizeof(name), "%s", e->name);
+        } else {
+            snprintf(name, sizeof(name), "event %04x", r.event);
+        }
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%llu,\"pid\":1,\"tid\":6,\"args\":{\"arg0\":%d,\"arg1\":%d}}",
+            name, ts, r.arg0, r.arg1);
+    }
+    fprintf(out, "\n]}\n");
+}
+
+static void usage() {
+    fprintf(stderr,
+        "usage: trace2json [options]\n"
+        "  -H host        firmware address (default 192.168.7.2, or BOD_HOST)\n"
+        "  -P port        trace port (default " TRACE_PORT ")\n"
+        "  -c mask        set the trace categories first, e.g. 0xdf for everything but the per-command debug records\n"
+        "  -d seconds     capture duration (default 10)\n"
+        "  -i file        convert a raw dump instead of capturing\n"
+        "  -w file        also write the raw records captured\n"
+        "  -o file        JSON output (default stdout)\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    std::vector<unsigned char> raw;
+    std::vector<Record> records;
+    int opt;
+
+    if (getenv("BOD_HOST") != NULL) { m_strHost = getenv("BOD_HOST"); }
+    while ((opt = getopt(argc, argv, "H:P:c:d:i:w:o:")) != -1) {
+        switch (opt) {
+            case 'H': m_strHost = optarg; break;
+            case 'P': m_strPort = optarg; break;
+            case 'c': m_intCategories = (int)strtol(optarg, NULL, 0) & 0xFF; break;
+            case 'd': m_dblDuration = atof(optarg); break;
+            case 'i': m_strInput = optarg; break;
+            case 'w': m_strRaw = optarg; break;
+            case 'o': m_strOutput = optarg; break;
+            default: usage();
+        }
+    }
+
+    if (m_strInput != NULL) {
+        if (read_file(m_strInput, raw) != 0) { return 1; }
+    } else if (capture(raw) != 0) {
+        return 1;
+    }
+
+    if (m_strRaw != NULL) {
+        FILE *f = fopen(m_strRaw, "wb");
+        if (f == NULL || fwrite(raw.data(), 1, raw.size(), f) != raw.size()) { fprintf(stderr, "trace2json: cannot write %s\n", m_strRaw); }
+        if (f != NULL) { fclose(f); }
+    }
+
+    decode(raw, records);
+
+    FILE *out = stdout;
+    if (m_strOutput != NULL && (out = fopen(m_strOutput, "w")) == NULL) {
+        fprintf(stderr, "trace2json: cannot write %s (%s)\n", m_strOutput, strerror(errno));
+        return 1;
+    }
+    write_json(out, records);
+    if (out != stdout) { fclose(out); }
+
+    fprintf(stderr, "trace2json: %zu records\n", records.size());
+    return 0;
+}
@@ -4,6 +4,18 @@
 #include "EthernetToSerial.h"
 #include "clsNetworkInterface.h"
 #include "clsPropellerInterface.h"
+#include "clsStatistics.h"
+#include "clsCommandTiming.h"
+#include "clsStageProfile.h"
+#include "clsTrace.h"
+#include "clsMemoryUsage.h"
+#include "clsPacketCapture.h"
+#include "clsBusArbiter.h"
+#include "clsInputMonitor.h"
+#include "clsOutputDriver.h"
+#include "clsAxisSnapshot.h"
+#include "clsRuleEngine.h"
+#include "clsPositionCapture.h"
 
 /* Propeller commands */
 #define HomeAxis = 4
@@ -55,7 +67,6 @@ PwmOut                  _led4(LED4);
 Serial                  pc(USBTX, USBRX);
 
 // I/O VARIABLES
-char                    m_bytOutputs[1];               // Array of output state bytes
 DigitalOut              out_OutputLatch(p6);
 DigitalOut              out_InputLatch(p7);
 DigitalOut              out_InputCS1(p5);
@@ -68,7 +79,7 @@ Serial                  serial_COM3(p13, p14); // tx, rx
 DigitalOut              out_COM3_485CS(p17);
 EthernetToSerial        *_ethernetToSerial[5];
 
-// PROPELLER INTERFACE
+// PROPELLER INTERFACE (these set the pins up, clsFastGPIO drives them)
 BusInOut                bus_DataBUS(p21, p22, p23, p24, p25, p26, p16, p15);
 DigitalIn               in_PropellerControlRX(p11);
 DigitalOut              out_PropellerControlTX(p12);
@@ -92,13 +103,12 @@ volatile int serial_out_pointer[4];
 
 // FUNCTION PROTOTYPES
 void ReadConfigFile();
+void SaveRule(int intRule);
 void SetupTCP(int intUseDHCP);
 void SetupIO();
 void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLength);
 void EthernetSerialPortDataReceived(int portnum, char *data, int length);
 void ProcessLoop_CheckSerialPorts();
-void ProcessLoop_SetOutputStates();
-int intReadInputState(int bank);
 void serial_COM1_Rx_interrupt();
 void serial_COM2_Rx_interrupt();
 void serial_COM3_Rx_interrupt();
@@ -110,10 +120,6 @@ int _vibrateAxis2State = 0;
 long _vibrateAxis1Distance = 0;
 long _vibrateAxis2Distance = 0;
 
-Timer _inputStateCheckTimer;
-Timer _inputStateChangedTimer;
-bool _lastInputState;
-
 
 long lngSendCommand(int intCommand, int intAxis, long lngParameterValue);
 
@@ -121,22 +127,27 @@ long lngSendCommand(int intCommand, int intAxis, long lngParameterValue);
 // MAIN PROCESS LOOP
 // ===========================================================================================================================================================================================
 int main() {
+    // Paint the free stack before anything else runs, so the deepest use can be measured
+    m_objMemoryUsage.Paint();
+    
     _led1.period_us(20);
     _led2.period_us(20);
     _led3.period_us(20);
     _led4.period_us(20);
     _led1 = 1;
 
+    // Start the clock used to time commands through the firmware, the input and output drivers time themselves from it too
+    m_objCommandTiming.Start();
+    m_objStageProfile.Start();
+    
     // Setup I/O devices
     SetupIO();
     
-    // Set initial variable values
-    for (int i=0; i<1; i++) {
-        m_bytOutputs[i] = 0x00;
-    }
-
-    // Set output states
-    ProcessLoop_SetOutputStates();
+    // Sample the inputs in the background, every change is logged with its time (see clsInputMonitor)
+    m_objInputMonitor.Setup(INPUT_SAMPLE_US);
+    
+    // Latch the outputs, from here on only when they change or the refresh is due (see clsOutputDriver)
+    m_objOutputDriver.Setup(&out_OutputLatch);
 
     // Initialise pointer values
     for (int i=0; i<4; i++) {
@@ -172,11 +183,14 @@ int main() {
 
     // Setup TCP/IP - pass in 0 for static IP, or 1 for DHCP
     m_objNetworkInterface->SetupTCP(0);
+    m_objStatistics.SetupUDPQuery(STATISTICS_UDP_PORT);
+    m_objTrace.Setup(&pc, TRACE_TCP_PORT);
+    m_objPacketCapture.Setup(CAPTURE_TCP_PORT);
 
     _led3 = 1;
 
     // Setup propeller interface
-    m_objPropellerInterface->SetupPropellerInterface(&bus_DataBUS, &in_PropellerControlRX, &out_PropellerControlTX, &_led3);
+    m_objPropellerInterface->SetupPropellerInterface(&_led3);
     //out_PropellerControlTX.write(1);
     
     _led4 = 1;
@@ -198,6 +212,13 @@ int main() {
     }
     
     printf("Propeller OK\r\n");
+    
+    // Keep the axis status for the snapshot command, read in the background (see clsAxisSnapshot)
+    m_objAxisSnapshot.Setup(m_objPropellerInterface);
+    
+    // Rules can send their commands now (see clsRuleEngine), and armed inputs capture the axis positions (see clsPositionCapture)
+    m_objRuleEngine.Setup(m_objPropellerInterface);
+    m_objPositionCapture.Setup(m_objPropellerInterface);
 
     /*
     m_objPropellerInterface->lngSendCommand(40, 1, 500000); // Home speed
@@ -225,39 +246,39 @@ int main() {
     Timer tmrStatus;
     tmrStatus.start();
     
-    // Start the timer looking for input state changes
-    _inputStateChangedTimer.start();
-    _inputStateCheckTimer.start();
-    
-    // Main program loop
+    // Main program loop, every stage is timed into the stage profile (see clsStageProfile)
+    unsigned int intLoopStart, intStageStart;
     while (1) {
+        intLoopStart = STAGE_PROFILE_NOW();
+        
+        // Read the encoder for any position captures, then send the commands of any rules that have fired, first as they are waiting on an input
+        m_objPositionCapture.Poll();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_POSITION_CAPTURE, intLoopStart);
+        m_objRuleEngine.Poll();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_RULES, intStageStart);
+        
         // Set output states
-        ProcessLoop_SetOutputStates();
+        m_objOutputDriver.Poll();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_OUTPUTS, intStageStart);
+        
+        // Read the next axis value for the snapshot when it is due
+        m_objAxisSnapshot.Poll();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_SNAPSHOT, intStageStart);
         
         // Poll serial ports
         ProcessLoop_CheckSerialPorts();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_SERIAL, intStageStart);
         //_ethernetToSerial[1]->CheckPortReceiveBuffer();
         //serial_COM1_Rx_interrupt();
         //serial_COM2_Rx_interrupt();
         //serial_COM3_Rx_interrupt();
         
-        /*
-        if (_inputStateCheckTimer.read_us() > 10000)
-        {
-            // Read input state
-            int inputState = intReadInputState(0) & (1 << 5);
-            if (inputState != _lastInputState) {
-                _lastInputState = inputState;
-                _inputStateChangedTimer.reset();
-            }
-            
-            // Reset the checker timer
-            _inputStateCheckTimer.reset();
-        }
-        */
-                
+        
         // Poll network interface
         device_poll();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_DEVICE_POLL, intStageStart);
+        m_objNetworkInterface->PollTimers();
+        intStageStart = m_objStageProfile.intRecord(PROFILE_TIMERS, intStageStart);
          
          /*
         if (_vibrateAxis1 > 0)
@@ -304,6 +325,14 @@ int main() {
             _led1 = ledState;
             tmrStatus.reset();
         }
+        intStageStart = m_objStageProfile.intRecord(PROFILE_LED, intStageStart);
+        
+        // Write out trace records, as much as the USB serial port or the trace connection can take without blocking,
+        // and any packet capture being downloaded
+        m_objTrace.Drain();
+        m_objPacketCapture.Drain();
+        m_objStageProfile.intRecord(PROFILE_TRACE, intStageStart);
+        m_objStageProfile.intRecord(PROFILE_LOOP, intLoopStart);
     }
 }
 
@@ -313,14 +342,15 @@ int main() {
 void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLength) {
     int     intCMD=0;
     long    lngValue;
-    int     bitPosition;
     int     intPortState;
+    unsigned int intProfileStart = STAGE_PROFILE_NOW();
     
     _led2 = 1;
     
     // Parse out the command
     intCMD = (int)((char*)&strCommsBuffer[2])[0];
-    if (TELNET_DEBUG) { printf("Received Command: %d, Node Address: %d\n", intCMD, intNodeAddress); }
+    TRACE(TRACE_COMMAND_RECEIVED, intCMD, intNodeAddress);
+    TRACE_BEGIN(TRACE_SPAN_COMMAND, intCMD, intNodeAddress);
     //printf("Received Command: %d, Node Address: %d\n", intCMD, intNodeAddress);
 
     // Check the node address of the packet
@@ -328,16 +358,27 @@ void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLe
         // Send packet to the propeller
         if (PROPELLER_DEBUG_HIGHLEVEL) { printf("Command received for the propeller: (%d) %s\n", intPacketLength, strCommsBuffer); }
         // Send the received command to the propeller
+        CMD_TIMING_MARK(TIMING_BUS_START);
         int intReplyLength = m_objPropellerInterface->intTX(strCommsBuffer, intPacketLength);
+        CMD_TIMING_MARK(TIMING_BUS_END);
         
         // If the packet sent and a reply received
         if (intReplyLength > 0) {
-            // Send the reply back to the TCP client
+            // Keep any axis status in it for the snapshot, then send the reply back to the TCP client
+            m_objAxisSnapshot.Observe(intCMD, intReplyLength);
             m_objNetworkInterface->SendReply(m_objPropellerInterface->m_strReply, intReplyLength);
+            m_objCommandTiming.Commit(intCMD);
+            m_objStageProfile.intRecord(PROFILE_COMMAND_PROPELLER, intProfileStart);
+            TRACE_END(TRACE_SPAN_COMMAND, intCMD, intNodeAddress);
             _led2 = 0;
             return;
         }
         
+        // No reply is sent, the reply stage is left as the bus end
+        CMD_TIMING_MARK(TIMING_REPLY);
+        m_objCommandTiming.Commit(intCMD);
+        m_objStageProfile.intRecord(PROFILE_COMMAND_PROPELLER, intProfileStart);
+        
     } else if (intNodeAddress == 3) {
         if (PROPELLER_DEBUG_HIGHLEVEL) { printf("Command for node the mbed!\n"); }
         //printf("Command for node the mbed!\n");
@@ -360,11 +401,8 @@ void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLe
                 // Extract the required output state from the packet
                 lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
                 
-                // Set the output bits
-                m_bytOutputs[0] = (char)lngValue; 
-                //m_bytOutputs[1] = (char)(lngValue>>8);
-                //m_bytOutputs[2] = (char)(lngValue>>16);
-                //m_bytOutputs[3] = (char)(lngValue>>24);
+                // Set every output bank, bank 0 in the low byte, latched together on the next pass of the main loop
+                m_objOutputDriver.Set(lngValue);
                 
                 // Reply with an OK
                 m_objNetworkInterface->SendReplyValue(1);
@@ -374,14 +412,8 @@ void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLe
                 // Parse input state
                 //lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
                 
-                // Read input states
-                int inputs0;
-                inputs0 = intReadInputState(0);
-                int inputs1;
-                inputs1 = intReadInputState(1);
-                
-                // Set port state value
-                intPortState = inputs0 + (inputs1 << 8);
+                // Debounced input states from the background sampler (see clsInputMonitor)
+                intPortState = m_objInputMonitor.m_intState;
                 //printf("Input State: %d\n", intPortState);
                 
                 // Reply with an OK
@@ -389,27 +421,25 @@ void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLe
                 break;
                 
             case 229:
-                // Parse required output
+                // Parse required output, 1 to OUTPUT_BITS, outputs 9 on are in banks 1 to 3
                 lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
-                bitPosition = 8 - (int)lngValue;
                 
                 // Switch output on
-                m_bytOutputs[0] |= (1 << bitPosition);
+                m_objOutputDriver.SetBits(m_objOutputDriver.intFittedBit(lngValue));
                 
-                // Reply with an OK
-                m_objNetworkInterface->SendReplyValue(1);
+                // Reply with an OK, or 0 for an output that does not exist or whose bank is not fitted
+                m_objNetworkInterface->SendReplyValue(m_objOutputDriver.intFittedBit(lngValue) != 0);
                 break;
                 
             case 230:
-                // Parse required output
+                // Parse required output, 1 to OUTPUT_BITS, outputs 9 on are in banks 1 to 3
                 lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
-                bitPosition = 8 - (int)lngValue;
                 
                 // Switch output off
-                m_bytOutputs[0] &= ~(1 << bitPosition);
+                m_objOutputDriver.ClearBits(m_objOutputDriver.intFittedBit(lngValue));
                 
-                // Reply with an OK
-                m_objNetworkInterface->SendReplyValue(1);
+                // Reply with an OK, or 0 for an output that does not exist or whose bank is not fitted
+                m_objNetworkInterface->SendReplyValue(m_objOutputDriver.intFittedBit(lngValue) != 0);
                 break;
 
             case 231: // START VIBRATE AXIS 1
@@ -452,93 +482,252 @@ void TCPPacketReceived(char *strCommsBuffer, int intNodeAddress, int intPacketLe
 
             case 235: // TIME SINCE INPUT STATE LAST CHANGED
                 long time;
-                time = _inputStateChangedTimer.read_ms();
+                time = (CMD_TIMING_NOW() - m_objInputMonitor.m_intLastChange) / 1000;
                 
                 // Reply with the time since the input state last changed
                 m_objNetworkInterface->SendReplyValue(time);
                 break;
 
+            case 236: { // STATISTICS
+                u32_t arrStatistics[STATISTICS_MAX_VALUES];
+                long arrStatisticsValues[STATISTICS_MAX_VALUES];
+                int intStatisticsCount;
+                intStatisticsCount = m_objStatistics.intGetValues(arrStatistics, STATISTICS_MAX_VALUES);
+                for (int i=0; i<intStatisticsCount; i++) { arrStatisticsValues[i] = arrStatistics[i]; }
+                
+                // Reply with every counter, same order as the UDP statistics query
+                m_objNetworkInterface->SendReplyValues(arrStatisticsValues, intStatisticsCount);
+                break;
+            }
+
+            case 237: { // TIMING OF THE LAST PROPELLER COMMAND
+                long arrTimingValues[TIMING_VALUES];
+                int intTimingCount;
+                intTimingCount = m_objCommandTiming.intGetValues(arrTimingValues);
+                
+                // Reply with the sequence number, command and stage durations (see clsCommandTiming)
+                m_objNetworkInterface->SendReplyValues(arrTimingValues, intTimingCount);
+                break;
+            }
+
+            case 238: { // STAGE PROFILE
+                // Parse the stage, 1 to PROFILE_STAGES, negative to read and then reset it
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                int intStage;
+                intStage = (lngValue < 0 ? -lngValue : lngValue) - 1;
+                if (intStage < 0 || intStage >= PROFILE_STAGES) {
+                    m_objNetworkInterface->SendReplyValue(-1);
+                    break;
+                }
+                
+                // Reply with the stage's histogram (see clsStageProfile)
+                long arrProfileValues[PROFILE_VALUES];
+                int intProfileCount;
+                intProfileCount = m_objStageProfile.intGetValues(intStage, arrProfileValues);
+                if (lngValue < 0) { m_objStageProfile.Reset(intStage); }
+                m_objNetworkInterface->SendReplyValues(arrProfileValues, intProfileCount);
+                break;
+            }
+
+            case 239: { // TRACE CATEGORIES
+                // Parse the categories, TRACE_SET plus the new set, anything else leaves them as they are
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                if ((lngValue & ~0xFF) == TRACE_SET) { m_objTrace.m_intCategories = lngValue & 0xFF; }
+                
+                // Reply with the categories, records dropped as the ring was full and records waiting to be written
+                long arrTraceValues[3];
+                arrTraceValues[0] = m_objTrace.m_intCategories;
+                arrTraceValues[1] = m_objTrace.m_intDropped;
+                arrTraceValues[2] = m_objTrace.intQueued();
+                m_objNetworkInterface->SendReplyValues(arrTraceValues, 3);
+                break;
+            }
+
+            case 240: { // MEMORY USE
+                // Reply with the stack, heap and lwIP memory high water marks (see clsMemoryUsage), a negative value resets the lwIP marks after reading
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                long arrMemoryValues[MEMORY_VALUES];
+                int intMemoryCount;
+                intMemoryCount = m_objMemoryUsage.intGetValues(arrMemoryValues);
+                if (lngValue < 0) { m_objMemoryUsage.Reset(); }
+                m_objNetworkInterface->SendReplyValues(arrMemoryValues, intMemoryCount);
+                break;
+            }
+
+            case 241: { // PACKET CAPTURE
+                // Parse the flags, CAPTURE_SET plus the new flags restarts the capture, then the port to capture (0 or left out for any)
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                if ((lngValue & ~0xFF) == CAPTURE_SET) {
+                    m_objPacketCapture.Start(lngValue & 0xFF, intPacketLength >= 15 ? m_objNetworkInterface->lngDecodeBase128ValueInReply(8) : 0);
+                }
+                
+                // Reply with the capture state (see clsPacketCapture), the frames are downloaded from CAPTURE_TCP_PORT
+                long arrCaptureValues[CAPTURE_VALUES];
+                int intCaptureCount;
+                intCaptureCount = m_objPacketCapture.intGetValues(arrCaptureValues);
+                m_objNetworkInterface->SendReplyValues(arrCaptureValues, intCaptureCount);
+                break;
+            }
+
+            case 242: { // INPUT EDGE LOG
+                // Parse the sequence number to read from, a negative value returns the current position only
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                
+                // Reply with the edges since then (see clsInputMonitor), ask again from the next sequence number returned
+                long arrEdgeValues[REPLYVALUESMAX];
+                int intEdgeCount;
+                intEdgeCount = m_objInputMonitor.intGetEdges(lngValue, arrEdgeValues, REPLYVALUESMAX);
+                m_objNetworkInterface->SendReplyValues(arrEdgeValues, intEdgeCount);
+                break;
+            }
+
+            case 243: { // INPUT DEBOUNCE
+                // Parse the input (0 to INPUT_BITS-1, INPUT_BITS for all) and the samples it must hold a new level for, just the input reads the counts
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                if (intPacketLength >= 15 && lngValue >= 0 && lngValue <= INPUT_BITS) {
+                    long lngCount = m_objNetworkInterface->lngDecodeBase128ValueInReply(8);
+                    for (int i=0; i<INPUT_BITS; i++) {
+                        if (lngValue == i || lngValue == INPUT_BITS) { m_objInputMonitor.SetDebounce(i, lngCount); }
+                    }
+                }
+                
+                // Reply with the count of every input, then the raw and debounced states
+                long arrDebounceValues[INPUT_BITS + 2];
+                for (int i=0; i<INPUT_BITS; i++) { arrDebounceValues[i] = m_objInputMonitor.intGetDebounce(i); }
+                arrDebounceValues[INPUT_BITS] = m_objInputMonitor.m_intRaw;
+                arrDebounceValues[INPUT_BITS + 1] = m_objInputMonitor.m_intState;
+                m_objNetworkInterface->SendReplyValues(arrDebounceValues, INPUT_BITS + 2);
+                break;
+            }
+
+            case 244: { // SNAPSHOT
+                // Reply with the inputs, outputs, ESTOP and busy flags and the position of every axis, from the last reads
+                long arrSnapshotValues[SNAPSHOT_VALUES];
+                m_objNetworkInterface->SendReplyValues(arrSnapshotValues, m_objAxisSnapshot.intGetValues(arrSnapshotValues));
+                break;
+            }
+
+            case 245: { // RULES
+                // Parse the rule word, its rule number in the top byte, and the value for a command rule. No value just reads the rules.
+                if (intPacketLength >= 10) {
+                    lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                    long lngRuleValue = (intPacketLength >= 15) ? m_objNetworkInterface->lngDecodeBase128ValueInReply(8) : 0;
+                    if (!m_objRuleEngine.intSetRule(RULE_NUMBER(lngValue), lngValue, lngRuleValue)) {
+                        m_objNetworkInterface->SendReplyValue(0);
+                        break;
+                    }
+                    SaveRule(RULE_NUMBER(lngValue));
+                }
+                
+                // Reply with the command counts and reaction times, then every rule (see clsRuleEngine)
+                long arrRuleValues[RULE_VALUES];
+                m_objNetworkInterface->SendReplyValues(arrRuleValues, m_objRuleEngine.intGetValues(arrRuleValues));
+                break;
+            }
+
+            case 246: { // ARM POSITION CAPTURE
+                // Parse the arming word (see clsPositionCapture), no value just reads the arming of every input
+                if (intPacketLength >= 10) {
+                    lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                    if (!m_objPositionCapture.intArm(lngValue)) {
+                        m_objNetworkInterface->SendReplyValue(0);
+                        break;
+                    }
+                }
+                
+                // Reply with the arming word of every input
+                long arrArmValues[POSITION_INPUTS];
+                for (int i=0; i<POSITION_INPUTS; i++) { arrArmValues[i] = m_objPositionCapture.intGetArm(i); }
+                m_objNetworkInterface->SendReplyValues(arrArmValues, POSITION_INPUTS);
+                break;
+            }
+
+            case 247: { // POSITION CAPTURES
+                // Parse the sequence number of the first capture wanted, negative for just the header
+                lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                
+                // Reply with as many captures as fit, oldest first (see clsPositionCapture)
+                long arrPositionValues[REPLYVALUESMAX];
+                m_objNetworkInterface->SendReplyValues(arrPositionValues, m_objPositionCapture.intGetCaptures(lngValue, arrPositionValues, REPLYVALUESMAX));
+                break;
+            }
+
+            case 248: { // PULSE OUTPUT
+                // Parse the output (1 to OUTPUT_BITS) with the number of pulses << 8 (0 until stopped), the width and then the period in
+                // microseconds. A width of 0 stops the output's pulses, no value just reads the pulse channels.
+                if (intPacketLength >= 15) {
+                    lngValue = m_objNetworkInterface->lngDecodeBase128ValueInReply(3);
+                    long lngWidth = m_objNetworkInterface->lngDecodeBase128ValueInReply(8);
+                    long lngPeriod = (intPacketLength >= 20) ? m_objNetworkInterface->lngDecodeBase128ValueInReply(13) : 0;
+                    if (lngWidth < 0 || lngPeriod < 0 || !m_objOutputDriver.intPulse(lngValue & 0xFF, (lngValue >> 8) & 0xFFFF, lngWidth, lngPeriod)) {
+                        m_objNetworkInterface->SendReplyValue(0);
+                        break;
+                    }
+                }
+                
+                // Reply with every pulse channel (see clsOutputDriver)
+                long arrPulseValues[OUTPUT_PULSE_VALUES];
+                m_objNetworkInterface->SendReplyValues(arrPulseValues, m_objOutputDriver.intGetPulses(arrPulseValues));
+                break;
+            }
+
             default:
-                printf("Parameter not found\n");
+                TRACE(TRACE_COMMAND_UNKNOWN, intCMD, 0);
                 m_objNetworkInterface->SendReplyValue(-1);
                 break;
         }
+        m_objStageProfile.intRecord(PROFILE_COMMAND_MBED, intProfileStart);
     }
     
+    TRACE_END(TRACE_SPAN_COMMAND, intCMD, intNodeAddress);
     _led2 = 0;        
 }
 
-// Read input state
-int intReadInputState(int bank) {
-    // Set input select pin for the required input bank
-    if (bank == 1) {
-        out_InputCS1 = 0;
-    } else {
-        out_InputCS2 = 0;
-    }
-    
-    // Toggle latch pin
-    out_InputLatch = 1;
-    wait_us(25);
-    
-    // Read databus
-    int data = bus_DataBUS;
-
-    // Reset input select pins and latch line
-    out_InputLatch = 0;
-    out_InputCS1 = 1;
-    out_InputCS2 = 1;
-
-    // Return the result
-    return (~data) & 0xFF;
-}
-
-// Process loop function that sets the I/O expander output states to the value stored in the output array
-void ProcessLoop_SetOutputStates() {
-    bus_DataBUS.output();
-    bus_DataBUS.write(m_bytOutputs[0]);
-    out_OutputLatch.write(1);
-    wait_us(25);
-    out_OutputLatch.write(0);
-    bus_DataBUS.input();
-    wait_us(25);
-}
-
 // ===========================================================================================================================================================================================
 
 // Interupt routine to read in data from serial port one when it arrives
 void serial_COM1_Rx_interrupt() {
     int portnum = 1;
+    int intStart = serial_in_pointer[portnum];
+    TRACE_BEGIN(TRACE_SPAN_SERIAL_ISR, portnum, 0);
     // Loop just in case more than one character is in UART's receive FIFO buffer. Stop if buffer full
     while ((serial_COM1.readable()) && (((serial_in_pointer[portnum] + 1) % buffer_size) != serial_out_pointer[portnum])) {
         serial_rx_buffer[portnum][serial_in_pointer[portnum]] = serial_COM1.getc();
         serial_in_pointer[portnum] = (serial_in_pointer[portnum] + 1) % buffer_size;
     }
+    TRACE_END(TRACE_SPAN_SERIAL_ISR, portnum, (serial_in_pointer[portnum] - intStart + buffer_size) % buffer_size);
 }
 
 // Interupt routine to read in data from serial port two when it arrives
 void serial_COM2_Rx_interrupt() {
     int portnum = 2;
+    int intStart = serial_in_pointer[portnum];
+    TRACE_BEGIN(TRACE_SPAN_SERIAL_ISR, portnum, 0);
     // Loop just in case more than one character is in UART's receive FIFO buffer. Stop if buffer full
     while ((serial_COM2.readable()) && (((serial_in_pointer[portnum] + 1) % buffer_size) != serial_out_pointer[portnum])) {
         serial_rx_buffer[portnum][serial_in_pointer[portnum]] = serial_COM2.getc();
         serial_in_pointer[portnum] = (serial_in_pointer[portnum] + 1) % buffer_size;
     }
+    TRACE_END(TRACE_SPAN_SERIAL_ISR, portnum, (serial_in_pointer[portnum] - intStart + buffer_size) % buffer_size);
 }
 
 // Interupt routine to read in data from serial port three when it arrives
 void serial_COM3_Rx_interrupt() {
     int portnum = 3;
+    int intStart = serial_in_pointer[portnum];
+    TRACE_BEGIN(TRACE_SPAN_SERIAL_ISR, portnum, 0);
     // Loop just in case more than one character is in UART's receive FIFO buffer. Stop if buffer full
     while ((serial_COM3.readable()) && (((serial_in_pointer[portnum] + 1) % buffer_size) != serial_out_pointer[portnum])) {
         serial_rx_buffer[portnum][serial_in_pointer[portnum]] = serial_COM3.getc();
         serial_in_pointer[portnum] = (serial_in_pointer[portnum] + 1) % buffer_size;
     }
+    TRACE_END(TRACE_SPAN_SERIAL_ISR, portnum, (serial_in_pointer[portnum] - intStart + buffer_size) % buffer_size);
 }
 
 // Callback from the ethernet serial ports when data has been received via ethernet
 void EthernetSerialPortDataReceived(int portnum, char *data, int length) {
     //printf("Ethernet Serial Data Received, port %d, '%s', length: %d\n", portnum, data, length);
+    int intStart = CMD_TIMING_NOW();
     
     data[length] = 0;
     for (int i=0; i<length; i++) {
@@ -549,6 +738,8 @@ void EthernetSerialPortDataReceived(int portnum, char *data, int length) {
             default: serial_COM3.putc(data[i]); break;
         }
     }
+    
+    FW_STATS_TIME(tcpToSerialUs[(portnum < 3 ? portnum : 3) - 1], CMD_TIMING_NOW() - intStart);
 }
 
 // Process loop function that checks the serial ports and performs serial to TCP bridging
@@ -556,11 +747,13 @@ void ProcessLoop_CheckSerialPorts() {
     // Buffer to store data in
     char data[1024];
     int intIndex;
+    int intStart;
         
     // Loop through each com port
     for (int portnum=1; portnum<=3; portnum++) {    
         // Reset buffer index
         intIndex = 0;
+        intStart = CMD_TIMING_NOW();
        
         // Only read if there is data in the buffer
         if(serial_in_pointer[portnum] != serial_out_pointer[portnum])
@@ -603,8 +796,9 @@ void ProcessLoop_CheckSerialPorts() {
         
         // If we have some data
         if (intIndex > 0) {
-            printf("Sending Serial Data to TCP (%d): %s\r\n", intIndex, data);
+            TRACE(TRACE_BRIDGE_TO_TCP, portnum, intIndex);
             m_objNetworkInterface->SendSerialData(portnum, data, intIndex);
+            FW_STATS_TIME(serialToTCPUs[portnum - 1], CMD_TIMING_NOW() - intStart);
         }
     }
 }
@@ -652,6 +846,98 @@ void SetSerialPortSettings() {
     }
 }
 
+// Read the static ARP entries (e.g. supervisory PC and gateway) which are pinned in the ARP cache
+void SetStaticARPEntries() {
+    char key[32];
+    char value[32];
+    char value2[32];
+    
+    for (int i=1;i<=STATIC_ARP_ENTRIES;i++) {
+        sprintf(key, "ARPStatic%dIP", i); if (!m_objConfigFile.getValue(key, &value[0], sizeof(value))) { continue; }
+        sprintf(key, "ARPStatic%dMAC", i); if (!m_objConfigFile.getValue(key, &value2[0], sizeof(value2))) { continue; }
+        
+        if (m_objNetworkInterface->intAddStaticARPEntry(value, value2)) {
+            printf("    Static ARP Entry %d: %s = %s\n", i, value, value2);
+        } else {
+            printf("    Static ARP Entry %d is invalid: %s = %s\n", i, value, value2);
+        }
+    }
+}
+
+// Read the input debounce counts, InputDebounce for every input then Input<n>Debounce (n from 0) for single inputs
+void SetInputDebounce() {
+    char key[32];
+    char value[32];
+    
+    if (m_objConfigFile.getValue("InputDebounce", &value[0], sizeof(value))) {
+        for (int i=0; i<INPUT_BITS; i++) { m_objInputMonitor.SetDebounce(i, atoi(value)); }
+        printf("    Input Debounce: %d samples\n", atoi(value));
+    }
+    
+    for (int i=0; i<INPUT_BITS; i++) {
+        sprintf(key, "Input%dDebounce", i); if (!m_objConfigFile.getValue(key, &value[0], sizeof(value))) { continue; }
+        m_objInputMonitor.SetDebounce(i, atoi(value));
+        printf("    Input %d Debounce: %d samples\n", i, atoi(value));
+    }
+}
+
+// Read the rules, Rule<n> (n from 0) is the rule word and the command value (see clsRuleEngine), e.g. Rule0=0x00100113 0
+void SetRules() {
+    char key[32];
+    char value[32];
+    char *strNext;
+    unsigned int intWord;
+    
+    for (int i=0; i<RULES; i++) {
+        sprintf(key, "Rule%d", i); if (!m_objConfigFile.getValue(key, &value[0], sizeof(value))) { continue; }
+        intWord = strtoul(value, &strNext, 0);
+        
+        if (m_objRuleEngine.intSetRule(i, intWord, strtol(strNext, NULL, 0))) {
+            printf("    Rule %d: %s\n", i, value);
+        } else {
+            printf("    Rule %d is invalid: %s\n", i, value);
+        }
+    }
+}
+
+// Keep a rule set by command 245 in the config file, so it is set again at start up
+void SaveRule(int intRule) {
+    char key[32];
+    char value[32];
+    long lngValue;
+    unsigned int intWord = m_objRuleEngine.intGetRule(intRule, &lngValue);
+    
+    sprintf(key, "Rule%d", intRule);
+    if (intWord == 0) {
+        m_objConfigFile.remove(key);
+    } else {
+        sprintf(value, "0x%08X %ld", intWord, lngValue);
+        m_objConfigFile.setValue(key, value);
+    }
+    
+    if (!m_objConfigFile.write("/local/config.cfg")) {
+        printf("Failed to write rule %d to the configuration file\n", intRule);
+    }
+}
+
+// Read the latch lines of output banks 1 to 3, Output<n>Latch is the mbed pin number (e.g. p18 or 18). Bank 0 is wired to p6.
+void SetOutputBanks() {
+    char key[32];
+    char value[32];
+    int intPin;
+    
+    for (int i=1; i<OUTPUT_BANKS; i++) {
+        sprintf(key, "Output%dLatch", i); if (!m_objConfigFile.getValue(key, &value[0], sizeof(value))) { continue; }
+        intPin = atoi(value[0] == 'p' ? &value[1] : &value[0]);
+        
+        if (m_objOutputDriver.intSetLatchPin(i, intPin)) {
+            printf("    Output Bank %d Latch: p%d\n", i, intPin);
+        } else {
+            printf("    Output Bank %d Latch is invalid: %s\n", i, value);
+        }
+    }
+}
+
 // Function which reads the device config file from flash memory and sets relevant variables
 void ReadConfigFile() {
     printf("==================================================\n");
@@ -674,6 +960,30 @@ void ReadConfigFile() {
     
     // Set the serial port settings
     SetSerialPortSettings();
+    
+    // Read the static ARP cache entries
+    SetStaticARPEntries();
+    
+    // Read the input debounce counts
+    SetInputDebounce();
+    
+    // Read the latch lines of the extra output banks
+    SetOutputBanks();
+    
+    // Read the output refresh interval
+    if (m_objConfigFile.getValue("OutputRefreshMs", &value[0], sizeof(value))) {
+        m_objOutputDriver.SetRefresh(atoi(value));
+        printf("    Output Refresh: %d ms\n", atoi(value));
+    }
+    
+    // Read the rules
+    SetRules();
+    
+    // Read the snapshot poll interval
+    if (m_objConfigFile.getValue("SnapshotPollMs", &value[0], sizeof(value))) {
+        m_objAxisSnapshot.SetPoll(atoi(value));
+        printf("    Snapshot Poll: %d ms\n", atoi(value));
+    }
 }
 
 // Function that sets up the I/O expander devices ready for operation
@@ -681,10 +991,8 @@ void SetupIO() {
     printf("==================================================\n");
     printf("Setting up I/O Devices\n");
 
-    out_InputCS1 = 1;
-    out_InputCS2 = 1;
-    out_InputLatch = 0;
+    // The bus arbiter owns the data bus direction and the input bank control lines (see clsBusArbiter)
+    m_objBusArbiter.Setup();
     
-    m_bytOutputs[0] = 0;
     out_OutputLatch = 0;
 }